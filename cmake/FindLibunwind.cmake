@@ -15,6 +15,7 @@
 #   LIBUNWIND_HAS_UNW_INIT_LOCAL        - True if unw_init_local() is found (optional).
 #   LIBUNWIND_HAS_UNW_BACKTRACE         - True if unw_backtrace() is found (required).
 #   LIBUNWIND_HAS_UNW_BACKTRACE_SKIP    - True if unw_backtrace_skip() is found (optional).
+#   LIBUNWIND_HAS_UNW_INIT_REMOTE       - True if the remote unwinding API and dwarf_search_unwind_table() are available (optional).
 #   LIBUNWIND_VERSION_STRING            - version number as a string (ex: "5.0.3")
 
 #=============================================================================
@@ -29,6 +30,8 @@ if(NOT EXISTS "${LIBUNWIND_INCLUDE_DIR}/unwind.h")
 endif()
 
 find_library(LIBUNWIND_LIBRARY unwind)
+# the remote unwinding API is part of the architecture specific library
+find_library(LIBUNWIND_GENERIC_LIBRARY unwind-generic)
 
 if(LIBUNWIND_INCLUDE_DIR AND EXISTS "${LIBUNWIND_INCLUDE_DIR}/libunwind-common.h")
   file(STRINGS "${LIBUNWIND_INCLUDE_DIR}/libunwind-common.h" LIBUNWIND_HEADER_CONTENTS REGEX "#define UNW_VERSION_[A-Z]+\t[0-9]*")
@@ -61,6 +64,11 @@ if (LIBUNWIND_LIBRARY)
   check_c_source_compiles ("#define UNW_LOCAL_ONLY 1\n#include <libunwind.h>\nint main() { void* buf[10]; unw_backtrace_skip(&buf, 10, 2); return 0; }" LIBUNWIND_HAS_UNW_BACKTRACE_SKIP)
   check_c_source_compiles ("#define UNW_LOCAL_ONLY 1\n#include <libunwind.h>\nint main() { return unw_set_cache_size(unw_local_addr_space, 1024, 0); }" LIBUNWIND_HAS_UNW_SET_CACHE_SIZE)
   check_c_source_compiles ("#define UNW_LOCAL_ONLY 1\n#include <libunwind.h>\nint main() { return unw_set_caching_policy(unw_local_addr_space, UNW_CACHE_PER_THREAD); }" LIBUNWIND_HAS_UNW_CACHE_PER_THREAD)
+  if (LIBUNWIND_GENERIC_LIBRARY)
+    set(CMAKE_REQUIRED_LIBRARIES ${LIBUNWIND_GENERIC_LIBRARY} ${LIBUNWIND_LIBRARY})
+    # the stack snapshots also need dwarf_search_unwind_table, which is exported but not part of the public API
+    check_c_source_compiles ("#include <libunwind.h>\nextern int UNW_OBJ(dwarf_search_unwind_table)(unw_addr_space_t, unw_word_t, unw_dyn_info_t*, unw_proc_info_t*, int, void*);\nint main() { unw_accessors_t accessors = {0}; unw_cursor_t cursor; unw_dyn_info_t info = {0}; unw_proc_info_t procInfo; unw_addr_space_t addressSpace = unw_create_addr_space(&accessors, 0); return unw_init_remote(&cursor, addressSpace, 0) + UNW_OBJ(dwarf_search_unwind_table)(addressSpace, 0, &info, &procInfo, 0, 0); }" LIBUNWIND_HAS_UNW_INIT_REMOTE)
+  endif()
   set(CMAKE_REQUIRED_QUIET ${CMAKE_REQUIRED_QUIET_SAVE})
   set(CMAKE_REQUIRED_LIBRARIES ${CMAKE_REQUIRED_LIBRARIES_SAVE})
   set(CMAKE_REQUIRED_INCLUDES ${CMAKE_REQUIRED_INCLUDES_SAVE})
@@ -75,6 +83,9 @@ FIND_PACKAGE_HANDLE_STANDARD_ARGS(Libunwind  REQUIRED_VARS  LIBUNWIND_INCLUDE_DI
 
 if (LIBUNWIND_FOUND)
   set(LIBUNWIND_LIBRARIES ${LIBUNWIND_LIBRARY})
+  if (LIBUNWIND_HAS_UNW_INIT_REMOTE)
+    list(INSERT LIBUNWIND_LIBRARIES 0 ${LIBUNWIND_GENERIC_LIBRARY})
+  endif()
   set(LIBUNWIND_INCLUDE_DIRS ${LIBUNWIND_INCLUDE_DIR})
 endif ()
 
@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <memory>
 
@@ -29,6 +30,7 @@
 #include "util/linereader.h"
 #include "util/macroutils.h"
 #include "util/pointermap.h"
+#include "util/recentallocations.h"
 
 #include "suppressions.h"
 
@@ -49,6 +51,12 @@ ostream& operator<<(ostream& out, const Index<Base> index)
     return out;
 }
 
+/// @return true for the records that got introduced with version 4 of the file format
+bool isFileFormatV4Record(char mode)
+{
+    return mode && strchr("MPFLfH!<>GDln", mode);
+}
+
 // boost's counter filter uses an int for the count which overflows for large streams; so replace it with a work alike.
 class byte_counter
 {
@@ -202,6 +210,9 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
     totalCost = {};
     peakTime = 0;
     if (pass == FirstPass) {
+        markers.clear();
+        phases.clear();
+        sampledIntervals.clear();
         if (!filterParameters.disableBuiltinSuppressions) {
             suppressions = builtinSuppressions();
         }
@@ -213,9 +224,17 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                        });
     }
     peakRSS = 0;
+    rss = 0;
+    allocatorStats = {};
+    peakAllocatorStats = {};
+    peakProcessMemory = {};
     for (auto& allocation : allocations) {
         allocation.clearCost();
     }
+    for (auto& tag : tags) {
+        tag.cost = {};
+        tag.maxConsumed = 0;
+    }
     unsigned int fileVersion = 0;
     bool debuggeeEncountered = false;
     bool inFilteredTime = !filterParameters.minTime;
@@ -228,6 +247,71 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
     // it holds the allocation info index. both can be used to find temporary
     // allocations, i.e. when a deallocation follows with the same data
     uint64_t lastAllocationPtr = 0;
+    // same as above, but for the last few allocations to find short-lived allocations,
+    // only used for files where the interpreter didn't classify the deallocations yet
+    RecentAllocations recentAllocations;
+    // the heap layout snapshot that is currently being read
+    HeapLayout layout;
+    auto finishLayout = [&]() {
+        if (layout.occupiedPages > heapLayout.occupiedPages) {
+            heapLayout = std::move(layout);
+        }
+        layout = {};
+    };
+
+    // only every n-th allocation got recorded while this is larger than one
+    uint32_t samplingRate = 1;
+
+    // the phases that are active while reading, the innermost one is the last
+    struct ActivePhase
+    {
+        StringIndex name;
+        int64_t start = 0;
+        AllocationData startCost;
+        int64_t peak = 0;
+    };
+    vector<ActivePhase> activePhases;
+    // the number of active phases that match filterParameters.phase
+    int filteredPhaseDepth = 0;
+    auto isFilteredPhase = [&](StringIndex name) {
+        return !filterParameters.phase.empty() && name.index && name.index <= strings.size()
+            && strings[name.index - 1] == filterParameters.phase;
+    };
+    auto inFilteredPhase = [&]() { return filterParameters.phase.empty() || filteredPhaseDepth > 0; };
+    auto endPhase = [&]() {
+        const auto phase = activePhases.back();
+        activePhases.pop_back();
+        if (isFilteredPhase(phase.name)) {
+            --filteredPhaseDepth;
+        }
+        if (pass != FirstPass) {
+            return;
+        }
+        auto it = find_if(phases.begin(), phases.end(), [&](const PhaseCost& cost) { return cost.name == phase.name; });
+        if (it == phases.end()) {
+            it = phases.insert(it, {phase.name, 0, 0, {}});
+        }
+        ++it->occurrences;
+        it->duration += timeStamp - phase.start;
+        it->cost.allocations += totalCost.allocations - phase.startCost.allocations;
+        it->cost.temporary += totalCost.temporary - phase.startCost.temporary;
+        it->cost.shortLived += totalCost.shortLived - phase.startCost.shortLived;
+        it->cost.leaked += totalCost.leaked - phase.startCost.leaked;
+        it->cost.peak = max(it->cost.peak, phase.peak - phase.startCost.leaked);
+    };
+
+    // find the index into the tags vector for the given tag, adding it when it was not encountered before
+    auto mapToTagIndex = [&](uint32_t tag) -> uint32_t {
+        if (tags.empty()) {
+            // the untagged allocations
+            tags.push_back({});
+        }
+        auto it = find_if(tags.begin(), tags.end(), [tag](const TagCost& cost) { return cost.tag == tag; });
+        if (it == tags.end()) {
+            it = tags.insert(it, {tag, {}, {}, 0});
+        }
+        return distance(tags.begin(), it);
+    };
 
     const auto uncompressedCount = in.component<byte_counter>(0);
     const auto compressedCount = in.component<byte_counter>(in.size() - 2);
@@ -240,6 +324,14 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
         parsingState.readUncompressedByte = uncompressedCount->bytes();
         parsingState.timestamp = timeStamp;
 
+        if (fileVersion < 4 && isFileFormatV4Record(reader.mode())) {
+            // older files cannot contain these records, don't misinterpret whatever this is
+            if (pass == FirstPass && !isReparsing) {
+                cerr << "unexpected line for file format version " << fileVersion << ": " << reader.line() << endl;
+            }
+            continue;
+        }
+
         if (reader.mode() == 's') {
             if (pass != FirstPass || isReparsing) {
                 continue;
@@ -304,7 +396,7 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 opNewIpIndices.push_back(index);
             }
         } else if (reader.mode() == '+') {
-            if (!inFilteredTime) {
+            if (!inFilteredTime || !inFilteredPhase()) {
                 continue;
             }
             AllocationInfo info;
@@ -320,6 +412,9 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 }
                 info = allocationInfos[allocationIndex.index];
                 lastAllocationPtr = allocationIndex.index;
+                if (fileVersion < 4) {
+                    recentAllocations.add(allocationIndex.index);
+                }
             } else { // backwards compatibility
                 uint64_t ptr = 0;
                 TraceIndex traceIndex;
@@ -333,6 +428,7 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 }
                 pointers.addPointer(ptr, allocationIndex);
                 lastAllocationPtr = ptr;
+                recentAllocations.add(ptr);
             }
 
             if (pass != FirstPass) {
@@ -340,6 +436,13 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 allocation.leaked += info.size;
                 ++allocation.allocations;
 
+                if (!tags.empty()) {
+                    auto& tag = tags[info.tagIndex];
+                    tag.cost.leaked += info.size;
+                    ++tag.cost.allocations;
+                    tag.maxConsumed = max(tag.maxConsumed, tag.cost.leaked);
+                }
+
                 handleAllocation(info, allocationIndex);
             }
 
@@ -353,20 +456,40 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                     for (auto& allocation : allocations) {
                         allocation.peak = allocation.leaked;
                     }
+                    for (auto& tag : tags) {
+                        tag.cost.peak = tag.cost.leaked;
+                    }
+                }
+            }
+            if (pass == FirstPass) {
+                for (auto& phase : activePhases) {
+                    phase.peak = max(phase.peak, totalCost.leaked);
                 }
             }
         } else if (reader.mode() == '-') {
-            if (!inFilteredTime) {
+            if (!inFilteredTime || !inFilteredPhase()) {
                 continue;
             }
             AllocationInfoIndex allocationInfoIndex;
             bool temporary = false;
+            bool shortLived = false;
             if (fileVersion >= 1) {
                 if (!(reader >> allocationInfoIndex)) {
                     cerr << "failed to parse line: " << reader.line() << endl;
                     continue;
                 }
                 temporary = lastAllocationPtr == allocationInfoIndex.index;
+                if (fileVersion >= 4) {
+                    // classified by the interpreter, which tracks the recent allocations by pointer,
+                    // the flag is omitted for allocations that aren't short-lived
+                    uint32_t isShortLived = 0;
+                    reader >> isShortLived;
+                    shortLived = isShortLived;
+                } else {
+                    // older files lack the flag, approximate it via the allocation info indices,
+                    // which overestimates for allocations of the same size and trace
+                    shortLived = recentAllocations.take(allocationInfoIndex.index);
+                }
             } else { // backwards compatibility
                 uint64_t ptr = 0;
                 if (!(reader >> ptr)) {
@@ -380,6 +503,7 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 }
                 allocationInfoIndex = taken.first;
                 temporary = lastAllocationPtr == ptr;
+                shortLived = recentAllocations.take(ptr);
             }
             lastAllocationPtr = 0;
 
@@ -388,6 +512,9 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
             if (temporary) {
                 ++totalCost.temporary;
             }
+            if (shortLived) {
+                ++totalCost.shortLived;
+            }
 
             if (pass != FirstPass) {
                 auto& allocation = allocations[info.allocationIndex.index];
@@ -395,6 +522,20 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 if (temporary) {
                     ++allocation.temporary;
                 }
+                if (shortLived) {
+                    ++allocation.shortLived;
+                }
+
+                if (!tags.empty()) {
+                    auto& tag = tags[info.tagIndex];
+                    tag.cost.leaked -= info.size;
+                    if (temporary) {
+                        ++tag.cost.temporary;
+                    }
+                    if (shortLived) {
+                        ++tag.cost.shortLived;
+                    }
+                }
             }
         } else if (reader.mode() == 'a') {
             if (pass != FirstPass || isReparsing) {
@@ -407,6 +548,10 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 continue;
             }
             info.allocationIndex = mapToAllocationIndex(traceIndex);
+            uint32_t tag = 0;
+            if (reader >> tag) {
+                info.tagIndex = mapToTagIndex(tag);
+            }
             allocationInfos.push_back(info);
 
         } else if (reader.mode() == '#') {
@@ -427,11 +572,123 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
             if (!inFilteredTime) {
                 continue;
             }
-            int64_t rss = 0;
             reader >> rss;
             if (rss > peakRSS) {
                 peakRSS = rss;
             }
+        } else if (reader.mode() == 'M') { // allocator statistics
+            AllocatorStats stats;
+            if (!(reader >> stats.arena) || !(reader >> stats.mmapped) || !(reader >> stats.inUse)
+                || !(reader >> stats.free)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            hasAllocatorStats = true;
+            allocatorStats = stats;
+            if (inFilteredTime && stats.held() > peakAllocatorStats.held()) {
+                peakAllocatorStats = stats;
+            }
+        } else if (reader.mode() == 'P') { // process memory from smaps_rollup
+            if (!inFilteredTime) {
+                continue;
+            }
+            ProcessMemory memory;
+            if (!(reader >> memory.anonymous) || !(reader >> memory.pss) || !(reader >> memory.swap)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            hasProcessMemory = true;
+            peakProcessMemory.anonymous = max(peakProcessMemory.anonymous, memory.anonymous);
+            peakProcessMemory.pss = max(peakProcessMemory.pss, memory.pss);
+            peakProcessMemory.swap = max(peakProcessMemory.swap, memory.swap);
+        } else if (reader.mode() == 'F') { // fragmentation sample
+            if (pass != FirstPass || isReparsing || !inFilteredTime) {
+                continue;
+            }
+            FragmentationSample sample;
+            sample.timeStamp = timeStamp;
+            if (!(reader >> sample.liveBytes) || !(reader >> sample.occupiedPages)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            fragmentation.push_back(sample);
+        } else if (reader.mode() == 'L') { // heap layout snapshot
+            if (pass != FirstPass || isReparsing) {
+                continue;
+            }
+            finishLayout();
+            layout.timeStamp = timeStamp;
+            if (!(reader >> layout.liveBytes) || !(reader >> layout.occupiedPages) || !(reader >> layout.holePages)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                layout = {};
+            }
+        } else if (reader.mode() == 'f') { // size class of the heap layout snapshot
+            if (pass != FirstPass || isReparsing) {
+                continue;
+            }
+            HeapLayout::SizeClass sizeClass;
+            if (!(reader >> sizeClass.sizeClass) || !(reader >> sizeClass.allocations)
+                || !(reader >> sizeClass.liveBytes) || !(reader >> sizeClass.occupiedPages)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            layout.sizeClasses.push_back(sizeClass);
+        } else if (reader.mode() == 'H') { // heatmap of the heap layout snapshot
+            if (pass != FirstPass || isReparsing) {
+                continue;
+            }
+            HeapLayout::AddressRange range;
+            if (!(reader >> range.start) || !(reader >> range.bucketSize)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            int64_t liveBytes = 0;
+            while (reader >> liveBytes) {
+                range.buckets.push_back(liveBytes);
+            }
+            layout.addressRanges.push_back(std::move(range));
+        } else if (reader.mode() == '!') { // marker
+            if (pass != FirstPass || !inFilteredTime) {
+                continue;
+            }
+            Marker marker;
+            if (!(reader >> marker.name)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            marker.timeStamp = timeStamp;
+            marker.consumed = totalCost.leaked;
+            markers.push_back(marker);
+        } else if (reader.mode() == '>') { // start of a phase
+            ActivePhase phase;
+            if (!(reader >> phase.name)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            phase.start = timeStamp;
+            phase.startCost = totalCost;
+            phase.peak = totalCost.leaked;
+            if (isFilteredPhase(phase.name)) {
+                ++filteredPhaseDepth;
+            }
+            activePhases.push_back(phase);
+        } else if (reader.mode() == '<') { // end of the innermost phase
+            if (activePhases.empty()) {
+                cerr << "end of a phase that never started" << endl;
+                continue;
+            }
+            endPhase();
+        } else if (reader.mode() == 'G') { // name of a tag
+            if (pass != FirstPass || isReparsing) {
+                continue;
+            }
+            uint32_t tag = 0;
+            StringIndex name;
+            if (!(reader >> tag) || !(reader >> name)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            tags[mapToTagIndex(tag)].name = name;
         } else if (reader.mode() == 'X') {
             if (debuggeeEncountered) {
                 cerr << "Duplicated debuggee entry - corrupt data file?" << endl;
@@ -441,6 +698,28 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
             if (pass != FirstPass && !isReparsing) {
                 handleDebuggee(reader.line().c_str() + 2);
             }
+        } else if (reader.mode() == 'D') { // sampling rate
+            if (pass != FirstPass) {
+                continue;
+            }
+            uint32_t rate = 0;
+            if (!(reader >> rate)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            if (rate > 1) {
+                if (samplingRate <= 1) {
+                    sampledIntervals.push_back({timeStamp, timeStamp, rate});
+                }
+                sampledIntervals.back().maxRate = std::max(sampledIntervals.back().maxRate, rate);
+            } else if (samplingRate > 1) {
+                sampledIntervals.back().end = timeStamp;
+            }
+            samplingRate = rate;
+        } else if (reader.mode() == 'l') {
+            leaksOnly = true;
+        } else if (reader.mode() == 'n') { // module of instruction pointers that are not symbolized yet
+            unsymbolized = true;
         } else if (reader.mode() == 'A') {
             if (pass != FirstPass || isReparsing)
                 continue;
@@ -483,7 +762,17 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
         }
     }
 
+    // phases that did not end before the application did
+    while (!activePhases.empty()) {
+        endPhase();
+    }
+
+    if (pass == FirstPass && samplingRate > 1) {
+        sampledIntervals.back().end = timeStamp;
+    }
+
     if (pass == FirstPass && !isReparsing) {
+        finishLayout();
         totalTime = timeStamp + 1;
         filterParameters.maxTime = totalTime;
     }
@@ -634,9 +923,20 @@ ForwardIt inplace_unique_reduce(ForwardIt first, ForwardIt last, BinaryPredicate
 
 void AccumulatedTraceData::diff(const AccumulatedTraceData& base)
 {
+    if (tags.empty() && !base.tags.empty()) {
+        // without any tag, all allocations are untagged
+        tags.push_back({0, {}, totalCost, totalCost.peak});
+    }
     totalCost -= base.totalCost;
     totalTime -= base.totalTime;
     peakRSS -= base.peakRSS;
+    peakAllocatorStats.arena -= base.peakAllocatorStats.arena;
+    peakAllocatorStats.mmapped -= base.peakAllocatorStats.mmapped;
+    peakAllocatorStats.inUse -= base.peakAllocatorStats.inUse;
+    peakAllocatorStats.free -= base.peakAllocatorStats.free;
+    peakProcessMemory.anonymous -= base.peakProcessMemory.anonymous;
+    peakProcessMemory.pss -= base.peakProcessMemory.pss;
+    peakProcessMemory.swap -= base.peakProcessMemory.swap;
     systemInfo.pages -= base.systemInfo.pages;
     systemInfo.pageSize -= base.systemInfo.pageSize;
 
@@ -679,6 +979,39 @@ void AccumulatedTraceData::diff(const AccumulatedTraceData& base)
         return ip;
     };
 
+    // the phases are matched by name, while the markers of different runs cannot be compared
+    markers.clear();
+    for (const auto& basePhase : base.phases) {
+        auto name = basePhase.name;
+        remapString(name);
+        auto it = find_if(phases.begin(), phases.end(), [name](const PhaseCost& phase) { return phase.name == name; });
+        if (it == phases.end()) {
+            it = phases.insert(it, {name, 0, 0, {}});
+        }
+        it->occurrences -= basePhase.occurrences;
+        it->duration -= basePhase.duration;
+        it->cost -= basePhase.cost;
+    }
+
+    // the tags are matched by their value
+    for (const auto& baseTag : base.tags) {
+        auto it = find_if(tags.begin(), tags.end(), [&baseTag](const TagCost& tag) { return tag.tag == baseTag.tag; });
+        if (it == tags.end()) {
+            // append, the allocation infos refer to the tags by index
+            it = tags.insert(it, {baseTag.tag, {}, {}, 0});
+        }
+        if (!it->name) {
+            it->name = baseTag.name;
+            remapString(it->name);
+        }
+        it->cost -= baseTag.cost;
+        it->maxConsumed -= baseTag.maxConsumed;
+    }
+    if (base.tags.empty() && !tags.empty()) {
+        tags.front().cost -= base.totalCost;
+        tags.front().maxConsumed -= base.totalCost.peak;
+    }
+
     // step 4: iterate over rhs data and find matching traces
     //         if no match is found, copy the data over
 
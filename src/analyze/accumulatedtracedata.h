@@ -74,9 +74,11 @@ struct AllocationInfo
     uint64_t size = 0;
     // index into AccumulatedTraceData::allocations
     AllocationIndex allocationIndex;
+    // index into AccumulatedTraceData::tags
+    uint32_t tagIndex = 0;
     bool operator==(const AllocationInfo& rhs) const
     {
-        return rhs.allocationIndex == allocationIndex && rhs.size == size;
+        return rhs.allocationIndex == allocationIndex && rhs.size == size && rhs.tagIndex == tagIndex;
     }
 };
 
@@ -113,6 +115,10 @@ struct AccumulatedTraceData
 
     bool shortenTemplates = false;
     bool fromAttached = false;
+    /// true when only the leaked allocations got recorded, cf. heaptrack --leaks-only
+    bool leaksOnly = false;
+    /// true when the symbolization got deferred and heaptrack_symbolize was not run on the data yet
+    bool unsymbolized = false;
     FilterParameters filterParameters;
 
     std::vector<Allocation> allocations;
@@ -128,6 +134,123 @@ struct AccumulatedTraceData
     };
     SystemInfo systemInfo;
 
+    // markers reported via heaptrack_report_mark
+    struct Marker
+    {
+        StringIndex name;
+        int64_t timeStamp = 0;
+        // the heap memory consumption at the time of the marker
+        int64_t consumed = 0;
+    };
+    std::vector<Marker> markers;
+
+    // the intervals in which libheaptrack only recorded every n-th allocation, as the output could not keep up
+    struct SampledInterval
+    {
+        int64_t start = 0;
+        int64_t end = 0;
+        // the highest sampling rate within the interval
+        uint32_t maxRate = 1;
+    };
+    std::vector<SampledInterval> sampledIntervals;
+
+    // the cost of all occurrences of a phase reported via heaptrack_report_push_phase, including nested phases
+    struct PhaseCost
+    {
+        StringIndex name;
+        int64_t occurrences = 0;
+        // total time spent in the phase
+        int64_t duration = 0;
+        // the peak is the largest increase of the memory consumption within one occurrence
+        AllocationData cost;
+    };
+    std::vector<PhaseCost> phases;
+
+    // the cost per tag set via heaptrack_report_set_tag, empty when the application never set a tag
+    struct TagCost
+    {
+        // zero for the untagged allocations, which always come first
+        uint32_t tag = 0;
+        // the name registered via heaptrack_report_register_tag, if any
+        StringIndex name;
+        // like for the allocations, the peak is the consumption at the time of the total peak
+        AllocationData cost;
+        // the highest consumption of this tag on its own
+        int64_t maxConsumed = 0;
+    };
+    std::vector<TagCost> tags;
+
+    // allocator-internal statistics, only available when the tracker sampled them
+    struct AllocatorStats
+    {
+        int64_t arena = 0;
+        int64_t mmapped = 0;
+        int64_t inUse = 0;
+        int64_t free = 0;
+
+        // the memory the allocator got from the system, whether it is in use or not
+        int64_t held() const
+        {
+            return arena + mmapped;
+        }
+    };
+    bool hasAllocatorStats = false;
+    // the latest sample while parsing
+    AllocatorStats allocatorStats;
+    // the sample in which the allocator held the most memory
+    AllocatorStats peakAllocatorStats;
+
+    // the memory of the process as seen by the kernel, only available when the tracker sampled it
+    struct ProcessMemory
+    {
+        int64_t anonymous = 0;
+        int64_t pss = 0;
+        int64_t swap = 0;
+    };
+    bool hasProcessMemory = false;
+    // the peak of every value on its own
+    ProcessMemory peakProcessMemory;
+
+    // the latest RSS in pages while parsing
+    int64_t rss = 0;
+
+    // fragmentation time series, only available when heaptrack_interpret analyzed the heap layout
+    struct FragmentationSample
+    {
+        int64_t timeStamp = 0;
+        int64_t liveBytes = 0;
+        int64_t occupiedPages = 0;
+    };
+    std::vector<FragmentationSample> fragmentation;
+
+    struct HeapLayout
+    {
+        struct SizeClass
+        {
+            // zero for the large allocations which are tracked separately
+            int64_t sizeClass = 0;
+            int64_t allocations = 0;
+            int64_t liveBytes = 0;
+            int64_t occupiedPages = 0;
+        };
+        struct AddressRange
+        {
+            uint64_t start = 0;
+            int64_t bucketSize = 0;
+            // live bytes per bucket
+            std::vector<int64_t> buckets;
+        };
+
+        int64_t timeStamp = 0;
+        int64_t liveBytes = 0;
+        int64_t occupiedPages = 0;
+        int64_t holePages = 0;
+        std::vector<SizeClass> sizeClasses;
+        std::vector<AddressRange> addressRanges;
+    };
+    // the heap layout snapshot with the most occupied pages
+    HeapLayout heapLayout;
+
     // our indices are sequentially increasing thus a new allocation can only ever
     // occur with an index larger than any other we encountered so far
     // this can be used to our advantage in speeding up the mapToAllocationIndex calls.
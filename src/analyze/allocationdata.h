@@ -15,6 +15,8 @@ struct AllocationData
     int64_t allocations = 0;
     // number of temporary allocations
     int64_t temporary = 0;
+    // number of short-lived allocations, i.e. those freed while still among the most recent allocations
+    int64_t shortLived = 0;
     // amount of bytes leaked
     int64_t leaked = 0;
     // largest amount of bytes allocated
@@ -28,7 +30,8 @@ struct AllocationData
 
 inline bool operator==(const AllocationData& lhs, const AllocationData& rhs)
 {
-    return lhs.allocations == rhs.allocations && lhs.temporary == rhs.temporary && lhs.leaked == rhs.leaked
+    return lhs.allocations == rhs.allocations && lhs.temporary == rhs.temporary
+        && lhs.shortLived == rhs.shortLived && lhs.leaked == rhs.leaked
         && lhs.peak == rhs.peak;
 }
 
@@ -41,6 +44,7 @@ inline AllocationData& operator+=(AllocationData& lhs, const AllocationData& rhs
 {
     lhs.allocations += rhs.allocations;
     lhs.temporary += rhs.temporary;
+    lhs.shortLived += rhs.shortLived;
     lhs.peak += rhs.peak;
     lhs.leaked += rhs.leaked;
     return lhs;
@@ -50,6 +54,7 @@ inline AllocationData& operator-=(AllocationData& lhs, const AllocationData& rhs
 {
     lhs.allocations -= rhs.allocations;
     lhs.temporary -= rhs.temporary;
+    lhs.shortLived -= rhs.shortLived;
     lhs.peak -= rhs.peak;
     lhs.leaked -= rhs.leaked;
     return lhs;
@@ -16,6 +16,8 @@ struct FilterParameters
 {
     int64_t minTime = 0;
     int64_t maxTime = std::numeric_limits<int64_t>::max();
+    // when set, only allocations and deallocations while a phase of this name is active are taken into account
+    std::string phase;
     std::vector<std::string> suppressions;
     bool disableEmbeddedSuppressions = false;
     bool disableBuiltinSuppressions = false;
@@ -54,6 +54,8 @@ QString ChartModel::typeString() const
         return i18n("Memory Consumed");
     case Temporary:
         return i18n("Temporary Allocations");
+    case Memory:
+        return i18n("Memory Usage");
     default:
         return QString();
     }
@@ -85,6 +87,15 @@ QVariant ChartModel::headerData(int section, Qt::Orientation orientation, int ro
                 return i18n("Total Memory Consumption");
             case Temporary:
                 return i18n("Total Temporary Allocations");
+            case Memory:
+                return i18n("RSS");
+            }
+        } else if (m_type == Memory) {
+            switch (section / 2) {
+            case HeapConsumed:
+                return i18n("Heap Memory Consumption");
+            case AllocatorRetained:
+                return i18n("Retained by Allocator");
             }
         } else {
             auto id = m_data.labels.value(section / 2).functionId;
@@ -158,7 +169,14 @@ QVariant ChartModel::data(const QModelIndex& index, int role) const
 
     const auto cost = data.cost[column];
     if (role == Qt::ToolTipRole) {
-        const QString time = Util::formatTime(data.timeStamp);
+        QString time = Util::formatTime(data.timeStamp);
+        // the heap charts are incomplete where only every n-th allocation got recorded
+        const auto previousTimeStamp = index.row() ? m_data.rows.at(index.row() - 1).timeStamp : 0;
+        const auto rate = m_type == Memory ? 1 : samplingRateBetween(previousTimeStamp, data.timeStamp);
+        if (rate > 1) {
+            time = i18nc("%1: the formatted time, %2: the sampling rate",
+                         "%1 <i>(only every %2. allocation got recorded)</i>", time, rate);
+        }
         auto byteCost = [cost]() -> QString {
             const auto formatted = Util::formatBytes(cost);
             if (cost > 1024) {
@@ -176,7 +194,16 @@ QVariant ChartModel::data(const QModelIndex& index, int role) const
                 return i18n("<qt>%1 temporary allocations in total after %2</qt>", cost, time);
             case Consumed:
                 return i18n("<qt>%1 consumed in total after %2</qt>", byteCost(), time);
+            case Memory:
+                return i18n("<qt>%1 RSS (including heaptrack overhead) after %2</qt>", byteCost(), time);
+            }
+        } else if (m_type == Memory) {
+            if (column == HeapConsumed) {
+                return i18n("<qt>%1 heap memory consumed after %2</qt>", byteCost(), time);
             }
+            return i18n("<qt>%1 held by the allocator after %2 in addition to the heap memory consumption. "
+                        "Trimming the heap or tuning the arenas could release it.</qt>",
+                        byteCost(), time);
         } else {
             auto label = Util::toString(m_data.labels.value(column), *m_data.resultData, Util::Long);
             switch (m_type) {
@@ -192,6 +219,8 @@ QVariant ChartModel::data(const QModelIndex& index, int role) const
                 return i18n("<qt>%2 consumed after %3 from:<p "
                             "style='margin-left:10px'>%1</p></qt>",
                             label, byteCost(), time);
+            case Memory:
+                break;
             }
         }
         return {};
@@ -291,4 +320,20 @@ qint64 ChartModel::totalCostAt(qint64 timeStamp) const
     return it->cost[0];
 }
 
+bool ChartModel::hasSampledIntervals() const
+{
+    return m_type != Memory && !m_data.sampledIntervals.isEmpty();
+}
+
+quint32 ChartModel::samplingRateBetween(qint64 start, qint64 end) const
+{
+    quint32 rate = 1;
+    for (const auto& interval : m_data.sampledIntervals) {
+        if (interval.start <= end && interval.end >= start) {
+            rate = std::max(rate, interval.maxRate);
+        }
+    }
+    return rate;
+}
+
 #include "moc_chartmodel.cpp"
@@ -32,10 +32,20 @@ struct ChartRows
 };
 Q_DECLARE_TYPEINFO(ChartRows, Q_MOVABLE_TYPE);
 
+// the time span in which libheaptrack only recorded every n-th allocation, time in ms
+struct ChartSampledInterval
+{
+    qint64 start = 0;
+    qint64 end = 0;
+    quint32 maxRate = 1;
+};
+Q_DECLARE_TYPEINFO(ChartSampledInterval, Q_PRIMITIVE_TYPE);
+
 struct ChartData
 {
     QVector<ChartRows> rows;
     QHash<int, Symbol> labels;
+    QVector<ChartSampledInterval> sampledIntervals;
     std::shared_ptr<const ResultData> resultData;
 };
 Q_DECLARE_METATYPE(ChartData)
@@ -50,6 +60,13 @@ public:
         Consumed,
         Allocations,
         Temporary,
+        Memory,
+    };
+    // the rows of a Memory chart, its total row is the RSS
+    enum MemoryRow
+    {
+        HeapConsumed = 1,
+        AllocatorRetained = 2,
     };
     explicit ChartModel(Type type, QObject* parent = nullptr);
     virtual ~ChartModel();
@@ -71,6 +88,11 @@ public:
 
     qint64 totalCostAt(qint64 timeStamp) const;
 
+    /// @return true when only every n-th allocation got recorded in some parts of a heap chart
+    bool hasSampledIntervals() const;
+    /// @return the highest sampling rate from @p start to @p end, or 1 when all allocations got recorded then
+    quint32 samplingRateBetween(qint64 start, qint64 end) const;
+
 public slots:
     void resetData(const ChartData& data);
     void clearData();
@@ -433,8 +433,17 @@ void ChartWidget::updateToolTip()
             stream << i18n("<tr><th>Temporary Allocations</th><td>%1</td><td>%2</td><td>%3</td></tr>", startCost,
                            endCost, (endCost - startCost));
             break;
+        case ChartModel::Memory:
+            stream << i18n("<tr><th>RSS</th><td>%1</td><td>%2</td><td>%3</td></tr>", Util::formatBytes(startCost),
+                           Util::formatBytes(endCost), Util::formatBytes(endCost - startCost));
+            break;
+        }
+        stream << "</table>";
+        const auto rate = m_model->samplingRateBetween(startTime, endTime);
+        if (rate > 1) {
+            stream << i18n("<i>Only every %1. allocation got recorded in parts of this time range.</i>", rate);
         }
-        stream << "</table></qt>";
+        stream << "</qt>";
     } else {
         switch (m_model->type()) {
         case ChartModel::Consumed:
@@ -451,6 +460,16 @@ void ChartWidget::updateToolTip()
                            "corresponding deallocation, without other allocations happening "
                            "in-between.<br>Click and drag to select a time range for filtering.</qt>");
             break;
+        case ChartModel::Memory:
+            toolTip = i18n("<qt>Shows the RSS over time, compared to the heap memory consumption and the memory "
+                           "that the allocator holds on to in addition, when heaptrack recorded the allocator "
+                           "statistics.<br>Click and drag to select a time range for filtering.</qt>");
+            break;
+        }
+        if (m_model->hasSampledIntervals()) {
+            toolTip.insert(toolTip.lastIndexOf(QLatin1String("</qt>")),
+                           i18n("<br>The cost is incomplete in parts, where only every n-th allocation got "
+                                "recorded as the output could not keep up."));
         }
     }
 
@@ -578,6 +597,10 @@ void ChartWidget::updateStatusTip(qint64 time)
             return i18n("T = %1, Temporary Allocations: %2. Click and drag to select time range for filtering.",
                         Util::formatTime(time), cost);
             break;
+        case ChartModel::Memory:
+            return i18n("T = %1, RSS: %2. Click and drag to select time range for filtering.", Util::formatTime(time),
+                        Util::formatBytes(cost));
+            break;
         }
         Q_UNREACHABLE();
     }();
@@ -420,7 +420,21 @@ MainWindow::MainWindow(QWidget* parent)
                            data.cost.temporary,
                            std::round(float(data.cost.temporary) * 100.f * 100.f / data.cost.allocations) / 100.f,
                            qint64(data.cost.temporary / totalTimeS))
-                   << "</dl></qt>";
+                   << i18n("<dt><b>short-lived allocations</b>:</dt><dd>%1 (%2%, "
+                           "%3/s)</dd>",
+                           data.cost.shortLived,
+                           std::round(float(data.cost.shortLived) * 100.f * 100.f / data.cost.allocations) / 100.f,
+                           qint64(data.cost.shortLived / totalTimeS));
+            if (data.sampledIntervals) {
+                stream << i18np("<dt><b>sampled allocations</b>:</dt><dd>only every %2. allocation or less got recorded "
+                                "for %3 in one interval, as the output could not keep up. The costs are incomplete "
+                                "there, see the tooltips of the charts.</dd>",
+                                "<dt><b>sampled allocations</b>:</dt><dd>only every %2. allocation or less got recorded "
+                                "for %3 in %1 intervals, as the output could not keep up. The costs are incomplete "
+                                "there, see the tooltips of the charts.</dd>",
+                                data.sampledIntervals, data.maxSamplingRate, Util::formatTime(data.sampledTime));
+            }
+            stream << "</dl></qt>";
         }
         {
             QTextStream stream(&textRight);
@@ -431,6 +445,29 @@ MainWindow::MainWindow(QWidget* parent)
                    << i18n("<dt><b>peak RSS</b> (including heaptrack "
                            "overhead):</dt><dd>%1</dd>",
                            Util::formatBytes(data.peakRSS));
+            if (data.peakAllocatorHeld) {
+                stream << i18n("<dt><b>peak memory held by the allocator</b>:</dt><dd>%1</dd>",
+                               Util::formatBytes(data.peakAllocatorHeld));
+            }
+            if (data.peakPSS) {
+                stream << i18n("<dt><b>peak PSS</b>:</dt><dd>%1 (%2 swapped)</dd>", Util::formatBytes(data.peakPSS),
+                               Util::formatBytes(data.peakSwap));
+            }
+            if (!data.tags.isEmpty()) {
+                // only list the tags that contribute the most to the peak, the others are rarely interesting
+                const int MAX_TAGS = 5;
+                stream << i18n("<dt><b>peak heap memory consumption per tag</b>:</dt>") << "<dd>";
+                for (int i = 0; i < data.tags.size() && i < MAX_TAGS; ++i) {
+                    const auto& tag = data.tags[i];
+                    stream << i18n("%1: %2 (at most %3)", tag.name.toHtmlEscaped(), Util::formatBytes(tag.cost.peak),
+                                   Util::formatBytes(tag.maxConsumed))
+                           << "<br/>";
+                }
+                if (data.tags.size() > MAX_TAGS) {
+                    stream << i18np("and one more tag", "and %1 more tags", data.tags.size() - MAX_TAGS);
+                }
+                stream << "</dd>";
+            }
             if (isFiltered) {
                 stream << i18n("<dt><b>memory consumption delta</b>:</dt><dd>%1</dd>",
                                Util::formatBytes(data.cost.leaked));
@@ -478,14 +515,18 @@ MainWindow::MainWindow(QWidget* parent)
                                       &Parser::allocationsChartDataAvailable, this);
     auto temporaryAllocationsTab = addChartTab(m_ui->tabWidget, i18n("Temporary Allocations"), ChartModel::Temporary,
                                                m_parser, &Parser::temporaryChartDataAvailable, this);
+    auto memoryTab = addChartTab(m_ui->tabWidget, i18n("Memory Usage"), ChartModel::Memory, m_parser,
+                                 &Parser::memoryChartDataAvailable, this);
     auto syncSelection = [=](const ChartWidget::Range& selection) {
         consumedTab->setSelection(selection);
         allocationsTab->setSelection(selection);
         temporaryAllocationsTab->setSelection(selection);
+        memoryTab->setSelection(selection);
     };
     connect(consumedTab, &ChartWidget::selectionChanged, syncSelection);
     connect(allocationsTab, &ChartWidget::selectionChanged, syncSelection);
     connect(temporaryAllocationsTab, &ChartWidget::selectionChanged, syncSelection);
+    connect(memoryTab, &ChartWidget::selectionChanged, syncSelection);
 
     auto sizesTab = new HistogramWidget(this);
     m_ui->tabWidget->addTab(sizesTab, i18n("Sizes"));
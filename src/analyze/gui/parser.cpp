@@ -107,6 +107,8 @@ struct ParserData final : public AccumulatedTraceData
         allocationsChartData.rows.reserve(MAX_CHART_DATAPOINTS);
         temporaryChartData.resultData = resultData;
         temporaryChartData.rows.reserve(MAX_CHART_DATAPOINTS);
+        memoryChartData.resultData = resultData;
+        memoryChartData.rows.reserve(MAX_CHART_DATAPOINTS);
         // start off with null data at the origin
         lastTimeStamp = filterParameters.minTime;
         ChartRows origin;
@@ -114,10 +116,25 @@ struct ParserData final : public AccumulatedTraceData
         consumedChartData.rows.push_back(origin);
         allocationsChartData.rows.push_back(origin);
         temporaryChartData.rows.push_back(origin);
+        memoryChartData.rows.push_back(origin);
         // index 0 indicates the total row
         consumedChartData.labels[0] = {};
         allocationsChartData.labels[0] = {};
         temporaryChartData.labels[0] = {};
+        // the memory chart has no hotspots, its total is the RSS and the stacked rows
+        // are the heap consumption and what the allocator holds on to in addition
+        memoryChartData.labels[0] = {};
+        memoryChartData.labels[ChartModel::HeapConsumed] = {};
+        if (hasAllocatorStats) {
+            memoryChartData.labels[ChartModel::AllocatorRetained] = {};
+        }
+        // the heap charts annotate the intervals in which only every n-th allocation got recorded
+        for (const auto& interval : sampledIntervals) {
+            const ChartSampledInterval sampled = {interval.start, interval.end, interval.maxRate};
+            consumedChartData.sampledIntervals.append(sampled);
+            allocationsChartData.sampledIntervals.append(sampled);
+            temporaryChartData.sampledIntervals.append(sampled);
+        }
 
         buildCharts = true;
         maxConsumedSinceLastTimeStamp = 0;
@@ -202,6 +219,11 @@ struct ParserData final : public AccumulatedTraceData
         auto consumed = createRow(nowConsumed);
         auto allocs = createRow(totalCost.allocations);
         auto temporary = createRow(totalCost.temporary);
+        auto memory = createRow(rss * systemInfo.pageSize);
+        memory.cost[ChartModel::HeapConsumed] = nowConsumed;
+        if (hasAllocatorStats) {
+            memory.cost[ChartModel::AllocatorRetained] = max(int64_t(0), allocatorStats.held() - nowConsumed);
+        }
 
         // if the cost is non-zero and the ip corresponds to a hotspot function
         // selected in the labels, we add the cost to the rows column
@@ -221,6 +243,7 @@ struct ParserData final : public AccumulatedTraceData
         consumedChartData.rows << consumed;
         allocationsChartData.rows << allocs;
         temporaryChartData.rows << temporary;
+        memoryChartData.rows << memory;
     }
 
     void handleAllocation(const AllocationInfo& info, const AllocationInfoIndex index) override
@@ -256,6 +279,7 @@ struct ParserData final : public AccumulatedTraceData
         consumedChartData = {};
         allocationsChartData = {};
         temporaryChartData = {};
+        memoryChartData = {};
         labelIds.clear();
         maxConsumedSinceLastTimeStamp = 0;
         lastTimeStamp = 0;
@@ -280,6 +304,7 @@ struct ParserData final : public AccumulatedTraceData
     ChartData consumedChartData;
     ChartData allocationsChartData;
     ChartData temporaryChartData;
+    ChartData memoryChartData;
     // here we store the indices into ChartRows::cost for those IpIndices that
     // are within the top hotspots. This way, we can do one hash lookup in the
     // handleTimeStamp function instead of three when we'd store this data
@@ -702,10 +727,34 @@ void Parser::parseImpl(const QString& path, const QString& diffBase, const Filte
 
         const auto resultData = std::make_shared<const ResultData>(data->totalCost, data->qtStrings);
 
-        emit summaryAvailable({QString::fromStdString(data->debuggee), data->totalCost, data->totalTime,
-                               data->filterParameters, data->peakTime, data->peakRSS * data->systemInfo.pageSize,
-                               data->systemInfo.pages * data->systemInfo.pageSize, data->fromAttached,
-                               data->totalLeakedSuppressed, toQt(data->suppressions)});
+        SummaryData summary(QString::fromStdString(data->debuggee), data->totalCost, data->totalTime,
+                            data->filterParameters, data->peakTime, data->peakRSS * data->systemInfo.pageSize,
+                            data->systemInfo.pages * data->systemInfo.pageSize, data->fromAttached,
+                            data->totalLeakedSuppressed, toQt(data->suppressions));
+        summary.peakAllocatorHeld = data->peakAllocatorStats.held();
+        summary.peakPSS = data->peakProcessMemory.pss;
+        summary.peakSwap = data->peakProcessMemory.swap;
+        for (const auto& tag : data->tags) {
+            QString name;
+            if (!tag.tag) {
+                name = i18n("untagged");
+            } else if (tag.name) {
+                name = data->qtStrings.value(tag.name.index - 1);
+            } else {
+                name = QString::number(tag.tag);
+            }
+            summary.tags.append({name, tag.cost, tag.maxConsumed});
+        }
+        std::sort(summary.tags.begin(), summary.tags.end(),
+                  [](const SummaryData::TagCost& lhs, const SummaryData::TagCost& rhs) {
+                      return lhs.cost.peak > rhs.cost.peak;
+                  });
+        for (const auto& interval : data->sampledIntervals) {
+            ++summary.sampledIntervals;
+            summary.sampledTime += interval.end - interval.start;
+            summary.maxSamplingRate = std::max(summary.maxSamplingRate, interval.maxRate);
+        }
+        emit summaryAvailable(summary);
 
         if (stopAfter == StopAfter::Summary) {
             emit finished();
@@ -755,6 +804,7 @@ void Parser::parseImpl(const QString& path, const QString& diffBase, const Filte
                 emit consumedChartDataAvailable(data->consumedChartData);
                 emit allocationsChartDataAvailable(data->allocationsChartData);
                 emit temporaryChartDataAvailable(data->temporaryChartData);
+                emit memoryChartDataAvailable(data->memoryChartData);
             });
         }
 
@@ -51,6 +51,7 @@ signals:
     void consumedChartDataAvailable(const ChartData& data);
     void allocationsChartDataAvailable(const ChartData& data);
     void temporaryChartDataAvailable(const ChartData& data);
+    void memoryChartDataAvailable(const ChartData& data);
     void sizeHistogramDataAvailable(const HistogramData& data);
     void finished();
     void failedToOpen(const QString& path);
@@ -41,6 +41,22 @@ struct SummaryData
     int64_t peakTime = 0;
     int64_t peakRSS = 0;
     int64_t totalSystemMemory = 0;
+    // only available when the allocator statistics were recorded
+    int64_t peakAllocatorHeld = 0;
+    int64_t peakPSS = 0;
+    int64_t peakSwap = 0;
+    struct TagCost
+    {
+        QString name;
+        AllocationData cost;
+        int64_t maxConsumed = 0;
+    };
+    // only available when the application tagged its allocations, sorted by peak
+    QVector<TagCost> tags;
+    // only available when libheaptrack sampled the allocations, as the output could not keep up
+    int sampledIntervals = 0;
+    int64_t sampledTime = 0;
+    uint32_t maxSamplingRate = 1;
     bool fromAttached = false;
     QVector<Suppression> suppressions;
 };
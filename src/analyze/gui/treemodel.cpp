@@ -156,11 +156,15 @@ QVariant TreeModel::data(const QModelIndex& index, int role) const
         const auto allocationsFraction = Util::formatCostRelative(row->cost.allocations, m_maxCost.cost.allocations);
         const auto temporaryFraction = Util::formatCostRelative(row->cost.temporary, row->cost.allocations);
         const auto temporaryFractionTotal = Util::formatCostRelative(row->cost.temporary, m_maxCost.cost.temporary);
+        const auto shortLivedFraction = Util::formatCostRelative(row->cost.shortLived, row->cost.allocations);
+        const auto shortLivedFractionTotal = Util::formatCostRelative(row->cost.shortLived, m_maxCost.cost.shortLived);
         stream << i18n("peak contribution: %1 (%2% of total)\n", Util::formatBytes(row->cost.peak), peakFraction);
         stream << i18n("leaked: %1 (%2% of total)\n", Util::formatBytes(row->cost.leaked), leakedFraction);
         stream << i18n("allocations: %1 (%2% of total)\n", row->cost.allocations, allocationsFraction);
         stream << i18n("temporary: %1 (%2% of allocations, %3% of total)\n", row->cost.temporary, temporaryFraction,
                        temporaryFractionTotal);
+        stream << i18n("short-lived: %1 (%2% of allocations, %3% of total)\n", row->cost.shortLived,
+                       shortLivedFraction, shortLivedFractionTotal);
         if (!row->children.isEmpty()) {
             auto child = row;
             int max = 5;
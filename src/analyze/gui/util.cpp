@@ -113,6 +113,7 @@ QString Util::formatTooltip(const Symbol& symbol, const AllocationData& costs, c
     toolTip += formatCost(i18n("Leaked"), &AllocationData::leaked);
     toolTip += formatCost(i18n("Allocations"), &AllocationData::allocations);
     toolTip += formatCost(i18n("Temporary Allocations"), &AllocationData::temporary);
+    toolTip += formatCost(i18n("Short-lived Allocations"), &AllocationData::shortLived);
     return QString(QLatin1String("<qt>") + toolTip + QLatin1String("</qt>"));
 }
 
@@ -142,6 +143,7 @@ QString Util::formatTooltip(const Symbol& symbol, const AllocationData& selfCost
     toolTip += formatCost(i18n("Leaked"), &AllocationData::leaked);
     toolTip += formatCost(i18n("Allocations"), &AllocationData::allocations);
     toolTip += formatCost(i18n("Temporary Allocations"), &AllocationData::temporary);
+    toolTip += formatCost(i18n("Short-lived Allocations"), &AllocationData::shortLived);
     return QString(QLatin1String("<qt>") + toolTip + QLatin1String("</qt>"));
 }
 
@@ -171,6 +173,7 @@ QString Util::formatTooltip(const FileLine& location, const AllocationData& self
     toolTip += formatCost(i18n("Leaked"), &AllocationData::leaked);
     toolTip += formatCost(i18n("Allocations"), &AllocationData::allocations);
     toolTip += formatCost(i18n("Temporary Allocations"), &AllocationData::temporary);
+    toolTip += formatCost(i18n("Short-lived Allocations"), &AllocationData::shortLived);
     return QString(QLatin1String("<qt>") + toolTip + QLatin1String("</qt>"));
 }
 
@@ -91,6 +91,7 @@ enum CostType
 {
     Allocations,
     Temporary,
+    ShortLived,
     Leaked,
     Peak
 };
@@ -103,6 +104,8 @@ std::istream& operator>>(std::istream& in, CostType& type)
         type = Allocations;
     else if (token == "temporary")
         type = Temporary;
+    else if (token == "short-lived")
+        type = ShortLived;
     else if (token == "leaked")
         type = Leaked;
     else if (token == "peak")
@@ -162,6 +165,7 @@ struct Printer final : public AccumulatedTraceData
                 merged.leaked += allocation.leaked;
                 merged.peak += allocation.peak;
                 merged.temporary += allocation.temporary;
+                merged.shortLived += allocation.shortLived;
             }
         }
         return ret;
@@ -384,6 +388,118 @@ struct Printer final : public AccumulatedTraceData
         cout << endl;
     }
 
+    void printPhases() const
+    {
+        if (!phases.empty()) {
+            cout << setw(12) << "occurrences" << setw(11) << "duration" << setw(14) << "allocations" << setw(12)
+                 << "temporary" << setw(12) << "delta" << setw(12) << "peak"
+                 << "  phase\n";
+            for (const auto& phase : phases) {
+                cout << setw(12) << phase.occurrences << setw(10) << fixed << setprecision(2)
+                     << (phase.duration / 1000.) << 's' << setw(14) << phase.cost.allocations << setw(12)
+                     << phase.cost.temporary << formatBytes(phase.cost.leaked, 12) << formatBytes(phase.cost.peak, 12)
+                     << "  " << stringify(phase.name) << '\n';
+            }
+            cout << '\n';
+        }
+
+        if (!markers.empty()) {
+            cout << setw(10) << "time" << setw(12) << "consumed"
+                 << "  marker\n";
+            for (const auto& marker : markers) {
+                cout << setw(9) << fixed << setprecision(2) << (marker.timeStamp / 1000.) << 's'
+                     << formatBytes(marker.consumed, 12) << "  " << stringify(marker.name) << '\n';
+            }
+            cout << '\n';
+        }
+        cout.flush();
+    }
+
+    void printTags() const
+    {
+        // allocation infos refer to the tags by their index, so sort a copy
+        auto sortedTags = tags;
+        sort(sortedTags.begin(), sortedTags.end(),
+             [](const TagCost& l, const TagCost& r) { return l.cost.peak > r.cost.peak; });
+        cout << setw(14) << "allocations" << setw(12) << "temporary" << setw(12) << "peak" << setw(12) << "max"
+             << setw(12) << "leaked"
+             << "  tag\n";
+        for (const auto& tag : sortedTags) {
+            cout << setw(14) << tag.cost.allocations << setw(12) << tag.cost.temporary
+                 << formatBytes(tag.cost.peak, 12) << formatBytes(tag.maxConsumed, 12)
+                 << formatBytes(tag.cost.leaked, 12) << "  ";
+            if (!tag.tag) {
+                cout << "(untagged)";
+            } else if (tag.name) {
+                cout << stringify(tag.name);
+            } else {
+                cout << tag.tag;
+            }
+            cout << '\n';
+        }
+        cout << endl;
+    }
+
+    void printFragmentation() const
+    {
+        const auto pageSize = systemInfo.pageSize ? systemInfo.pageSize : 4096;
+        auto utilization = [pageSize](int64_t liveBytes, int64_t pages) {
+            return pages ? (float(liveBytes) * 100.f / (pages * pageSize)) : 0.f;
+        };
+
+        // print a downsampled time series
+        const size_t maxSamples = 20;
+        const size_t stride = (fragmentation.size() + maxSamples - 1) / maxSamples;
+        cout << setw(10) << "time" << setw(12) << "live" << setw(12) << "spanned" << setw(13) << "utilization\n";
+        for (size_t i = 0; i < fragmentation.size(); i += stride) {
+            const auto& sample = fragmentation[i];
+            cout << setw(9) << fixed << setprecision(2) << (sample.timeStamp / 1000.) << 's'
+                 << formatBytes(sample.liveBytes, 12) << formatBytes(sample.occupiedPages * pageSize, 12) << setw(11)
+                 << utilization(sample.liveBytes, sample.occupiedPages) << "%\n";
+        }
+        cout << '\n';
+
+        const auto& layout = heapLayout;
+        cout << "heap layout with the most occupied pages after " << fixed << setprecision(2)
+             << (layout.timeStamp / 1000.) << "s:\n"
+             << formatBytes(layout.liveBytes) << " live in " << formatBytes(layout.occupiedPages * pageSize)
+             << " of occupied pages (" << utilization(layout.liveBytes, layout.occupiedPages) << "% utilization), "
+             << formatBytes(layout.holePages * pageSize) << " in holes between them\n\n";
+
+        cout << setw(12) << "size class" << setw(14) << "allocations" << setw(12) << "live" << setw(12) << "spanned"
+             << setw(13) << "utilization\n";
+        for (const auto& sizeClass : layout.sizeClasses) {
+            if (sizeClass.sizeClass) {
+                cout << formatBytes(sizeClass.sizeClass, 12);
+            } else {
+                cout << setw(12) << "large";
+            }
+            cout << setw(14) << sizeClass.allocations << formatBytes(sizeClass.liveBytes, 12)
+                 << formatBytes(sizeClass.occupiedPages * pageSize, 12) << setw(11)
+                 << utilization(sizeClass.liveBytes, sizeClass.occupiedPages) << "%\n";
+        }
+        cout << '\n';
+
+        // every character represents the utilization of one bucket, from empty to fully used
+        static const char heat[] = " .:-=+*#%@";
+        const auto maxHeat = sizeof(heat) - 2;
+        cout << "address space heatmap (utilization: \"" << heat << "\"):\n";
+        for (const auto& range : layout.addressRanges) {
+            cout << "0x" << hex << range.start << dec << ' ' << formatBytes(range.bucketSize * range.buckets.size(), 10)
+                 << " [";
+            for (auto liveBytes : range.buckets) {
+                const auto fraction = range.bucketSize ? min(1., double(liveBytes) / range.bucketSize) : 0.;
+                auto level = static_cast<size_t>(fraction * maxHeat + 0.5);
+                if (liveBytes && !level) {
+                    level = 1;
+                }
+                cout << heat[level];
+            }
+            cout << "]\n";
+        }
+        cout << endl;
+    }
+
     void writeMassifHeader(const char* command)
     {
         // write massif header
@@ -572,6 +688,19 @@ int main(int argc, char** argv)
             "Print backtraces to top allocators, sorted by number of calls to allocation functions.")
         ("print-temporary,T", po::value<bool>()->default_value(true)->implicit_value(true),
             "Print backtraces to top allocators, sorted by number of temporary allocations.")
+        ("print-short-lived,S", po::value<bool>()->default_value(false)->implicit_value(true),
+            "Print backtraces to top allocators, sorted by number of short-lived allocations, i.e. allocations "
+            "that got freed while still being one of the most recent allocations.")
+        ("print-fragmentation", po::value<bool>()->default_value(true)->implicit_value(true),
+            "Print the heap fragmentation over time and the heap layout at its largest extent. This requires data "
+            "that got recorded with heaptrack --fragmentation.")
+        ("print-phases", po::value<bool>()->default_value(true)->implicit_value(true),
+            "Print the cost of the phases and the markers that the application reported via heaptrack_api.h.")
+        ("print-tags", po::value<bool>()->default_value(true)->implicit_value(true),
+            "Print the cost per tag that the application set via heaptrack_api.h. The peak is the memory consumed "
+            "by a tag at the time of the total peak, max is the highest consumption of the tag on its own.")
+        ("phase", po::value<string>()->default_value(string()),
+            "Only take the allocations into account that happened while a phase of the given name was active.")
         ("print-leaks,l", po::value<bool>()->default_value(false)->implicit_value(true),
             "Print backtraces to leaked memory allocations.")
         ("peak-limit,n", po::value<size_t>()->default_value(10)->implicit_value(10),
@@ -584,6 +713,7 @@ int main(int argc, char** argv)
             "The cost type to use when generating a flamegraph. Possible options are:\n"
             "  - allocations: number of allocations\n"
             "  - temporary: number of temporary allocations\n"
+            "  - short-lived: number of short-lived allocations\n"
             "  - leaked: bytes not deallocated at the end\n"
             "  - peak: bytes consumed at highest total memory consumption")
         ("print-flamegraph,F", po::value<string>()->default_value(string()),
@@ -680,9 +810,14 @@ int main(int argc, char** argv)
     const bool printPeaks = vm["print-peaks"].as<bool>();
     const bool printAllocs = vm["print-allocators"].as<bool>();
     const bool printTemporary = vm["print-temporary"].as<bool>();
+    const bool printShortLived = vm["print-short-lived"].as<bool>();
+    const bool printFragmentation = vm["print-fragmentation"].as<bool>();
+    const bool printPhases = vm["print-phases"].as<bool>();
+    const bool printTags = vm["print-tags"].as<bool>();
     const auto printSuppressions = vm["print-suppressions"].as<bool>();
     const auto suppressionsFile = vm["suppressions"].as<string>();
 
+    data.filterParameters.phase = vm["phase"].as<string>();
     data.filterParameters.disableEmbeddedSuppressions = vm.count("disable-embedded-suppressions");
     data.filterParameters.disableBuiltinSuppressions = vm.count("disable-builtin-suppressions");
     bool suppressionsOk = false;
@@ -769,15 +904,74 @@ int main(int argc, char** argv)
         cout << endl;
     }
 
+    if (printShortLived) {
+        // sort by amount of short-lived allocations
+        cout << "MOST SHORT-LIVED ALLOCATIONS\n";
+        data.printAllocations(
+            &AllocationData::shortLived,
+            [](const AllocationData& data) {
+                cout << data.shortLived << " short-lived allocations of " << data.allocations
+                     << " allocations in total (" << fixed << setprecision(2)
+                     << (float(data.shortLived) * 100.f / data.allocations) << "%) from\n";
+            },
+            [](const AllocationData& data) {
+                cout << data.shortLived << " short-lived allocations of " << data.allocations
+                     << " allocations in total (" << fixed << setprecision(2)
+                     << (float(data.shortLived) * 100.f / data.allocations) << "%) from:\n";
+            });
+        cout << endl;
+    }
+
+    if (printPhases && (!data.phases.empty() || !data.markers.empty())) {
+        cout << "PHASES AND MARKERS\n";
+        data.printPhases();
+    }
+
+    if (printTags && !data.tags.empty()) {
+        cout << "COST PER TAG\n";
+        data.printTags();
+    }
+
+    if (printFragmentation && !data.fragmentation.empty()) {
+        cout << "HEAP FRAGMENTATION\n";
+        data.printFragmentation();
+    }
+
+    for (const auto& interval : data.sampledIntervals) {
+        cout << "NOTE: only every " << interval.maxRate << ". allocation or less got recorded from " << fixed
+             << setprecision(2) << (interval.start / 1000.) << "s to " << (interval.end / 1000.)
+             << "s, as the output could not keep up\n";
+    }
+    if (data.leaksOnly) {
+        cout << "NOTE: only the leaked allocations got recorded, the other numbers below are only based on those\n";
+    }
+    if (data.unsymbolized) {
+        cout << "NOTE: the symbolization got deferred, run heaptrack_symbolize on the data to resolve the backtraces\n";
+    }
+
     const double totalTimeS = data.totalTime ? (1000. / data.totalTime) : 1.;
     cout << "total runtime: " << fixed << (data.totalTime / 1000.) << "s.\n"
          << "calls to allocation functions: " << data.totalCost.allocations << " ("
          << int64_t(data.totalCost.allocations * totalTimeS) << "/s)\n"
          << "temporary memory allocations: " << data.totalCost.temporary << " ("
          << int64_t(data.totalCost.temporary * totalTimeS) << "/s)\n"
+         << "short-lived memory allocations: " << data.totalCost.shortLived << " ("
+         << int64_t(data.totalCost.shortLived * totalTimeS) << "/s)\n"
          << "peak heap memory consumption: " << formatBytes(data.totalCost.peak) << '\n'
          << "peak RSS (including heaptrack overhead): " << formatBytes(data.peakRSS * data.systemInfo.pageSize) << '\n'
          << "total memory leaked: " << formatBytes(data.totalCost.leaked) << '\n';
+    if (data.hasAllocatorStats) {
+        const auto& stats = data.peakAllocatorStats;
+        cout << "peak memory held by the allocator: " << formatBytes(stats.held()) << " ("
+             << formatBytes(stats.arena) << " in arenas, " << formatBytes(stats.mmapped) << " mmapped, "
+             << formatBytes(stats.free) << " free)\n";
+    }
+    if (data.hasProcessMemory) {
+        const auto& memory = data.peakProcessMemory;
+        cout << "peak anonymous memory: " << formatBytes(memory.anonymous) << '\n'
+             << "peak PSS: " << formatBytes(memory.pss) << '\n'
+             << "peak swap: " << formatBytes(memory.swap) << '\n';
+    }
     if (data.totalLeakedSuppressed) {
         cout << "suppressed leaks: " << formatBytes(data.totalLeakedSuppressed) << '\n';
 
@@ -825,6 +1019,9 @@ int main(int argc, char** argv)
                 case Temporary:
                     flamegraph << allocation.temporary;
                     break;
+                case ShortLived:
+                    flamegraph << allocation.shortLived;
+                    break;
                 case Peak:
                     flamegraph << allocation.peak;
                     break;
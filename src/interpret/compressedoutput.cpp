@@ -0,0 +1,323 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "compressedoutput.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#if ZSTD_FOUND
+#include <zstd.h>
+#endif
+
+namespace {
+bool endsWith(const std::string& str, const char* suffix)
+{
+    const auto length = strlen(suffix);
+    return str.size() >= length && str.compare(str.size() - length, length, suffix) == 0;
+}
+
+/// the file the compressed data gets written to
+class OutputFile
+{
+public:
+    explicit OutputFile(int fd)
+        : m_fd(fd)
+    {
+    }
+
+    ~OutputFile()
+    {
+        close();
+    }
+
+    bool write(const char* data, size_t size)
+    {
+        while (size) {
+            const auto ret = ::write(m_fd, data, size);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            } else if (ret < 0) {
+                if (!m_failed) {
+                    fprintf(stderr, "ERROR: failed to write the output: %s\n", strerror(errno));
+                    m_failed = true;
+                }
+                return false;
+            }
+            data += ret;
+            size -= ret;
+        }
+        return true;
+    }
+
+    bool close()
+    {
+        if (m_fd == -1) {
+            return !m_failed;
+        }
+        const auto ret = ::close(m_fd);
+        m_fd = -1;
+        return ret == 0 && !m_failed;
+    }
+
+private:
+    int m_fd;
+    bool m_failed = false;
+};
+
+class UncompressedSink : public LineWriter::Sink
+{
+public:
+    explicit UncompressedSink(int fd)
+        : m_file(fd)
+    {
+    }
+
+    bool write(const char* data, size_t size) override
+    {
+        return m_file.write(data, size);
+    }
+
+    bool close() override
+    {
+        return m_file.close();
+    }
+
+private:
+    OutputFile m_file;
+};
+
+class GzipSink : public LineWriter::Sink
+{
+public:
+    GzipSink(int fd, int level)
+        : m_file(fd)
+        , m_buffer(128 * 1024)
+    {
+        // add 16 to the window bits to write a gzip header instead of a zlib one
+        m_valid = deflateInit2(&m_stream, level ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                               Z_DEFAULT_STRATEGY)
+            == Z_OK;
+    }
+
+    ~GzipSink()
+    {
+        close();
+    }
+
+    bool isValid() const
+    {
+        return m_valid;
+    }
+
+    bool write(const char* data, size_t size) override
+    {
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        m_stream.avail_in = size;
+        return deflate(Z_NO_FLUSH);
+    }
+
+    bool close() override
+    {
+        if (!m_valid) {
+            return false;
+        }
+        m_stream.next_in = nullptr;
+        m_stream.avail_in = 0;
+        const auto finished = deflate(Z_FINISH);
+        deflateEnd(&m_stream);
+        m_valid = false;
+        return m_file.close() && finished;
+    }
+
+private:
+    bool deflate(int flush)
+    {
+        if (!m_valid) {
+            return false;
+        }
+        int ret = Z_OK;
+        do {
+            m_stream.next_out = reinterpret_cast<Bytef*>(m_buffer.data());
+            m_stream.avail_out = m_buffer.size();
+            ret = ::deflate(&m_stream, flush);
+            if (ret == Z_STREAM_ERROR) {
+                return false;
+            }
+            const auto compressed = m_buffer.size() - m_stream.avail_out;
+            if (compressed && !m_file.write(m_buffer.data(), compressed)) {
+                return false;
+            }
+            // the output buffer is full when there is more to write
+        } while (m_stream.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+        return true;
+    }
+
+    OutputFile m_file;
+    std::vector<char> m_buffer;
+    z_stream m_stream = {};
+    bool m_valid = false;
+};
+
+#if ZSTD_FOUND
+class ZstdSink : public LineWriter::Sink
+{
+public:
+    ZstdSink(int fd, const CompressedOutput::Options& options)
+        : m_file(fd)
+        , m_buffer(ZSTD_CStreamOutSize())
+        , m_context(ZSTD_createCCtx())
+    {
+        if (!m_context) {
+            return;
+        }
+        // like the zstd command line client, which was used before
+        ZSTD_CCtx_setParameter(m_context, ZSTD_c_checksumFlag, 1);
+        if (options.level) {
+            ZSTD_CCtx_setParameter(m_context, ZSTD_c_compressionLevel, options.level);
+        }
+        if (options.threads) {
+            const auto ret = ZSTD_CCtx_setParameter(m_context, ZSTD_c_nbWorkers, options.threads);
+            if (ZSTD_isError(ret)) {
+                fprintf(stderr, "WARNING: zstd cannot compress with multiple threads: %s\n", ZSTD_getErrorName(ret));
+            }
+        }
+    }
+
+    ~ZstdSink()
+    {
+        close();
+        ZSTD_freeCCtx(m_context);
+    }
+
+    bool isValid() const
+    {
+        return m_context != nullptr;
+    }
+
+    bool write(const char* data, size_t size) override
+    {
+        ZSTD_inBuffer input = {data, size, 0};
+        // with worker threads, not all input may be consumed at once
+        while (input.pos < input.size) {
+            if (!compress(&input, ZSTD_e_continue)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool close() override
+    {
+        if (m_closed || !m_context) {
+            return false;
+        }
+        m_closed = true;
+        ZSTD_inBuffer input = {nullptr, 0, 0};
+        size_t remaining = 0;
+        do {
+            remaining = compress(&input, ZSTD_e_end);
+        } while (remaining && !m_failed);
+        return m_file.close() && !m_failed;
+    }
+
+private:
+    /// @return the amount of data that still needs to be flushed, or 0 on failure
+    size_t compress(ZSTD_inBuffer* input, ZSTD_EndDirective mode)
+    {
+        ZSTD_outBuffer output = {m_buffer.data(), m_buffer.size(), 0};
+        const auto ret = ZSTD_compressStream2(m_context, &output, input, mode);
+        if (ZSTD_isError(ret)) {
+            fprintf(stderr, "ERROR: failed to compress the output: %s\n", ZSTD_getErrorName(ret));
+            m_failed = true;
+            return 0;
+        }
+        if (output.pos && !m_file.write(m_buffer.data(), output.pos)) {
+            m_failed = true;
+            return 0;
+        }
+        return mode == ZSTD_e_end ? ret : 1;
+    }
+
+    OutputFile m_file;
+    std::vector<char> m_buffer;
+    ZSTD_CCtx* m_context;
+    bool m_failed = false;
+    bool m_closed = false;
+};
+#endif
+}
+
+CompressedOutput::Format CompressedOutput::formatForPath(const std::string& path)
+{
+    if (endsWith(path, ".gz")) {
+        return Format::Gzip;
+    } else if (endsWith(path, ".zst")) {
+        return Format::Zstd;
+    }
+    return Format::Uncompressed;
+}
+
+bool CompressedOutput::isSupported(Format format)
+{
+#if ZSTD_FOUND
+    (void)format;
+    return true;
+#else
+    return format != Format::Zstd;
+#endif
+}
+
+std::unique_ptr<LineWriter::Sink> CompressedOutput::open(const std::string& path, const Options& options,
+                                                         std::string* error)
+{
+    const auto format = formatForPath(path);
+    if (!isSupported(format)) {
+        *error = "heaptrack_interpret was built without zstd support";
+        return {};
+    }
+
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        *error = std::string("failed to open ") + path + ": " + strerror(errno);
+        return {};
+    }
+
+    switch (format) {
+    case Format::Uncompressed:
+        return std::unique_ptr<LineWriter::Sink>(new UncompressedSink(fd));
+    case Format::Gzip: {
+        std::unique_ptr<GzipSink> sink(new GzipSink(fd, options.level));
+        if (!sink->isValid()) {
+            *error = "failed to initialize the gzip compression";
+            return {};
+        }
+        return sink;
+    }
+    case Format::Zstd: {
+#if ZSTD_FOUND
+        std::unique_ptr<ZstdSink> sink(new ZstdSink(fd, options));
+        if (!sink->isValid()) {
+            *error = "failed to initialize the zstd compression";
+            return {};
+        }
+        return sink;
+#else
+        break;
+#endif
+    }
+    }
+
+    ::close(fd);
+    return {};
+}
@@ -0,0 +1,53 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef COMPRESSEDOUTPUT_H
+#define COMPRESSEDOUTPUT_H
+
+#include <memory>
+#include <string>
+
+#include "util/linewriter.h"
+
+/**
+ * Writes the output of the interpreter to a file, compressed on the fly.
+ *
+ * This replaces piping the output through an external gzip or zstd process.
+ */
+class CompressedOutput
+{
+public:
+    enum class Format
+    {
+        Uncompressed,
+        Gzip,
+        Zstd,
+    };
+
+    struct Options
+    {
+        // the compression level, or 0 for the default level of the format
+        int level = 0;
+        // the number of additional threads that compress the data, only supported by zstd
+        unsigned threads = 0;
+    };
+
+    /// @return the format that matches the extension of @p path, i.e. `.gz` or `.zst`
+    static Format formatForPath(const std::string& path);
+
+    /// @return true when the interpreter can write @p format, zstd is optional
+    static bool isSupported(Format format);
+
+    /**
+     * Create or truncate the file at @p path, the format is deduced from its extension.
+     *
+     * @return the sink for a LineWriter, or nullptr on failure in which case @p error describes the failure
+     */
+    static std::unique_ptr<LineWriter::Sink> open(const std::string& path, const Options& options,
+                                                  std::string* error);
+};
+
+#endif // COMPRESSEDOUTPUT_H
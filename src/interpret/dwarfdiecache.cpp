@@ -14,8 +14,65 @@
 #include <cxxabi.h>
 
 #include <cstring>
+#include <functional>
+#include <mutex>
+#include <set>
 
 namespace {
+/**
+ * The demangled names of all modules and compilation units, shared by all threads that symbolize.
+ *
+ * The same names get demangled over and over again otherwise, e.g. the ones of templates that get inlined into
+ * many compilation units, or the symbols of code that is linked statically into multiple modules. The names are
+ * distributed over multiple independently locked shards, to keep the contention between the threads low.
+ *
+ * The callers keep their own copies of the names they resolved, so this only needs to remember the names that got
+ * demangled recently. A shard gets cleared once it is full, which bounds the memory for huge applications.
+ */
+class DemangleCache
+{
+public:
+    bool find(const std::string& mangledName, size_t hash, std::string* demangledName)
+    {
+        auto& shard = shardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.names.find(mangledName, hash);
+        if (it == shard.names.end())
+            return false;
+        *demangledName = it->second;
+        return true;
+    }
+
+    void insert(const std::string& mangledName, size_t hash, const std::string& demangledName)
+    {
+        auto& shard = shardFor(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.names.size() >= MAX_NAMES_PER_SHARD)
+            shard.names.clear();
+        shard.names.insert({mangledName, demangledName});
+    }
+
+private:
+    enum
+    {
+        NUM_SHARDS = 16,
+        MAX_NAMES_PER_SHARD = 4096
+    };
+    struct Shard
+    {
+        std::mutex mutex;
+        tsl::robin_map<std::string, std::string> names;
+    };
+
+    Shard& shardFor(size_t hash)
+    {
+        // use the upper bits, the lower ones select the buckets within the shard
+        return m_shards[(hash >> (sizeof(size_t) * 8 - 8)) % NUM_SHARDS];
+    }
+
+    Shard m_shards[NUM_SHARDS];
+};
+
 enum class WalkResult
 {
     Recurse,
@@ -217,15 +274,28 @@ std::string demangle(const std::string& mangledName)
     if (mangledName.length() < 3) {
         return mangledName;
     } else {
-        static size_t demangleBufferLength = 1024;
-        static char* demangleBuffer = reinterpret_cast<char*>(malloc(demangleBufferLength));
+        // one buffer per thread, as heaptrack_interpret symbolizes on multiple threads
+        static thread_local size_t demangleBufferLength = 1024;
+        static thread_local char* demangleBuffer = reinterpret_cast<char*>(malloc(demangleBufferLength));
 
         // Require GNU v3 ABI by the "_Z" prefix.
         if (mangledName[0] == '_' && mangledName[1] == 'Z') {
+            static DemangleCache cache;
+            const auto hash = std::hash<std::string>()(mangledName);
+            std::string demangled;
+            if (cache.find(mangledName, hash, &demangled))
+                return demangled;
+
             int status = -1;
             char* dsymname = abi::__cxa_demangle(mangledName.data(), demangleBuffer, &demangleBufferLength, &status);
-            if (status == 0 && dsymname)
-                return demangleBuffer = dsymname;
+            if (status == 0 && dsymname) {
+                demangleBuffer = dsymname;
+                demangled = dsymname;
+            } else {
+                demangled = mangledName;
+            }
+            cache.insert(mangledName, hash, demangled);
+            return demangled;
         }
     }
     return mangledName;
@@ -286,6 +356,82 @@ std::vector<Dwarf_Die> findInlineScopes(Dwarf_Die* subprogram, Dwarf_Addr offset
     return scopes;
 }
 
+void DwarfRangeIndex::add(DwarfRange range, uint32_t index)
+{
+    if (range.low < range.high)
+        m_entries.push_back({range.low, range.high, index});
+}
+
+void DwarfRangeIndex::build()
+{
+    // ranges can overlap, e.g. for code that got discarded by the linker and thus starts at zero
+    // sweep over all range boundaries and assign every disjoint range between them to the lowest active index
+    struct Event
+    {
+        Dwarf_Addr addr;
+        uint32_t index;
+        bool isStart;
+    };
+    std::vector<Event> events;
+    events.reserve(m_entries.size() * 2);
+    uint32_t numIndices = 0;
+    for (const auto& entry : m_entries) {
+        events.push_back({entry.low, entry.index, true});
+        events.push_back({entry.high, entry.index, false});
+        numIndices = std::max(numIndices, entry.index + 1);
+    }
+    std::sort(events.begin(), events.end(), [](const Event& lhs, const Event& rhs) { return lhs.addr < rhs.addr; });
+
+    // the number of active ranges per index and a min-heap of the active indices, which get removed lazily
+    std::vector<uint32_t> activeRanges(numIndices, 0);
+    std::vector<uint32_t> activeIndices;
+    auto lowestActiveIndex = [&]() -> int64_t {
+        while (!activeIndices.empty() && !activeRanges[activeIndices.front()]) {
+            std::pop_heap(activeIndices.begin(), activeIndices.end(), std::greater<uint32_t>());
+            activeIndices.pop_back();
+        }
+        return activeIndices.empty() ? -1 : static_cast<int64_t>(activeIndices.front());
+    };
+
+    std::vector<Entry> flattened;
+    flattened.reserve(m_entries.size());
+    for (auto it = events.begin(); it != events.end();) {
+        const auto addr = it->addr;
+        for (; it != events.end() && it->addr == addr; ++it) {
+            if (it->isStart) {
+                if (!activeRanges[it->index]++) {
+                    activeIndices.push_back(it->index);
+                    std::push_heap(activeIndices.begin(), activeIndices.end(), std::greater<uint32_t>());
+                }
+            } else {
+                --activeRanges[it->index];
+            }
+        }
+
+        const auto index = lowestActiveIndex();
+        if (index < 0 || it == events.end())
+            continue;
+        const auto next = it->addr;
+        if (!flattened.empty() && flattened.back().high == addr && flattened.back().index == index)
+            flattened.back().high = next;
+        else
+            flattened.push_back({addr, next, static_cast<uint32_t>(index)});
+    }
+
+    flattened.shrink_to_fit();
+    m_entries = std::move(flattened);
+}
+
+int64_t DwarfRangeIndex::find(Dwarf_Addr addr) const
+{
+    auto it = std::upper_bound(m_entries.begin(), m_entries.end(), addr,
+                               [](Dwarf_Addr addr, const Entry& entry) { return addr < entry.low; });
+    if (it == m_entries.begin())
+        return -1;
+    --it;
+    return it->high > addr ? static_cast<int64_t>(it->index) : -1;
+}
+
 SubProgramDie::SubProgramDie(Dwarf_Die die)
     : m_ranges {die, {}}
 {
@@ -297,6 +443,122 @@ SubProgramDie::SubProgramDie(Dwarf_Die die)
         &die);
 }
 
+std::vector<SubProgramDie::InlineScope*> SubProgramDie::findInlineScopes(Dwarf_Addr offset, Dwarf_Die* cuDie)
+{
+    if (!m_inlineScopesAdded)
+        addInlineScopes(cuDie);
+
+    std::vector<InlineScope*> scopes;
+    auto it = std::upper_bound(m_inlineScopeRanges.begin(), m_inlineScopeRanges.end(), offset,
+                               [](Dwarf_Addr offset, const InlineScopeRange& range) { return offset < range.low; });
+    if (it == m_inlineScopeRanges.begin())
+        return scopes;
+    --it;
+    if (it->high <= offset)
+        return scopes;
+
+    scopes.reserve(it->scopes.size());
+    for (auto index : it->scopes)
+        scopes.push_back(&m_inlineScopes[index]);
+    return scopes;
+}
+
+void SubProgramDie::addInlineScopes(Dwarf_Die* cuDie)
+{
+    m_inlineScopesAdded = true;
+
+    Dwarf_Files* files = nullptr;
+    dwarf_getsrcfiles(cuDie, &files, nullptr);
+
+    struct Event
+    {
+        Dwarf_Addr addr;
+        uint32_t index;
+        bool isStart;
+    };
+    std::vector<Event> events;
+    // the index of the closest inlined scope that encloses a scope, or -1
+    std::vector<int64_t> parents;
+
+    // like walkDieTree, but we need to know the enclosing inlined scope of every scope
+    auto addChildren = [&](Dwarf_Die* die, int64_t parent, const auto& addChildren) -> void {
+        Dwarf_Die childDie;
+        if (dwarf_child(die, &childDie) != 0)
+            return;
+
+        while (true) {
+            auto childParent = parent;
+            if (dwarf_tag(&childDie) == DW_TAG_inlined_subroutine) {
+                const auto index = static_cast<uint32_t>(m_inlineScopes.size());
+                m_inlineScopes.push_back({childDie, callSourceLocation(&childDie, files, cuDie)});
+                parents.push_back(parent);
+                walkRanges(
+                    [&events, index](DwarfRange range) {
+                        if (range.low < range.high) {
+                            events.push_back({range.low, index, true});
+                            events.push_back({range.high, index, false});
+                        }
+                        return true;
+                    },
+                    &childDie);
+                childParent = index;
+            }
+            addChildren(&childDie, childParent, addChildren);
+
+            Dwarf_Die siblingDie;
+            if (dwarf_siblingof(&childDie, &siblingDie) != 0)
+                break;
+            childDie = siblingDie;
+        }
+    };
+    addChildren(die(), -1, addChildren);
+
+    if (m_inlineScopes.empty())
+        return;
+
+    std::sort(events.begin(), events.end(), [](const Event& lhs, const Event& rhs) { return lhs.addr < rhs.addr; });
+
+    // sweep over all range boundaries, the scopes that contain an address are the ones that are active
+    // and, as findInlineScopes doesn't descend into scopes that don't contain it, whose parents are too
+    // the active scopes are ordered by their index, such that parents are visited before their children
+    std::vector<uint32_t> activeRanges(m_inlineScopes.size(), 0);
+    std::set<uint32_t> activeScopes;
+    // the range in which a scope got found to contain the addresses last, to not reset this for every range
+    std::vector<size_t> inScopeRange(m_inlineScopes.size(), 0);
+    size_t range = 0;
+    std::vector<uint32_t> scopes;
+    for (auto it = events.begin(); it != events.end();) {
+        const auto addr = it->addr;
+        for (; it != events.end() && it->addr == addr; ++it) {
+            if (it->isStart && !activeRanges[it->index]++)
+                activeScopes.insert(it->index);
+            else if (!it->isStart && !--activeRanges[it->index])
+                activeScopes.erase(it->index);
+        }
+        if (it == events.end())
+            break;
+
+        ++range;
+        scopes.clear();
+        for (auto index : activeScopes) {
+            const auto parent = parents[index];
+            if (parent < 0 || inScopeRange[parent] == range) {
+                inScopeRange[index] = range;
+                scopes.push_back(index);
+            }
+        }
+        if (scopes.empty())
+            continue;
+
+        if (!m_inlineScopeRanges.empty() && m_inlineScopeRanges.back().high == addr
+            && m_inlineScopeRanges.back().scopes == scopes) {
+            m_inlineScopeRanges.back().high = it->addr;
+        } else {
+            m_inlineScopeRanges.push_back({addr, it->addr, scopes});
+        }
+    }
+}
+
 CuDieRangeMapping::CuDieRangeMapping(Dwarf_Die cudie, Dwarf_Addr bias)
     : m_bias {bias}
     , m_cuDieRanges {cudie, {}}
@@ -314,12 +576,11 @@ SubProgramDie* CuDieRangeMapping::findSubprogramDie(Dwarf_Addr offset)
     if (m_subPrograms.empty())
         addSubprograms();
 
-    auto it = std::find_if(m_subPrograms.begin(), m_subPrograms.end(),
-                           [offset](const SubProgramDie& program) { return program.contains(offset); });
-    if (it == m_subPrograms.end())
+    const auto index = m_subProgramIndex.find(offset);
+    if (index < 0)
         return nullptr;
 
-    return &(*it);
+    return &m_subPrograms[index];
 }
 
 void CuDieRangeMapping::addSubprograms()
@@ -339,6 +600,12 @@ void CuDieRangeMapping::addSubprograms()
             return WalkResult::Recurse;
         },
         cudie());
+
+    for (uint32_t i = 0; i < m_subPrograms.size(); ++i) {
+        for (const auto& range : m_subPrograms[i].ranges())
+            m_subProgramIndex.add(range, i);
+    }
+    m_subProgramIndex.build();
 }
 
 const std::string& CuDieRangeMapping::dieName(Dwarf_Die* die)
@@ -346,31 +613,125 @@ const std::string& CuDieRangeMapping::dieName(Dwarf_Die* die)
     const auto offset = dwarf_dieoffset(die);
     auto it = m_dieNameCache.find(offset);
     if (it == m_dieNameCache.end())
-        it = m_dieNameCache.insert({offset, demangle(qualifiedDieName(die, m_dieNameCache))}).first;
+        it = m_dieNameCache.insert({offset, demangle(qualifiedDieName(die, m_scopeNameCache))}).first;
 
     return it->second;
 }
 
 DwarfDieCache::DwarfDieCache(Dwfl_Module* mod)
+    : m_module(mod)
+{
+}
+
+CuDieRangeMapping* DwarfDieCache::findCuDie(Dwarf_Addr addr)
+{
+    if (!m_module)
+        return nullptr;
+
+    if (!m_initialized)
+        initialize();
+
+    if (!m_arangeCuOffsets.empty()) {
+        if (auto cuDie = findCuDieViaAranges(addr))
+            return cuDie;
+        if (m_arangesComplete)
+            return nullptr;
+    }
+
+    if (!m_visitedAllCuDies)
+        addAllCuDies();
+
+    const auto index = m_cuDieIndex.find(addr);
+    if (index < 0)
+        return nullptr;
+
+    return &m_cuDieRanges[m_indexedCuDies[index]];
+}
+
+void DwarfDieCache::initialize()
 {
-    if (!mod)
+    m_initialized = true;
+
+    m_dwarf = dwfl_module_getdwarf(m_module, &m_bias);
+    Dwarf_Aranges* aranges = nullptr;
+    size_t numAranges = 0;
+    if (!m_dwarf || dwarf_getaranges(m_dwarf, &aranges, &numAranges) != 0 || !numAranges)
         return;
 
-    Dwarf_Die* die = nullptr;
-    Dwarf_Addr bias = 0;
-    while ((die = dwfl_module_nextcu(mod, die, &bias))) {
-        CuDieRangeMapping cuDieMapping(*die, bias);
-        if (!cuDieMapping.isEmpty())
-            m_cuDieRanges.push_back(cuDieMapping);
+    tsl::robin_map<Dwarf_Off, uint32_t> arangeCuIndices;
+    for (size_t i = 0; i < numAranges; ++i) {
+        Dwarf_Addr start = 0;
+        Dwarf_Word length = 0;
+        Dwarf_Off cuOffset = 0;
+        if (dwarf_getarangeinfo(dwarf_onearange(aranges, i), &start, &length, &cuOffset) != 0)
+            continue;
+        auto inserted = arangeCuIndices.insert({cuOffset, m_arangeCuOffsets.size()});
+        if (inserted.second)
+            m_arangeCuOffsets.push_back(cuOffset);
+        m_arangeIndex.add({start + m_bias, start + m_bias + length}, inserted.first->second);
+    }
+    m_arangeIndex.build();
+
+    // the aranges are optional per CU, e.g. for assembly files or when compiled with clang
+    // only the CU headers get read here, which is cheap compared to visiting the CU DIEs
+    m_arangesComplete = true;
+    Dwarf_Off offset = 0;
+    Dwarf_Off nextOffset = 0;
+    size_t headerSize = 0;
+    while (dwarf_nextcu(m_dwarf, offset, &nextOffset, &headerSize, nullptr, nullptr, nullptr) == 0) {
+        if (!arangeCuIndices.contains(offset + headerSize)) {
+            m_arangesComplete = false;
+            break;
+        }
+        offset = nextOffset;
     }
 }
 
-CuDieRangeMapping* DwarfDieCache::findCuDie(Dwarf_Addr addr)
+CuDieRangeMapping* DwarfDieCache::findCuDieViaAranges(Dwarf_Addr addr)
 {
-    auto it = std::find_if(m_cuDieRanges.begin(), m_cuDieRanges.end(),
-                           [addr](const CuDieRangeMapping& cuDieMapping) { return cuDieMapping.contains(addr); });
-    if (it == m_cuDieRanges.end())
+    const auto index = m_arangeIndex.find(addr);
+    if (index < 0)
         return nullptr;
 
-    return &(*it);
+    const auto cuOffset = m_arangeCuOffsets[index];
+    auto it = m_cuDieMappings.find(cuOffset);
+    if (it != m_cuDieMappings.end())
+        return &m_cuDieRanges[it->second];
+
+    Dwarf_Die cuDie;
+    if (!dwarf_offdie(m_dwarf, cuOffset, &cuDie))
+        return nullptr;
+
+    return &m_cuDieRanges[cuDieMapping(&cuDie, m_bias)];
+}
+
+void DwarfDieCache::addAllCuDies()
+{
+    m_visitedAllCuDies = true;
+
+    Dwarf_Die* die = nullptr;
+    Dwarf_Addr bias = 0;
+    while ((die = dwfl_module_nextcu(m_module, die, &bias))) {
+        const auto index = cuDieMapping(die, bias);
+        const auto& cuDieMapping = m_cuDieRanges[index];
+        if (cuDieMapping.isEmpty())
+            continue;
+
+        for (const auto& range : cuDieMapping.ranges())
+            m_cuDieIndex.add(range, m_indexedCuDies.size());
+        m_indexedCuDies.push_back(index);
+    }
+    m_cuDieIndex.build();
+}
+
+size_t DwarfDieCache::cuDieMapping(Dwarf_Die* cuDie, Dwarf_Addr bias)
+{
+    const auto offset = dwarf_dieoffset(cuDie);
+    auto it = m_cuDieMappings.find(offset);
+    if (it != m_cuDieMappings.end())
+        return it->second;
+
+    m_cuDieRanges.emplace_back(*cuDie, bias);
+    m_cuDieMappings.insert({offset, m_cuDieRanges.size() - 1});
+    return m_cuDieRanges.size() - 1;
 }
@@ -15,6 +15,7 @@
 #include <tsl/robin_map.h>
 
 #include <algorithm>
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -44,6 +45,38 @@ struct DwarfRange
     }
 };
 
+/**
+ * Maps addresses to the first of multiple, potentially overlapping, DIEs whose ranges contain them.
+ *
+ * The ranges get flattened into a sorted array of disjoint ranges once, such that lookups are a binary search.
+ */
+class DwarfRangeIndex
+{
+public:
+    /// add the @p range of the DIE with the given @p index, lower indices take precedence
+    void add(DwarfRange range, uint32_t index);
+    /// flatten the ranges, must be called after all ranges got added and before the first lookup
+    void build();
+
+    /// @return the index of the first DIE whose ranges contain @p addr, or -1
+    int64_t find(Dwarf_Addr addr) const;
+
+    /// @return the number of disjoint ranges, adjacent ranges of the same DIE get merged by build()
+    std::size_t size() const
+    {
+        return m_entries.size();
+    }
+
+private:
+    struct Entry
+    {
+        Dwarf_Addr low;
+        Dwarf_Addr high;
+        uint32_t index;
+    };
+    std::vector<Entry> m_entries;
+};
+
 /// cache of dwarf ranges for a given Dwarf_Die
 struct DieRanges
 {
@@ -67,6 +100,10 @@ public:
     {
         return m_ranges.ranges.empty();
     }
+    const std::vector<DwarfRange>& ranges() const
+    {
+        return m_ranges.ranges;
+    }
     /// @p offset a bias-corrected offset
     bool contains(Dwarf_Addr offset) const
     {
@@ -77,8 +114,36 @@ public:
         return &m_ranges.die;
     }
 
+    struct InlineScope
+    {
+        Dwarf_Die die;
+        /// the DW_AT_call_{file,line} of the DIE
+        SourceLocation callSite;
+    };
+    /**
+     * On first call this will visit the DIE sub tree to cache all inlined scopes and their call sites
+     * @return the same scopes as findInlineScopes, outermost first
+     * @p offset bias-corrected address that is checked against the dwarf ranges of the DIEs
+     * @p cuDie the CU DIE of this sub program
+     */
+    std::vector<InlineScope*> findInlineScopes(Dwarf_Addr offset, Dwarf_Die* cuDie);
+
 private:
+    void addInlineScopes(Dwarf_Die* cuDie);
+
     DieRanges m_ranges;
+
+    bool m_inlineScopesAdded = false;
+    // all DW_TAG_inlined_subroutine DIEs in pre-order
+    std::vector<InlineScope> m_inlineScopes;
+    // disjoint ranges that map to the indices of the scopes in m_inlineScopes that contain them
+    struct InlineScopeRange
+    {
+        Dwarf_Addr low;
+        Dwarf_Addr high;
+        std::vector<uint32_t> scopes;
+    };
+    std::vector<InlineScopeRange> m_inlineScopeRanges;
 };
 
 /// cache of dwarf ranges for a CU DIE and child sub programs
@@ -95,6 +160,11 @@ public:
     {
         return m_cuDieRanges.contains(addr);
     }
+    /// absolute ranges, not bias-corrected
+    const std::vector<DwarfRange>& ranges() const
+    {
+        return m_cuDieRanges.ranges;
+    }
     Dwarf_Addr bias()
     {
         return m_bias;
@@ -118,7 +188,11 @@ private:
     Dwarf_Addr m_bias = 0;
     DieRanges m_cuDieRanges;
     std::vector<SubProgramDie> m_subPrograms;
+    DwarfRangeIndex m_subProgramIndex;
     tsl::robin_map<Dwarf_Off, std::string> m_dieNameCache;
+    // the qualified names of the enclosing scopes, kept apart from the names above as they can differ for the same
+    // DIE, which would otherwise make the names depend on the order in which the addresses get resolved
+    tsl::robin_map<Dwarf_Off, std::string> m_scopeNameCache;
 };
 
 /**
@@ -130,7 +204,10 @@ std::vector<Dwarf_Die> findInlineScopes(Dwarf_Die* subprogram, Dwarf_Addr offset
 
 /**
  * This cache makes it easily possible to find a CU DIE (i.e. Compilation Unit Debugging Information Entry)
- * based on a
+ * based on an address.
+ *
+ * The CUs get looked up lazily via .debug_aranges, which doesn't require visiting any other CU. Only when
+ * an address isn't covered and not every CU is listed in there, all CUs get visited to find it via their ranges.
  */
 class DwarfDieCache
 {
@@ -141,7 +218,30 @@ public:
     CuDieRangeMapping* findCuDie(Dwarf_Addr addr);
 
 public:
-    std::vector<CuDieRangeMapping> m_cuDieRanges;
+    /// the CUs that got visited so far, a deque such that the pointers to them stay valid
+    std::deque<CuDieRangeMapping> m_cuDieRanges;
+
+private:
+    void initialize();
+    CuDieRangeMapping* findCuDieViaAranges(Dwarf_Addr addr);
+    void addAllCuDies();
+    /// @return the index of the mapping for @p cuDie in m_cuDieRanges, which gets created when needed
+    size_t cuDieMapping(Dwarf_Die* cuDie, Dwarf_Addr bias);
+
+    Dwfl_Module* m_module = nullptr;
+    Dwarf* m_dwarf = nullptr;
+    Dwarf_Addr m_bias = 0;
+    bool m_initialized = false;
+    // maps the absolute address ranges listed in .debug_aranges to the indices in m_arangeCuOffsets
+    DwarfRangeIndex m_arangeIndex;
+    std::vector<Dwarf_Off> m_arangeCuOffsets;
+    // true when every CU is listed in the aranges, then addresses that aren't covered by them are in no CU
+    bool m_arangesComplete = false;
+    bool m_visitedAllCuDies = false;
+    tsl::robin_map<Dwarf_Off, size_t> m_cuDieMappings;
+    // maps to the indices in m_cuDieRanges, in the order of the CUs in the module
+    DwarfRangeIndex m_cuDieIndex;
+    std::vector<size_t> m_indexedCuDies;
 };
 
 #endif // DWARFDIECACHE_H
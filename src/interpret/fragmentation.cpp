@@ -0,0 +1,254 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "fragmentation.h"
+
+#include "util/linewriter.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <vector>
+
+namespace {
+// allocations spanning more pages are usually served by dedicated mappings, they cannot fragment the heap
+constexpr const uint64_t LARGE_ALLOCATION_PAGES = 32;
+// empty ranges of at most this many pages are considered holes, larger gaps separate address ranges
+constexpr const uint64_t MAX_HOLE_PAGES = 256;
+// write a new layout snapshot when the number of occupied pages grew by this fraction
+constexpr const double LAYOUT_GROWTH_FACTOR = 1.05;
+constexpr const uint64_t HEATMAP_BUCKETS = 64;
+// only the largest address ranges get a heatmap
+constexpr const size_t MAX_HEATMAP_RANGES = 32;
+constexpr const uint64_t MIN_SIZE_CLASS = 16;
+
+uint64_t toSizeClass(uint64_t size)
+{
+    uint64_t sizeClass = MIN_SIZE_CLASS;
+    while (sizeClass < size) {
+        sizeClass *= 2;
+    }
+    return sizeClass;
+}
+
+struct AddressRange
+{
+    uint64_t firstPage = 0;
+    uint64_t lastPage = 0;
+    uint64_t pages() const
+    {
+        return lastPage - firstPage + 1;
+    }
+};
+}
+
+void Fragmentation::setPageSize(uint64_t pageSize)
+{
+    if (pageSize) {
+        m_pageSize = pageSize;
+    }
+}
+
+bool Fragmentation::isLarge(uint64_t ptr, uint64_t size) const
+{
+    return lastPage(ptr, size) - firstPage(ptr) >= LARGE_ALLOCATION_PAGES;
+}
+
+uint64_t Fragmentation::firstPage(uint64_t ptr) const
+{
+    return ptr / m_pageSize;
+}
+
+uint64_t Fragmentation::lastPage(uint64_t ptr, uint64_t size) const
+{
+    return (ptr + std::max(size, uint64_t(1)) - 1) / m_pageSize;
+}
+
+void Fragmentation::addAllocation(uint64_t ptr, uint64_t size)
+{
+    auto it = m_allocations.find(ptr);
+    if (it != m_allocations.end()) {
+        // missed a deallocation, e.g. because it happened before we attached
+        removeAllocation(ptr);
+    }
+    m_allocations.insert({ptr, size});
+    m_liveBytes += size;
+
+    if (isLarge(ptr, size)) {
+        m_largePages += lastPage(ptr, size) - firstPage(ptr) + 1;
+        return;
+    }
+
+    for (auto page = firstPage(ptr), last = lastPage(ptr, size); page <= last; ++page) {
+        ++m_pages[page];
+    }
+}
+
+void Fragmentation::removeAllocation(uint64_t ptr)
+{
+    auto it = m_allocations.find(ptr);
+    if (it == m_allocations.end()) {
+        return;
+    }
+    const auto size = it->second;
+    m_allocations.erase(it);
+    m_liveBytes -= size;
+
+    if (isLarge(ptr, size)) {
+        m_largePages -= lastPage(ptr, size) - firstPage(ptr) + 1;
+        return;
+    }
+
+    for (auto page = firstPage(ptr), last = lastPage(ptr, size); page <= last; ++page) {
+        auto pageIt = m_pages.find(page);
+        if (pageIt->second == 1) {
+            m_pages.erase(pageIt);
+        } else {
+            --pageIt.value();
+        }
+    }
+}
+
+void Fragmentation::writeTimeStamp(LineWriter& out)
+{
+    const uint64_t occupiedPages = m_pages.size() + m_largePages;
+    if (occupiedPages == m_lastOccupiedPages && m_liveBytes == m_lastLiveBytes) {
+        return;
+    }
+
+    out.writeHexLine('F', m_liveBytes, occupiedPages);
+    m_lastLiveBytes = m_liveBytes;
+    m_lastOccupiedPages = occupiedPages;
+
+    if (occupiedPages > m_lastLayoutPages * LAYOUT_GROWTH_FACTOR) {
+        writeLayout(out);
+    }
+}
+
+void Fragmentation::writeFinalLayout(LineWriter& out)
+{
+    writeTimeStamp(out);
+    if (m_pages.size() + m_largePages > m_lastLayoutPages) {
+        writeLayout(out);
+    }
+}
+
+void Fragmentation::writeLayout(LineWriter& out)
+{
+    // the occupied pages, large allocations occupy a whole range of pages
+    std::vector<AddressRange> occupied;
+    occupied.reserve(m_pages.size());
+    for (const auto& page : m_pages) {
+        occupied.push_back({page.first, page.first});
+    }
+    for (const auto& allocation : m_allocations) {
+        if (isLarge(allocation.first, allocation.second)) {
+            occupied.push_back({firstPage(allocation.first), lastPage(allocation.first, allocation.second)});
+        }
+    }
+    std::sort(occupied.begin(), occupied.end(),
+              [](const AddressRange& lhs, const AddressRange& rhs) { return lhs.firstPage < rhs.firstPage; });
+
+    // group the occupied pages into address ranges, small gaps in-between are holes
+    std::vector<AddressRange> ranges;
+    uint64_t holePages = 0;
+    for (const auto& pages : occupied) {
+        if (!ranges.empty() && pages.firstPage <= ranges.back().lastPage + MAX_HOLE_PAGES) {
+            if (pages.firstPage > ranges.back().lastPage) {
+                holePages += pages.firstPage - ranges.back().lastPage - 1;
+            }
+            ranges.back().lastPage = std::max(ranges.back().lastPage, pages.lastPage);
+        } else {
+            ranges.push_back(pages);
+        }
+    }
+
+    const uint64_t occupiedPages = m_pages.size() + m_largePages;
+    out.writeHexLine('L', m_liveBytes, occupiedPages, holePages);
+    m_lastLayoutPages = occupiedPages;
+
+    // only consider the largest address ranges for the heatmap
+    if (ranges.size() > MAX_HEATMAP_RANGES) {
+        std::nth_element(ranges.begin(), ranges.begin() + MAX_HEATMAP_RANGES, ranges.end(),
+                         [](const AddressRange& lhs, const AddressRange& rhs) { return lhs.pages() > rhs.pages(); });
+        ranges.resize(MAX_HEATMAP_RANGES);
+    }
+    std::sort(ranges.begin(), ranges.end(),
+              [](const AddressRange& lhs, const AddressRange& rhs) { return lhs.firstPage < rhs.firstPage; });
+    std::vector<std::vector<uint64_t>> heatmaps(ranges.size(), std::vector<uint64_t>(HEATMAP_BUCKETS, 0));
+    auto bucketSize = [this](const AddressRange& range) {
+        const auto pagesPerBucket = (range.pages() + HEATMAP_BUCKETS - 1) / HEATMAP_BUCKETS;
+        return pagesPerBucket * m_pageSize;
+    };
+
+    struct SizeClassData
+    {
+        uint64_t allocations = 0;
+        uint64_t liveBytes = 0;
+        std::vector<uint64_t> pages;
+    };
+    tsl::robin_map<uint64_t, SizeClassData> sizeClasses;
+    for (const auto& allocation : m_allocations) {
+        const auto ptr = allocation.first;
+        const auto size = allocation.second;
+        const bool large = isLarge(ptr, size);
+        auto& data = sizeClasses[large ? 0 : toSizeClass(size)];
+        ++data.allocations;
+        data.liveBytes += size;
+        if (!large) {
+            for (auto page = firstPage(ptr), last = lastPage(ptr, size); page <= last; ++page) {
+                data.pages.push_back(page);
+            }
+        }
+
+        const auto page = firstPage(ptr);
+        auto range = std::upper_bound(ranges.begin(), ranges.end(), page,
+                                      [](uint64_t page, const AddressRange& range) { return page < range.firstPage; });
+        if (range == ranges.begin() || page > std::prev(range)->lastPage) {
+            continue;
+        }
+        --range;
+
+        // distribute the allocation over all the buckets it spans
+        auto& heatmap = heatmaps[range - ranges.begin()];
+        const auto rangeStart = range->firstPage * m_pageSize;
+        const auto rangeBucketSize = bucketSize(*range);
+        for (auto start = ptr, end = ptr + size; start < end;) {
+            const auto bucket = (start - rangeStart) / rangeBucketSize;
+            const auto bucketEnd = std::min(end, rangeStart + (bucket + 1) * rangeBucketSize);
+            heatmap[bucket] += bucketEnd - start;
+            start = bucketEnd;
+        }
+    }
+
+    std::vector<uint64_t> sortedSizeClasses;
+    sortedSizeClasses.reserve(sizeClasses.size());
+    for (const auto& sizeClass : sizeClasses) {
+        sortedSizeClasses.push_back(sizeClass.first);
+    }
+    std::sort(sortedSizeClasses.begin(), sortedSizeClasses.end());
+    for (auto sizeClass : sortedSizeClasses) {
+        auto& data = sizeClasses[sizeClass];
+        uint64_t occupied = 0;
+        if (sizeClass) {
+            std::sort(data.pages.begin(), data.pages.end());
+            occupied = std::unique(data.pages.begin(), data.pages.end()) - data.pages.begin();
+        } else {
+            occupied = m_largePages;
+        }
+        out.writeHexLine('f', sizeClass, data.allocations, data.liveBytes, occupied);
+    }
+
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        const auto& range = ranges[i];
+        const auto size = bucketSize(range);
+        const auto numBuckets = (range.pages() * m_pageSize + size - 1) / size;
+        out.write("H %" PRIx64 " %" PRIx64, range.firstPage * m_pageSize, size);
+        for (uint64_t bucket = 0; bucket < numBuckets; ++bucket) {
+            out.write(" %" PRIx64, heatmaps[i][bucket]);
+        }
+        out.write("\n");
+    }
+}
@@ -0,0 +1,69 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef FRAGMENTATION_H
+#define FRAGMENTATION_H
+
+#include <tsl/robin_map.h>
+
+#include <cstdint>
+
+class LineWriter;
+
+/**
+ * Replays the allocation addresses to estimate the fragmentation of the heap.
+ *
+ * We keep track of the pages that are occupied by live allocations, which
+ * allows us to compare the number of live bytes to the memory spanned by them.
+ * This explains situations where the RSS is far higher than the peak heap
+ * memory consumption.
+ *
+ * The following records get written:
+ *
+ * - `F <live bytes> <occupied pages>` whenever these values changed since the last timestamp
+ * - `L <live bytes> <occupied pages> <hole pages>` starts a new layout snapshot
+ * - `f <size class> <allocations> <live bytes> <occupied pages>` for every size class of the snapshot,
+ *   a size class of zero stands for the large allocations that get tracked separately
+ * - `H <start address> <bucket size> <live bytes>...` a heatmap of one contiguous address range of the snapshot
+ *
+ * Layout snapshots are only written when the number of occupied pages grew significantly, which bounds
+ * their number while ensuring we get a snapshot close to the peak.
+ */
+class Fragmentation
+{
+public:
+    void setPageSize(uint64_t pageSize);
+
+    void addAllocation(uint64_t ptr, uint64_t size);
+    void removeAllocation(uint64_t ptr);
+
+    /// called for every timestamp, writes the time series and potentially a new layout snapshot
+    void writeTimeStamp(LineWriter& out);
+    /// called at the end of the data stream, writes a last layout snapshot if the heap grew since the last one
+    void writeFinalLayout(LineWriter& out);
+
+private:
+    bool isLarge(uint64_t ptr, uint64_t size) const;
+    uint64_t firstPage(uint64_t ptr) const;
+    uint64_t lastPage(uint64_t ptr, uint64_t size) const;
+    void writeLayout(LineWriter& out);
+
+    uint64_t m_pageSize = 4096;
+    // live allocations, mapping the address to their size
+    tsl::robin_map<uint64_t, uint64_t> m_allocations;
+    // number of small live allocations per page
+    tsl::robin_map<uint64_t, uint32_t> m_pages;
+
+    uint64_t m_liveBytes = 0;
+    // pages occupied by large allocations, these are not part of m_pages
+    uint64_t m_largePages = 0;
+
+    uint64_t m_lastLiveBytes = 0;
+    uint64_t m_lastOccupiedPages = 0;
+    uint64_t m_lastLayoutPages = 0;
+};
+
+#endif // FRAGMENTATION_H
@@ -11,99 +11,46 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <cinttypes>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <set>
 #include <sstream>
 #ifdef __linux__
 #include <stdio_ext.h>
 #endif
 #include <memory>
-#include <tuple>
+#include <thread>
 #include <vector>
 
-#include "dwarfdiecache.h"
-#include "symbolcache.h"
+#include <tsl/robin_set.h>
+
+#include "compressedoutput.h"
+#include "fragmentation.h"
+#include "stringinterner.h"
+#include "symbolizer.h"
 
 #include "util/linereader.h"
 #include "util/linewriter.h"
 #include "util/pointermap.h"
-
-#include <dwarf.h>
-#include <elfutils/libdwelf.h>
+#include "util/recentallocations.h"
 
 #include <csignal>
+#include <fcntl.h>
 #include <unistd.h>
 
 using namespace std;
 
 namespace {
-bool isArmArch()
-{
-#ifdef __arm__
-    return true;
-#else
-    return false;
-#endif
-}
-
 #define error_out cerr << __FILE__ << ':' << __LINE__ << " ERROR:"
 
-bool startsWith(const std::string& haystack, const char* needle)
-{
-    return haystack.compare(0, strlen(needle), needle) == 0;
-}
-
-static uint64_t alignedAddress(uint64_t addr, bool isArmArch)
-{
-    // Adjust addr back. The symtab entries are 1 off for all practical purposes.
-    return (isArmArch && (addr & 1)) ? addr - 1 : addr;
-}
-
-static SymbolCache::Symbols extractSymbols(Dwfl_Module* module, uint64_t elfStart, bool isArmArch)
-{
-    SymbolCache::Symbols symbols;
-
-    const auto numSymbols = dwfl_module_getsymtab(module);
-    if (numSymbols <= 0)
-        return symbols;
-
-    symbols.reserve(numSymbols);
-    for (int i = 0; i < numSymbols; ++i) {
-        GElf_Sym sym;
-        GElf_Addr symAddr;
-        const auto symbol = dwfl_module_getsym_info(module, i, &sym, &symAddr, nullptr, nullptr, nullptr);
-        if (symbol) {
-            const uint64_t start = alignedAddress(sym.st_value, isArmArch);
-            symbols.push_back({symAddr - elfStart, start, sym.st_size, symbol});
-        }
-    }
-    return symbols;
-}
-
-struct Frame
-{
-    Frame(string function = {}, string file = {}, int line = 0)
-        : function(function)
-        , file(file)
-        , line(line)
-    {
-    }
-
-    bool isValid() const
-    {
-        return !function.empty();
-    }
-
-    string function;
-    string file;
-    int line;
-};
-
-struct AddressInformation
-{
-    Frame frame;
-    vector<Frame> inlined;
-};
+// fake instruction pointer appended to truncated backtraces, cf. Trace::TRUNCATION_MARKER
+constexpr uintptr_t TRUNCATION_MARKER = UINTPTR_MAX;
 
 struct ResolvedFrame
 {
@@ -125,138 +72,332 @@ struct ResolvedIP
     vector<ResolvedFrame> inlined;
 };
 
-struct ModuleFragment
+/**
+ * Symbolizes the instruction pointers on a pool of worker threads, ahead of the main thread.
+ *
+ * A reader thread reads the input in batches of lines and looks for new instruction pointers. Each of them becomes
+ * a job for the worker that owns the module of the instruction pointer. That way every worker only loads the debug
+ * information of its own modules, into its own Dwfl, and large modules get symbolized in parallel to each other.
+ *
+ * The main thread then processes the lines in input order and only waits for a job once it reaches the trace that
+ * references the instruction pointer first. As it writes the output in order too, the strings and instruction
+ * pointers still get written before anything references them. Meanwhile, the reader thread keeps draining the input,
+ * such that the traced application does not stall while we symbolize.
+ */
+class SymbolizerPipeline
 {
-    ModuleFragment(string fileName, uintptr_t addressStart, uintptr_t fragmentStart, uintptr_t fragmentEnd,
-                   size_t moduleIndex)
-        : fileName(fileName)
-        , addressStart(addressStart)
-        , fragmentStart(fragmentStart)
-        , fragmentEnd(fragmentEnd)
-        , moduleIndex(moduleIndex)
+public:
+    SymbolizerPipeline(istream& in, unsigned numWorkers)
+        : m_workers(numWorkers)
     {
+        for (auto& worker : m_workers) {
+            worker.pipeline = this;
+            worker.runner = thread([&worker]() { worker.run(); });
+        }
+        for (unsigned i = 0; i < MAX_BATCHES; ++i) {
+            m_freeBatches.push_back(make_unique<Batch>());
+        }
+        m_reader = thread([this, &in]() { read(in); });
     }
 
-    bool operator<(const ModuleFragment& module) const
+    ~SymbolizerPipeline()
     {
-        return tie(addressStart, fragmentStart, fragmentEnd, moduleIndex)
-            < tie(module.addressStart, module.fragmentStart, module.fragmentEnd, module.moduleIndex);
+        {
+            lock_guard<mutex> lock(m_batchMutex);
+            m_stop = true;
+        }
+        m_batchCondition.notify_all();
+        m_reader.join();
+        for (auto& worker : m_workers) {
+            worker.push({WorkItem::Stop});
+            worker.runner.join();
+        }
     }
 
-    bool operator!=(const ModuleFragment& module) const
+    /**
+     * Read the next line of the input into @p reader.
+     *
+     * @return false at the end of the input
+     */
+    bool getLine(LineReader& reader)
     {
-        return tie(addressStart, fragmentStart, fragmentEnd, moduleIndex)
-            != tie(module.addressStart, module.fragmentStart, module.fragmentEnd, module.moduleIndex);
+        while (!m_batch || m_batch->nextLine == m_batch->numLines) {
+            unique_lock<mutex> lock(m_batchMutex);
+            if (m_batch) {
+                m_batch->numLines = 0;
+                m_batch->nextLine = 0;
+                m_batch->jobs.clear();
+                m_batch->nextJob = 0;
+                m_freeBatches.push_back(std::move(m_batch));
+                m_batchCondition.notify_all();
+            }
+            m_batchCondition.wait(lock, [this]() { return !m_fullBatches.empty() || m_readerDone; });
+            if (m_fullBatches.empty()) {
+                return false;
+            }
+            m_batch = std::move(m_fullBatches.front());
+            m_fullBatches.pop_front();
+        }
+        reader.swapLine(m_batch->lines[m_batch->nextLine++]);
+        return true;
     }
 
-    string fileName;
-    uintptr_t addressStart;
-    uintptr_t fragmentStart;
-    uintptr_t fragmentEnd;
-    size_t moduleIndex;
-};
-
-struct Module
-{
-    Module(string fileName, uintptr_t addressStart, Dwfl_Module* module, SymbolCache* symbolCache)
-        : fileName(std::move(fileName))
-        , addressStart(addressStart)
-        , module(module)
-        , dieCache(module)
-        , symbolCache(symbolCache)
+    /**
+     * @return the symbolized @p ip, which must be the next one that was not encountered before
+     */
+    SymbolizedIP take(const uintptr_t ip)
     {
+        assert(m_batch && m_batch->nextJob < m_batch->jobs.size());
+        auto& job = *m_batch->jobs[m_batch->nextJob++];
+        assert(job.ip == ip);
+        (void)ip;
+
+        unique_lock<mutex> lock(m_jobMutex);
+        m_jobCondition.wait(lock, [&job]() { return job.done; });
+        return std::move(job.result);
     }
 
-    Module()
-        : Module({}, 0, nullptr, nullptr)
+private:
+    struct Job
     {
-    }
+        uintptr_t ip = 0;
+        SymbolizedIP result;
+        // guarded by m_jobMutex
+        bool done = false;
+    };
 
-    AddressInformation resolveAddress(uintptr_t address) const
+    struct Batch
     {
-        AddressInformation info;
+        // the strings get reused for the next batch, to not allocate memory for every line
+        vector<string> lines = vector<string>(LINES_PER_BATCH);
+        size_t numLines = 0;
+        size_t nextLine = 0;
+        // the jobs of the new instruction pointers in the lines, in input order
+        vector<unique_ptr<Job>> jobs;
+        size_t nextJob = 0;
+    };
+
+    struct WorkItem
+    {
+        enum Type
+        {
+            AddModule,
+            SetBuildId,
+            ClearModules,
+            Symbolize,
+            Stop,
+        };
 
-        if (!module) {
-            return info;
+        WorkItem() = default;
+        WorkItem(Type type, string fileName = {}, size_t moduleIndex = 0, uintptr_t addressStart = 0,
+                 uintptr_t fragmentStart = 0, uintptr_t fragmentEnd = 0, Job* job = nullptr)
+            : type(type)
+            , fileName(std::move(fileName))
+            , moduleIndex(moduleIndex)
+            , addressStart(addressStart)
+            , fragmentStart(fragmentStart)
+            , fragmentEnd(fragmentEnd)
+            , job(job)
+        {
         }
 
-        if (!symbolCache->hasSymbols(fileName)) {
-            // cache all symbols in a sorted lookup table and demangle them on-demand
-            // note that the symbols within the symtab aren't necessarily sorted,
-            // which makes searching repeatedly via dwfl_module_addrinfo potentially very slow
-            symbolCache->setSymbols(fileName, extractSymbols(module, addressStart, isArmArch()));
-        }
+        Type type = Stop;
+        string fileName;
+        size_t moduleIndex = 0;
+        uintptr_t addressStart = 0;
+        uintptr_t fragmentStart = 0;
+        uintptr_t fragmentEnd = 0;
+        Job* job = nullptr;
+    };
 
-        auto cachedAddrInfo = symbolCache->findSymbol(fileName, address - addressStart);
-        if (cachedAddrInfo.isValid()) {
-            info.frame.function = std::move(cachedAddrInfo.symname);
-        }
+    struct Worker
+    {
+        SymbolizerPipeline* pipeline = nullptr;
+        thread runner;
+        mutex itemMutex;
+        condition_variable itemCondition;
+        deque<WorkItem> items;
 
-        auto cuDie = dieCache.findCuDie(address);
-        if (!cuDie) {
-            return info;
+        void push(WorkItem item)
+        {
+            {
+                lock_guard<mutex> lock(itemMutex);
+                items.push_back(std::move(item));
+            }
+            itemCondition.notify_one();
         }
 
-        const auto offset = address - cuDie->bias();
-        auto srcloc = dwarf_getsrc_die(cuDie->cudie(), offset);
-        if (srcloc) {
-            const char* srcfile = dwarf_linesrc(srcloc, nullptr, nullptr);
-            if (srcfile) {
-                const auto file = std::string(srcfile);
-                info.frame.file = srcfile;
-                dwarf_lineno(srcloc, &info.frame.line);
+        void run()
+        {
+            Symbolizer symbolizer(pipeline->m_symbolizationCache);
+            while (true) {
+                WorkItem item;
+                {
+                    unique_lock<mutex> lock(itemMutex);
+                    itemCondition.wait(lock, [this]() { return !items.empty(); });
+                    item = std::move(items.front());
+                    items.pop_front();
+                }
+
+                switch (item.type) {
+                case WorkItem::AddModule:
+                    symbolizer.fragments().add(std::move(item.fileName), item.moduleIndex, item.addressStart,
+                                               item.fragmentStart, item.fragmentEnd);
+                    break;
+                case WorkItem::SetBuildId:
+                    symbolizer.fragments().setBuildId(item.fileName);
+                    break;
+                case WorkItem::ClearModules:
+                    symbolizer.fragments().clear();
+                    break;
+                case WorkItem::Symbolize:
+                    pipeline->finish(item.job, symbolizer.symbolize(item.job->ip));
+                    break;
+                case WorkItem::Stop:
+                    return;
+                }
             }
         }
+    };
 
-        auto* subprogram = cuDie->findSubprogramDie(offset);
-        if (!subprogram) {
-            return info;
+    void finish(Job* job, SymbolizedIP result)
+    {
+        {
+            lock_guard<mutex> lock(m_jobMutex);
+            job->result = std::move(result);
+            job->done = true;
         }
+        m_jobCondition.notify_all();
+    }
 
-        // resolve the inline chain if possible
-        auto scopes = findInlineScopes(subprogram->die(), offset);
-
-        if (scopes.empty()) {
-            // no inline frames, use subprogram name directly and return
-            info.frame.function = cuDie->dieName(subprogram->die());
-            return info;
+    void broadcast(const WorkItem& item)
+    {
+        for (auto& worker : m_workers) {
+            worker.push(item);
         }
+    }
 
-        // use name of the last inlined function as symbol
-        info.frame.function = cuDie->dieName(&scopes.back());
+    /// runs on the reader thread, mirrors the module handling of the main loop to dispatch the jobs
+    void read(istream& in)
+    {
+        LineReader reader;
+        string exe;
+        ModuleFragments fragments;
+        size_t moduleIndex = 0;
+        tsl::robin_set<uintptr_t> encounteredIps;
+
+        unique_ptr<Batch> batch;
+        bool done = false;
+        while (!done) {
+            {
+                unique_lock<mutex> lock(m_batchMutex);
+                m_batchCondition.wait(lock, [this]() { return !m_freeBatches.empty() || m_stop; });
+                if (m_stop) {
+                    break;
+                }
+                batch = std::move(m_freeBatches.back());
+                m_freeBatches.pop_back();
+            }
 
-        Dwarf_Files* files = nullptr;
-        dwarf_getsrcfiles(cuDie->cudie(), &files, nullptr);
+            // only happens when the main thread bails out early, don't wait for the end of the input then
+            while (batch->numLines < LINES_PER_BATCH && !m_stop) {
+                if (!reader.getLine(in)) {
+                    done = true;
+                    break;
+                }
+                batch->lines[batch->numLines++].assign(reader.lineData(), reader.lineLength());
+
+                if (reader.mode() == 'v') {
+                    unsigned int heaptrackVersion = 0;
+                    reader >> heaptrackVersion;
+                    unsigned int fileVersion = 0;
+                    reader >> fileVersion;
+                    if (fileVersion >= 3) {
+                        reader.setExpectedSizedStrings(true);
+                    }
+                } else if (reader.mode() == 'x') {
+                    reader >> exe;
+                } else if (reader.mode() == 'm') {
+                    string fileName;
+                    reader >> fileName;
+                    if (fileName == "-") {
+                        fragments.clear();
+                        broadcast({WorkItem::ClearModules});
+                        continue;
+                    }
+                    if (fileName == "x") {
+                        fileName = exe;
+                    }
+                    ++moduleIndex;
+                    uintptr_t addressStart = 0;
+                    if (!(reader >> addressStart)) {
+                        continue;
+                    }
+                    uintptr_t vAddr = 0;
+                    uintptr_t memSize = 0;
+                    while ((reader >> vAddr) && (reader >> memSize)) {
+                        const auto fragmentStart = addressStart + vAddr;
+                        const auto fragmentEnd = fragmentStart + memSize;
+                        fragments.add(fileName, moduleIndex, addressStart, fragmentStart, fragmentEnd);
+                        broadcast(
+                            {WorkItem::AddModule, fileName, moduleIndex, addressStart, fragmentStart, fragmentEnd});
+                    }
+                } else if (reader.mode() == 'B') {
+                    string buildId;
+                    reader >> buildId;
+                    fragments.setBuildId(buildId);
+                    broadcast({WorkItem::SetBuildId, buildId});
+                } else if (reader.mode() == 't') {
+                    uintptr_t ip = 0;
+                    if (!(reader >> ip) || !ip || ip == TRUNCATION_MARKER || !encounteredIps.insert(ip).second) {
+                        continue;
+                    }
 
-        auto handleDie = [&](Dwarf_Die *scope, Dwarf_Die *prevScope) {
-            const auto tag = dwarf_tag(prevScope);
-            if (tag != DW_TAG_inlined_subroutine) {
-                error_out << "unexpected prev scope tag: " << std::hex << tag << '\n';
-                return;
+                    batch->jobs.push_back(make_unique<Job>());
+                    auto* job = batch->jobs.back().get();
+                    job->ip = ip;
+
+                    fragments.update();
+                    if (auto fragment = fragments.find(ip)) {
+                        auto& worker = m_workers[hash<string>()(fragment->fileName) % m_workers.size()];
+                        worker.push({WorkItem::Symbolize, {}, 0, 0, 0, 0, job});
+                    } else {
+                        // not part of any known module, nothing to symbolize
+                        job->done = true;
+                    }
+                }
             }
 
-            auto call = callSourceLocation(prevScope, files, cuDie->cudie());
-            info.inlined.push_back({cuDie->dieName(scope), std::move(call.file), call.line});
-        };
-
-        // iterate in reverse, to properly rebuild the inline stack
-        // note that we need to take the DW_AT_call_{file,line} from the previous scope DIE
-        const auto numScopes = scopes.size();
-        for (std::size_t scopeIndex = numScopes - 1; scopeIndex >= 1; --scopeIndex) {
-            handleDie(&scopes[scopeIndex - 1], &scopes[scopeIndex]);
+            {
+                lock_guard<mutex> lock(m_batchMutex);
+                m_fullBatches.push_back(std::move(batch));
+                m_readerDone = done;
+            }
+            m_batchCondition.notify_all();
         }
-
-        // the very last frame is the one where all the code got inlined into
-        handleDie(subprogram->die(), &scopes.front());
-
-        return info;
     }
 
-    string fileName;
-    uintptr_t addressStart;
-    Dwfl_Module* module;
-    mutable DwarfDieCache dieCache;
-    SymbolCache* symbolCache;
+    /// the number of lines that get read at once
+    static constexpr const size_t LINES_PER_BATCH = 4096;
+    /// limits how far the reader can get ahead of the main thread
+    static constexpr const unsigned MAX_BATCHES = 64;
+
+    // shared by the symbolizers of all workers, such that the entries of all of them get persisted
+    shared_ptr<SymbolizationCache> m_symbolizationCache = SymbolizationCache::fromConfiguration();
+    vector<Worker> m_workers;
+    thread m_reader;
+
+    mutex m_batchMutex;
+    condition_variable m_batchCondition;
+    deque<unique_ptr<Batch>> m_freeBatches;
+    deque<unique_ptr<Batch>> m_fullBatches;
+    bool m_readerDone = false;
+    atomic<bool> m_stop {false};
+    // only accessed by the main thread
+    unique_ptr<Batch> m_batch;
+
+    mutex m_jobMutex;
+    condition_variable m_jobCondition;
 };
 
 struct AccumulatedTraceData
@@ -264,128 +405,80 @@ struct AccumulatedTraceData
     AccumulatedTraceData()
         : out(fileno(stdout))
     {
-        m_moduleFragments.reserve(256);
-        m_internedData.reserve(4096);
         m_encounteredIps.reserve(32768);
-
-        {
-            std::string debugPath(":.debug:/usr/lib/debug");
-            const auto length = debugPath.size() + 1;
-            m_debugPath = new char[length];
-            std::memcpy(m_debugPath, debugPath.data(), length);
-        }
-
-        m_callbacks = {
-            &dwfl_build_id_find_elf,
-            &dwfl_standard_find_debuginfo,
-            &dwfl_offline_section_address,
-            &m_debugPath,
-        };
-
-        m_dwfl = dwfl_begin(&m_callbacks);
     }
 
     ~AccumulatedTraceData()
     {
-        out.write("# strings: %zu\n# ips: %zu\n", m_internedData.size(), m_encounteredIps.size());
-        out.flush();
-
-        delete[] m_debugPath;
-        dwfl_end(m_dwfl);
+        finish();
     }
 
-    ResolvedIP resolve(const uintptr_t ip)
+    /**
+     * Write the trailing statistics and all pending data.
+     *
+     * @return false when the output could not be written completely
+     */
+    bool finish()
     {
-        if (m_modulesDirty) {
-            // sort by addresses, required for binary search below
-            sort(m_moduleFragments.begin(), m_moduleFragments.end());
-
-#ifndef NDEBUG
-            for (size_t i = 0; i < m_moduleFragments.size(); ++i) {
-                const auto& m1 = m_moduleFragments[i];
-                for (size_t j = i + 1; j < m_moduleFragments.size(); ++j) {
-                    if (i == j) {
-                        continue;
-                    }
-                    const auto& m2 = m_moduleFragments[j];
-                    if ((m1.fragmentStart <= m2.fragmentStart && m1.fragmentEnd > m2.fragmentStart)
-                        || (m1.fragmentStart < m2.fragmentEnd && m1.fragmentEnd >= m2.fragmentEnd)) {
-                        cerr << "OVERLAPPING MODULES: " << hex << m1.moduleIndex << " (" << m1.fragmentStart << " to "
-                             << m1.fragmentEnd << ") and " << m1.moduleIndex << " (" << m2.fragmentStart << " to "
-                             << m2.fragmentEnd << ")\n"
-                             << dec;
-                    } else if (m2.fragmentStart >= m1.fragmentEnd) {
-                        break;
-                    }
-                }
-            }
-#endif
-
-            // reset dwfl state
-            m_modules.clear();
-
-            dwfl_report_begin(m_dwfl);
-            dwfl_report_end(m_dwfl, nullptr, nullptr);
-
-            m_modulesDirty = false;
+        if (!out.canWrite()) {
+            return true;
         }
+        out.write("# strings: %zu\n# ips: %zu\n", m_internedData.size(), m_encounteredIps.size());
+        const bool flushed = out.flush();
+        return out.close() && flushed;
+    }
 
+    ResolvedIP resolve(const uintptr_t ip)
+    {
         auto resolveFrame = [this](const Frame& frame) {
             return ResolvedFrame {intern(frame.function), intern(frame.file), frame.line};
         };
 
-        ResolvedIP data;
-        // find module for this instruction pointer
-        auto fragment = lower_bound(
-            m_moduleFragments.begin(), m_moduleFragments.end(), ip,
-            [](const ModuleFragment& fragment, const uintptr_t ip) -> bool { return fragment.fragmentEnd < ip; });
-        if (fragment != m_moduleFragments.end() && fragment->fragmentStart <= ip && fragment->fragmentEnd >= ip) {
-            data.moduleIndex = fragment->moduleIndex;
+        const auto symbolized = m_pipeline ? m_pipeline->take(ip) : m_symbolizer.symbolize(ip);
 
-            if (auto module = reportModule(*fragment)) {
-                const auto info = module->resolveAddress(ip);
-                data.frame = resolveFrame(info.frame);
-                std::transform(info.inlined.begin(), info.inlined.end(), std::back_inserter(data.inlined),
-                               resolveFrame);
-            }
-        }
+        ResolvedIP data;
+        data.moduleIndex = intern(symbolized.moduleName);
+        data.frame = resolveFrame(symbolized.info.frame);
+        std::transform(symbolized.info.inlined.begin(), symbolized.info.inlined.end(), std::back_inserter(data.inlined),
+                       resolveFrame);
         return data;
     }
 
-    size_t intern(const string& str, const char** internedString = nullptr)
+    size_t intern(const char* data, size_t size)
     {
-        if (str.empty()) {
+        if (!size) {
             return 0;
         }
 
-        const size_t id = m_internedData.size() + 1;
-        auto inserted = m_internedData.insert({str, id});
-        if (internedString) {
-            *internedString = inserted.first->first.data();
-        }
-
-        if (!inserted.second) {
-            return inserted.first->second;
+        const auto interned = m_internedData.intern(data, size);
+        if (interned.inserted) {
+            out.write("s ");
+            out.writeString(data, size);
+            out.write("\n");
         }
+        return interned.id;
+    }
 
-        out.write("s ");
-        out.write(str);
-        out.write("\n");
-        return id;
+    size_t intern(const string& str)
+    {
+        return intern(str.data(), str.size());
     }
 
     void addModule(string fileName, const size_t moduleIndex, const uintptr_t addressStart,
                    const uintptr_t fragmentStart, const uintptr_t fragmentEnd)
     {
-        m_moduleFragments.emplace_back(fileName, addressStart, fragmentStart, fragmentEnd, moduleIndex);
-        m_modulesDirty = true;
+        m_symbolizer.fragments().add(std::move(fileName), moduleIndex, addressStart, fragmentStart, fragmentEnd);
+    }
+
+    /// set the build-id of the module that got added last
+    void setBuildId(const string& buildId)
+    {
+        m_symbolizer.fragments().setBuildId(buildId);
     }
 
     void clearModules()
     {
-        // TODO: optimize this, reuse modules that are still valid
-        m_moduleFragments.clear();
-        m_modulesDirty = true;
+        m_symbolizer.fragments().clear();
     }
 
     size_t addIp(const uintptr_t instructionPointer)
@@ -400,6 +493,17 @@ struct AccumulatedTraceData
             return inserted.first->second;
         }
 
+        if (instructionPointer == TRUNCATION_MARKER) {
+            const auto functionIndex = intern("<truncated backtrace>");
+            out.write("i %zx 0 %zx\n", instructionPointer, functionIndex);
+            return ipId;
+        }
+
+        if (m_deferSymbolization) {
+            out.write("i %zx %zx\n", instructionPointer, writeModule(instructionPointer));
+            return ipId;
+        }
+
         const auto ip = resolve(instructionPointer);
         out.write("i %zx %zx", instructionPointer, ip.moduleIndex);
         if (ip.frame.functionIndex || ip.frame.fileIndex) {
@@ -415,47 +519,150 @@ struct AccumulatedTraceData
         return ipId;
     }
 
+    /**
+     * Symbolize the instruction pointers on @p numThreads threads, while the input gets processed.
+     *
+     * Must be called before the first line got read.
+     */
+    void startPipeline(istream& in, unsigned numThreads)
+    {
+        m_pipeline = make_unique<SymbolizerPipeline>(in, numThreads);
+    }
+
+    bool getLine(LineReader& reader, istream& in)
+    {
+        return m_pipeline ? m_pipeline->getLine(reader) : reader.getLine(in);
+    }
+
+    /**
+     * Only write the module of every instruction pointer, such that heaptrack_symbolize can resolve them later on,
+     * potentially on another host that has the debug information.
+     */
+    void deferSymbolization()
+    {
+        m_deferSymbolization = true;
+    }
+
+    bool isSymbolizationDeferred() const
+    {
+        return m_deferSymbolization;
+    }
+
     LineWriter out;
 
 private:
-    Module* reportModule(const ModuleFragment& module)
+    /**
+     * Find the module that contains @p ip and describe it in a `n` line once, which is all that heaptrack_symbolize
+     * needs to know about it: `n <module index> <address start> <range start> <range end> [build-id]`
+     *
+     * @return the index of the module name, or zero if the module is unknown
+     */
+    size_t writeModule(const uintptr_t ip)
     {
-        if (startsWith(module.fileName, "linux-vdso.so")) {
-            return nullptr;
+        auto& fragments = m_symbolizer.fragments();
+        fragments.update();
+        const auto* fragment = fragments.find(ip);
+        if (!fragment) {
+            return 0;
         }
 
-        auto& ret = m_modules[module.fileName];
-        if (ret.module)
-            return &ret;
+        if (m_writtenModules.insert({fragment->moduleIndex, fragment->addressStart}).second) {
+            const auto range = fragments.moduleRange(*fragment);
+            out.write("n %zx %zx %zx %zx", fragment->moduleIndex, fragment->addressStart, range.first, range.second);
+            if (!fragment->buildId.empty()) {
+                out.write(" ");
+                out.write(fragment->buildId);
+            }
+            out.write("\n");
+        }
+        return fragment->moduleIndex;
+    }
 
-        auto dwflModule = dwfl_addrmodule(m_dwfl, module.addressStart);
-        if (!dwflModule) {
-            dwfl_report_begin_add(m_dwfl);
-            dwflModule = dwfl_report_elf(m_dwfl, module.fileName.c_str(), module.fileName.c_str(), -1,
-                                         module.addressStart, false);
-            dwfl_report_end(m_dwfl, nullptr, nullptr);
+    Symbolizer m_symbolizer;
+    unique_ptr<SymbolizerPipeline> m_pipeline;
 
-            if (!dwflModule) {
-                error_out << "Failed to report module for " << module.fileName << ": " << dwfl_errmsg(dwfl_errno())
-                          << endl;
-                return nullptr;
-            }
+    StringInterner m_internedData;
+    tsl::robin_map<uintptr_t, size_t> m_encounteredIps;
+
+    bool m_deferSymbolization = false;
+    // the module index and start address of the modules that got written out already
+    set<pair<size_t, uintptr_t>> m_writtenModules;
+};
+
+/**
+ * Tracks the pointers that got tied to an arena via heaptrack_report_alloc_batch,
+ * such that an arena reset can release all of them at once.
+ */
+struct Arenas
+{
+    void add(uint64_t arena, uint64_t ptr)
+    {
+        pointerArenas[ptr] = arena;
+        auto& pointers = arenaPointers[arena];
+        pointers.pointers.push_back(ptr);
+        ++pointers.live;
+    }
+
+    void remove(uint64_t ptr)
+    {
+        auto it = pointerArenas.find(ptr);
+        if (it == pointerArenas.end()) {
+            return;
+        }
+        const auto arena = it->second;
+        pointerArenas.erase(it);
+
+        // don't let the pointers of an arena that never gets reset grow without bounds
+        auto& pointers = arenaPointers[arena];
+        --pointers.live;
+        if (pointers.pointers.size() > 64 && pointers.live < pointers.pointers.size() / 2) {
+            takeLive(arena, &pointers.pointers);
+            pointers.live = pointers.pointers.size();
         }
+    }
 
-        ret = Module(module.fileName, module.addressStart, dwflModule, &m_symbolCache);
-        return &ret;
+    /// @return the pointers that are still tied to the @p arena, which is empty afterwards
+    vector<uint64_t> reset(uint64_t arena)
+    {
+        auto it = arenaPointers.find(arena);
+        if (it == arenaPointers.end()) {
+            return {};
+        }
+        auto pointers = std::move(it.value().pointers);
+        arenaPointers.erase(it);
+        takeLive(arena, &pointers);
+        for (auto ptr : pointers) {
+            pointerArenas.erase(ptr);
+        }
+        return pointers;
     }
 
-    vector<ModuleFragment> m_moduleFragments;
-    Dwfl* m_dwfl = nullptr;
-    char* m_debugPath = nullptr;
-    Dwfl_Callbacks m_callbacks;
-    SymbolCache m_symbolCache;
-    bool m_modulesDirty = false;
+    bool empty() const
+    {
+        return pointerArenas.empty();
+    }
 
-    tsl::robin_map<string, size_t> m_internedData;
-    tsl::robin_map<uintptr_t, size_t> m_encounteredIps;
-    tsl::robin_map<string, Module> m_modules;
+private:
+    /// only keep the pointers that are still tied to the arena, they could have been freed and reused since
+    void takeLive(uint64_t arena, vector<uint64_t>* pointers) const
+    {
+        sort(pointers->begin(), pointers->end());
+        pointers->erase(unique(pointers->begin(), pointers->end()), pointers->end());
+        pointers->erase(remove_if(pointers->begin(), pointers->end(),
+                                  [&](uint64_t ptr) {
+                                      auto it = pointerArenas.find(ptr);
+                                      return it == pointerArenas.end() || it->second != arena;
+                                  }),
+                        pointers->end());
+    }
+
+    struct Pointers
+    {
+        vector<uint64_t> pointers;
+        size_t live = 0;
+    };
+    tsl::robin_map<uint64_t, uint64_t> pointerArenas;
+    tsl::robin_map<uint64_t, Pointers> arenaPointers;
 };
 
 struct Stats
@@ -463,6 +670,7 @@ struct Stats
     uint64_t allocations = 0;
     uint64_t leakedAllocations = 0;
     uint64_t temporaryAllocations = 0;
+    uint64_t shortLivedAllocations = 0;
 } c_stats;
 
 void exitHandler()
@@ -470,15 +678,35 @@ void exitHandler()
     fflush(stdout);
     fprintf(stderr,
             "heaptrack stats:\n"
-            "\tallocations:          \t%" PRIu64 "\n"
-            "\tleaked allocations:   \t%" PRIu64 "\n"
-            "\ttemporary allocations:\t%" PRIu64 "\n",
-            c_stats.allocations, c_stats.leakedAllocations, c_stats.temporaryAllocations);
+            "\tallocations:           \t%" PRIu64 "\n"
+            "\tleaked allocations:    \t%" PRIu64 "\n"
+            "\ttemporary allocations: \t%" PRIu64 "\n"
+            "\tshort-lived allocations:\t%" PRIu64 "\n",
+            c_stats.allocations, c_stats.leakedAllocations, c_stats.temporaryAllocations,
+            c_stats.shortLivedAllocations);
 }
 }
 
-int main(int /*argc*/, char** /*argv*/)
+int main(int argc, char** argv)
 {
+    string outputPath;
+    CompressedOutput::Options outputOptions;
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--output") && hasValue) {
+            outputPath = argv[++i];
+        } else if (!strcmp(argv[i], "--compression-level") && hasValue) {
+            outputOptions.level = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--compression-threads") && hasValue) {
+            outputOptions.threads = std::max(atoi(argv[++i]), 0);
+        } else {
+            cerr << "usage: " << argv[0] << " [--output FILE] [--compression-level N] [--compression-threads N]\n\n"
+                 << "Interprets the raw heaptrack data from stdin and writes the result to stdout, or to FILE.\n"
+                 << "FILE gets compressed when it ends with .gz or .zst, zstd can use additional threads for that.\n";
+            return 1;
+        }
+    }
+
     [] {
         // NOTE: we disable debuginfod by default as it can otherwise lead to
         //       nasty delays otherwise which are highly unexpected to users
@@ -499,17 +727,48 @@ int main(int /*argc*/, char** /*argv*/)
         }
     }();
 
-    // optimize: we only have a single thread
+    // optimize: only the main thread writes to stdout, and only the main thread or the reader thread of the
+    // symbolizer pipeline read from stdin
     ios_base::sync_with_stdio(false);
 #ifdef __linux__
     __fsetlocking(stdout, FSETLOCKING_BYCALLER);
     __fsetlocking(stdin, FSETLOCKING_BYCALLER);
 #endif
 
+    // compress the output in-process, instead of piping it through another process
+    unique_ptr<LineWriter::Sink> output;
+    if (!outputPath.empty()) {
+        string error;
+        output = CompressedOutput::open(outputPath, outputOptions, &error);
+        if (!output) {
+            error_out << error << endl;
+            return 1;
+        }
+    }
+
     // output data at end, even when we get terminated
     std::atexit(exitHandler);
 
     AccumulatedTraceData data;
+    if (output) {
+        data.out.setSink(std::move(output));
+    }
+
+    // symbolization can be deferred to heaptrack_symbolize, to keep the overhead on the recording host minimal
+    if (auto defer = getenv("HEAPTRACK_DEFER_SYMBOLIZATION")) {
+        if (atoi(defer)) {
+            data.deferSymbolization();
+        }
+    }
+
+    // symbolize in parallel by default, as that is often the bottleneck for applications with lots of debug info
+    unsigned numThreads = std::min(thread::hardware_concurrency(), 4u);
+    if (auto threads = getenv("HEAPTRACK_INTERPRET_THREADS")) {
+        numThreads = std::max(atoi(threads), 0);
+    }
+    if (numThreads > 1 && !data.isSymbolizationDeferred()) {
+        data.startPipeline(cin, numThreads);
+    }
 
     LineReader reader;
 
@@ -517,9 +776,21 @@ int main(int /*argc*/, char** /*argv*/)
 
     PointerMap ptrToIndex;
     uint64_t lastPtr = 0;
+    RecentAllocations recentAllocations;
     AllocationInfoSet allocationInfos;
+    Arenas arenas;
+    // the tag of the following allocations
+    uint32_t tag = 0;
+
+    // the fragmentation analysis is opt-in, as it requires more memory and time
+    unique_ptr<Fragmentation> fragmentation;
+    if (auto enable = getenv("HEAPTRACK_FRAGMENTATION")) {
+        if (atoi(enable)) {
+            fragmentation = make_unique<Fragmentation>();
+        }
+    }
 
-    while (reader.getLine(cin)) {
+    while (data.getLine(reader, cin)) {
         if (reader.mode() == 'v') {
             unsigned int heaptrackVersion = 0;
             reader >> heaptrackVersion;
@@ -531,7 +802,8 @@ int main(int /*argc*/, char** /*argv*/)
             data.out.write("%s\n", reader.line().c_str());
         } else if (reader.mode() == 'x') {
             if (!exe.empty()) {
-                error_out << "received duplicate exe event - child process tracking is not yet supported" << endl;
+                error_out << "received duplicate exe event - use --follow-fork to trace child processes separately"
+                          << endl;
                 return 1;
             }
             reader >> exe;
@@ -544,8 +816,7 @@ int main(int /*argc*/, char** /*argv*/)
                 if (fileName == "x") {
                     fileName = exe;
                 }
-                const char* internedString = nullptr;
-                const auto moduleIndex = data.intern(fileName, &internedString);
+                const auto moduleIndex = data.intern(fileName);
                 uintptr_t addressStart = 0;
                 if (!(reader >> addressStart)) {
                     error_out << "failed to parse line: " << reader.line() << endl;
@@ -558,6 +829,10 @@ int main(int /*argc*/, char** /*argv*/)
                                    addressStart + vAddr + memSize);
                 }
             }
+        } else if (reader.mode() == 'B') {
+            string buildId;
+            reader >> buildId;
+            data.setBuildId(buildId);
         } else if (reader.mode() == 't') {
             uintptr_t instructionPointer = 0;
             size_t parentIndex = 0;
@@ -581,11 +856,27 @@ int main(int /*argc*/, char** /*argv*/)
             }
 
             AllocationInfoIndex index;
-            if (allocationInfos.add(size, traceId, &index)) {
-                data.out.writeHexLine('a', size, traceId.index);
+            if (allocationInfos.add(size, traceId, &index, tag)) {
+                if (tag) {
+                    data.out.writeHexLine('a', size, traceId.index, tag);
+                } else {
+                    data.out.writeHexLine('a', size, traceId.index);
+                }
             }
             ptrToIndex.addPointer(ptr, index);
+            if (fragmentation) {
+                fragmentation->addAllocation(ptr, size);
+            }
+            // allocations reported in a batch can be tied to an arena
+            uint64_t arena = 0;
+            if (!arenas.empty()) {
+                arenas.remove(ptr);
+            }
+            if (reader >> arena) {
+                arenas.add(arena, ptr);
+            }
             lastPtr = ptr;
+            recentAllocations.add(ptr);
             data.out.writeHexLine('+', index.index);
         } else if (reader.mode() == '-') {
             uint64_t ptr = 0;
@@ -595,19 +886,100 @@ int main(int /*argc*/, char** /*argv*/)
             }
             bool temporary = lastPtr == ptr;
             lastPtr = 0;
+            bool shortLived = recentAllocations.take(ptr);
             auto allocation = ptrToIndex.takePointer(ptr);
             if (!allocation.second) {
                 continue;
             }
-            data.out.writeHexLine('-', allocation.first.index);
+            if (fragmentation) {
+                fragmentation->removeAllocation(ptr);
+            }
+            if (!arenas.empty()) {
+                arenas.remove(ptr);
+            }
+            // the analyzer only sees allocation info indices, which cannot tell apart allocations
+            // of the same size and trace, so pass on our pointer based classification
+            // the flag is only written for short-lived allocations, a missing flag is read as 0
+            if (shortLived) {
+                data.out.writeHexLine('-', allocation.first.index, 1u);
+            } else {
+                data.out.writeHexLine('-', allocation.first.index);
+            }
             if (temporary) {
                 ++c_stats.temporaryAllocations;
             }
+            if (shortLived) {
+                ++c_stats.shortLivedAllocations;
+            }
             --c_stats.leakedAllocations;
-        } else {
+        } else if (reader.mode() == 'r') {
+            // an arena reset releases all allocations tied to it
+            uint64_t arena = 0;
+            if (!(reader >> arena)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            lastPtr = 0;
+            for (auto ptr : arenas.reset(arena)) {
+                auto allocation = ptrToIndex.takePointer(ptr);
+                if (!allocation.second) {
+                    continue;
+                }
+                recentAllocations.take(ptr);
+                if (fragmentation) {
+                    fragmentation->removeAllocation(ptr);
+                }
+                data.out.writeHexLine('-', allocation.first.index);
+                --c_stats.leakedAllocations;
+            }
+        } else if (reader.mode() == 'g') {
+            // the tag changed, it gets attached to the allocation infos instead
+            if (!(reader >> tag)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                tag = 0;
+            }
+        } else if (reader.mode() == 'G') {
+            // name of a tag, intern it
+            uint32_t namedTag = 0;
+            string name;
+            if (!(reader >> namedTag) || !(reader >> name)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            data.out.writeHexLine('G', namedTag, data.intern(name));
+        } else if (reader.mode() == 'c') {
+            data.out.write("%s\n", reader.line().c_str());
+            if (fragmentation) {
+                fragmentation->writeTimeStamp(data.out);
+            }
+        } else if (reader.mode() == '!' || reader.mode() == '>') {
+            // marker or start of a phase, intern its name
+            string name;
+            if (!(reader >> name)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            data.out.writeHexLine(reader.mode(), data.intern(name));
+        } else if (reader.mode() == 'I') {
             data.out.write("%s\n", reader.line().c_str());
+            uint64_t pageSize = 0;
+            if (fragmentation && (reader >> pageSize)) {
+                fragmentation->setPageSize(pageSize);
+            }
+        } else {
+            // most of these are the allocations and deallocations, copy them without materializing the line
+            data.out.write("%.*s\n", static_cast<int>(reader.lineLength()), reader.lineData());
         }
     }
 
+    if (fragmentation) {
+        fragmentation->writeFinalLayout(data.out);
+    }
+
+    if (!data.finish()) {
+        error_out << "failed to write the output completely" << endl;
+        return 1;
+    }
+
     return 0;
 }
@@ -0,0 +1,368 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/**
+ * @file heaptrack_symbolize.cpp
+ *
+ * @brief Resolve the instruction pointers of data that got interpreted with HEAPTRACK_DEFER_SYMBOLIZATION=1.
+ *
+ * The deferred data only has the module of every instruction pointer, and a `n` line which describes every module
+ * that is referenced. All instruction pointers get resolved in one batch, sorted by module and address, and the
+ * `i` and `s` lines get rewritten. As new strings get written, the indices of all strings can change, such that
+ * all lines that reference strings get rewritten too. All other lines are copied verbatim.
+ *
+ * The input has to be read twice, stdin gets copied into a temporary file for that.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "stringinterner.h"
+#include "symbolizer.h"
+
+#include "util/linereader.h"
+#include "util/linewriter.h"
+
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+struct ModuleInstance
+{
+    size_t moduleIndex = 0;
+    uintptr_t addressStart = 0;
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+    string buildId;
+};
+
+struct UnresolvedIP
+{
+    uintptr_t ip;
+    size_t instance;
+};
+
+struct InputFile
+{
+    ~InputFile()
+    {
+        if (!tmpPath.empty()) {
+            unlink(tmpPath.c_str());
+        }
+    }
+
+    /// open @p path, or a copy of stdin if it is empty
+    bool open(const string& path)
+    {
+        if (!path.empty()) {
+            in.open(path);
+            return in.is_open();
+        }
+
+        char pathTemplate[] = "/tmp/heaptrack_symbolize.XXXXXX";
+        const auto fd = mkstemp(pathTemplate);
+        if (fd < 0) {
+            return false;
+        }
+        close(fd);
+        tmpPath = pathTemplate;
+        {
+            ofstream copy(tmpPath);
+            // inserting an empty stream buffer sets the failbit, but an empty input is no error
+            if (cin.peek() != ifstream::traits_type::eof()) {
+                copy << cin.rdbuf();
+            }
+            if (!copy || cin.bad()) {
+                return false;
+            }
+        }
+        in.open(tmpPath);
+        return in.is_open();
+    }
+
+    bool rewind()
+    {
+        in.clear();
+        in.seekg(0);
+        return static_cast<bool>(in);
+    }
+
+    ifstream in;
+    string tmpPath;
+};
+
+/// handle the version line, which has to be passed through in any case
+void readVersion(LineReader& reader)
+{
+    unsigned int heaptrackVersion = 0;
+    reader >> heaptrackVersion;
+    unsigned int fileVersion = 0;
+    reader >> fileVersion;
+    if (fileVersion >= 3) {
+        reader.setExpectedSizedStrings(true);
+    }
+}
+
+/**
+ * Read all fields of an `i` line: the instruction pointer, the module and then the function, file and line of
+ * all frames, if known.
+ */
+void readIP(LineReader& reader, vector<uint64_t>* fields)
+{
+    fields->clear();
+    uint64_t field = 0;
+    while (reader >> field) {
+        fields->push_back(field);
+    }
+}
+
+/// @return true when the instruction pointer still needs to be symbolized, i.e. only its module is known
+bool isUnresolved(const vector<uint64_t>& fields)
+{
+    // the function is known already e.g. for truncated backtraces
+    return fields.size() == 2 && fields[1];
+}
+
+class Symbolization
+{
+public:
+    /**
+     * Find the modules and all instruction pointers in them that need to be symbolized.
+     */
+    bool scan(istream& in)
+    {
+        LineReader reader;
+        tsl::robin_map<size_t, vector<size_t>> moduleInstances;
+        vector<uint64_t> fields;
+        while (reader.getLine(in)) {
+            if (reader.mode() == 'v') {
+                readVersion(reader);
+            } else if (reader.mode() == 's') {
+                string str;
+                reader >> str;
+                m_strings.push_back(std::move(str));
+            } else if (reader.mode() == 'n') {
+                ModuleInstance instance;
+                if (!(reader >> instance.moduleIndex) || !(reader >> instance.addressStart)
+                    || !(reader >> instance.start) || !(reader >> instance.end)) {
+                    cerr << "failed to parse line: " << reader.line() << endl;
+                    return false;
+                }
+                reader >> instance.buildId;
+                moduleInstances[instance.moduleIndex].push_back(m_instances.size());
+                m_instances.push_back(std::move(instance));
+            } else if (reader.mode() == 'i') {
+                readIP(reader, &fields);
+                if (!isUnresolved(fields)) {
+                    continue;
+                }
+                const auto ip = fields[0];
+                const auto moduleIndex = fields[1];
+                // the module gets described before the first instruction pointer in it, but it could have been
+                // loaded multiple times, with the same module index, at different addresses since
+                size_t instance = m_instances.size();
+                auto it = moduleInstances.find(moduleIndex);
+                if (it != moduleInstances.end()) {
+                    auto candidate = find_if(it->second.rbegin(), it->second.rend(), [&](size_t index) {
+                        return m_instances[index].start <= ip && ip <= m_instances[index].end;
+                    });
+                    if (candidate != it->second.rend()) {
+                        instance = *candidate;
+                    }
+                }
+                m_ips.push_back({ip, instance});
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Resolve all instruction pointers, grouped by their module and sorted by address,
+     * such that every module gets loaded once and its debug information gets visited in order.
+     */
+    void resolve()
+    {
+        vector<size_t> order(m_ips.size());
+        iota(order.begin(), order.end(), 0);
+        order.erase(remove_if(order.begin(), order.end(),
+                              [this](size_t index) { return m_ips[index].instance == m_instances.size(); }),
+                    order.end());
+        sort(order.begin(), order.end(), [this](size_t lhs, size_t rhs) {
+            const auto& lhsInstance = m_instances[m_ips[lhs].instance];
+            const auto& rhsInstance = m_instances[m_ips[rhs].instance];
+            return tie(moduleName(lhsInstance), lhsInstance.addressStart, m_ips[lhs].ip)
+                < tie(moduleName(rhsInstance), rhsInstance.addressStart, m_ips[rhs].ip);
+        });
+
+        m_resolved.resize(m_ips.size());
+        size_t currentInstance = m_instances.size();
+        for (auto index : order) {
+            const auto& ip = m_ips[index];
+            if (ip.instance != currentInstance) {
+                // only one module is reported at any time, as modules from different times could overlap
+                currentInstance = ip.instance;
+                const auto& instance = m_instances[currentInstance];
+                auto& fragments = m_symbolizer.fragments();
+                fragments.clear();
+                fragments.add(moduleName(instance), instance.moduleIndex, instance.addressStart, instance.start,
+                              instance.end);
+                fragments.setBuildId(instance.buildId);
+            }
+            m_resolved[index] = m_symbolizer.symbolize(ip.ip).info;
+        }
+    }
+
+    /**
+     * Copy the data from @p in, with the resolved instruction pointers.
+     */
+    void write(istream& in, LineWriter& out)
+    {
+        LineReader reader;
+        // maps the indices of the input strings to the output ones
+        vector<size_t> stringIndices = {0};
+        StringInterner internedStrings;
+        auto intern = [&](const string& str) -> size_t {
+            if (str.empty()) {
+                return 0;
+            }
+            const auto interned = internedStrings.intern(str);
+            if (interned.inserted) {
+                out.write("s ");
+                out.write(str);
+                out.write("\n");
+            }
+            return interned.id;
+        };
+        auto mapString = [&](size_t index) -> size_t {
+            return index < stringIndices.size() ? stringIndices[index] : 0;
+        };
+
+        vector<uint64_t> fields;
+        size_t ipIndex = 0;
+        while (reader.getLine(in)) {
+            if (reader.mode() == 'v') {
+                readVersion(reader);
+                out.write("%s\n", reader.line().c_str());
+            } else if (reader.mode() == 's') {
+                string str;
+                reader >> str;
+                // strings that got written for the symbols already are not written again
+                stringIndices.push_back(intern(str));
+            } else if (reader.mode() == 'n') {
+                continue;
+            } else if (reader.mode() == 'i') {
+                readIP(reader, &fields);
+                if (fields.size() < 2) {
+                    cerr << "failed to parse line: " << reader.line() << endl;
+                    continue;
+                }
+                if (isUnresolved(fields)) {
+                    // the strings have to be written before the line that references them
+                    const auto& info = m_resolved[ipIndex++];
+                    fields.push_back(intern(info.frame.function));
+                    fields.push_back(intern(info.frame.file));
+                    fields.push_back(static_cast<uint32_t>(info.frame.line));
+                    for (const auto& inlined : info.inlined) {
+                        fields.push_back(intern(inlined.function));
+                        fields.push_back(intern(inlined.file));
+                        fields.push_back(static_cast<uint32_t>(inlined.line));
+                    }
+                    // like heaptrack_interpret, omit the unknown parts of the frames
+                    if (!fields[3]) {
+                        fields.resize(fields[2] ? 3 : 2);
+                    }
+                } else {
+                    // resolved already, only the string indices of the frames change, but not their lines
+                    for (size_t i = 2; i < fields.size(); ++i) {
+                        if ((i - 2) % 3 != 2) {
+                            fields[i] = mapString(fields[i]);
+                        }
+                    }
+                }
+                out.write("i %zx %zx", fields[0], mapString(fields[1]));
+                for (size_t i = 2; i < fields.size(); ++i) {
+                    out.write(" %zx", fields[i]);
+                }
+                out.write("\n");
+            } else if (reader.mode() == 'G') {
+                uint32_t tag = 0;
+                size_t name = 0;
+                reader >> tag;
+                reader >> name;
+                out.writeHexLine('G', tag, mapString(name));
+            } else if (reader.mode() == '!' || reader.mode() == '>') {
+                size_t name = 0;
+                reader >> name;
+                out.writeHexLine(reader.mode(), mapString(name));
+            } else if (reader.mode() == '#' && reader.line().compare(0, 10, "# strings:") == 0) {
+                out.write("# strings: %zu\n", internedStrings.size());
+            } else {
+                out.write("%s\n", reader.line().c_str());
+            }
+        }
+        out.flush();
+    }
+
+private:
+    const string& moduleName(const ModuleInstance& instance) const
+    {
+        static const string empty;
+        return instance.moduleIndex && instance.moduleIndex <= m_strings.size() ? m_strings[instance.moduleIndex - 1]
+                                                                                   : empty;
+    }
+
+    vector<string> m_strings;
+    vector<ModuleInstance> m_instances;
+    // the instruction pointers to symbolize, in the order of the input
+    vector<UnresolvedIP> m_ips;
+    vector<AddressInformation> m_resolved;
+    Symbolizer m_symbolizer;
+};
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 2 || (argc == 2 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")))) {
+        cerr << "usage: " << argv[0] << " [FILE]\n\n"
+             << "Resolves the instruction pointers of heaptrack data that got recorded with\n"
+             << "--defer-symbolization and writes the result to stdout. The data is read\n"
+             << "uncompressed from FILE, or from stdin if no FILE is given, e.g.:\n\n"
+             << "  zstd -dc heaptrack.foo.123.unsymbolized.zst | " << argv[0] << " | zstd -c > heaptrack.foo.123.zst\n";
+        return 1;
+    }
+
+    // optimize: we only have a single thread
+    ios_base::sync_with_stdio(false);
+
+    InputFile input;
+    if (!input.open(argc == 2 ? argv[1] : string())) {
+        cerr << "failed to open the input: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    Symbolization symbolization;
+    if (!symbolization.scan(input.in)) {
+        return 1;
+    }
+    symbolization.resolve();
+
+    if (!input.rewind()) {
+        cerr << "failed to read the input again" << endl;
+        return 1;
+    }
+    LineWriter out(fileno(stdout));
+    symbolization.write(input.in, out);
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef STRINGINTERNER_H
+#define STRINGINTERNER_H
+
+#include <tsl/robin_map.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Maps strings to sequential ids, starting at one.
+ *
+ * The strings get copied into large blocks of an append-only arena, instead of allocating every one of them
+ * separately. The hash map only stores views into the arena along with their hash, such that looking up a string
+ * hashes it once and never allocates, which is the common case for the function and file names of hot code.
+ */
+class StringInterner
+{
+public:
+    enum
+    {
+        // the size of the arena blocks, strings larger than a quarter of it get allocated separately
+        BLOCK_SIZE = 64 * 1024
+    };
+
+    struct Result
+    {
+        size_t id;
+        // true when the string was not interned before
+        bool inserted;
+    };
+
+    StringInterner()
+    {
+        m_ids.reserve(4096);
+    }
+
+    Result intern(const char* data, size_t size)
+    {
+        const Key key = {data, size, hash(data, size)};
+        auto it = m_ids.find(key);
+        if (it != m_ids.end()) {
+            return {it->second, false};
+        }
+
+        const Key stored = {store(data, size), size, key.hash};
+        const auto id = m_ids.size() + 1;
+        m_ids.insert({stored, id});
+        return {id, true};
+    }
+
+    Result intern(const std::string& str)
+    {
+        return intern(str.data(), str.size());
+    }
+
+    size_t size() const
+    {
+        return m_ids.size();
+    }
+
+private:
+    struct Key
+    {
+        const char* data;
+        size_t size;
+        size_t hash;
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            return key.hash;
+        }
+    };
+
+    struct KeyEqual
+    {
+        bool operator()(const Key& lhs, const Key& rhs) const
+        {
+            return lhs.hash == rhs.hash && lhs.size == rhs.size && memcmp(lhs.data, rhs.data, lhs.size) == 0;
+        }
+    };
+
+    static size_t hash(const char* data, size_t size)
+    {
+        // multiplicative hashing of whole words, mixed with the murmur3 finalizer for the low bits that get used
+        const uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+        uint64_t hash = size * multiplier;
+        for (; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, data, sizeof(word));
+            hash = (hash ^ word) * multiplier;
+            hash ^= hash >> 32;
+        }
+        if (size) {
+            uint64_t word = 0;
+            memcpy(&word, data, size);
+            hash = (hash ^ word) * multiplier;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    /// @return a copy of the string in the arena, the blocks never move
+    const char* store(const char* data, size_t size)
+    {
+        if (size > BLOCK_SIZE / 4) {
+            // large strings get their own allocation, to not waste the remainder of the current block
+            m_largeStrings.emplace_back(new char[size]);
+            memcpy(m_largeStrings.back().get(), data, size);
+            return m_largeStrings.back().get();
+        }
+        if (m_blocks.empty() || m_blockUsed + size > BLOCK_SIZE) {
+            m_blocks.emplace_back(new char[BLOCK_SIZE]);
+            m_blockUsed = 0;
+        }
+        auto* ret = m_blocks.back().get() + m_blockUsed;
+        memcpy(ret, data, size);
+        m_blockUsed += size;
+        return ret;
+    }
+
+    tsl::robin_map<Key, size_t, KeyHash, KeyEqual> m_ids;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    std::vector<std::unique_ptr<char[]>> m_largeStrings;
+    size_t m_blockUsed = 0;
+};
+
+#endif // STRINGINTERNER_H
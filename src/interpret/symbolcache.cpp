@@ -33,7 +33,7 @@ bool SymbolCache::hasSymbols(const std::string& filePath) const
     return m_symbolCache.contains(filePath);
 }
 
-SymbolCache::SymbolCacheEntry SymbolCache::findSymbol(const std::string& filePath, uint64_t relAddr)
+const SymbolCache::SymbolCacheEntry* SymbolCache::findSymbol(const std::string& filePath, uint64_t relAddr)
 {
     auto& symbols = m_symbolCache[filePath];
     auto it = std::lower_bound(symbols.begin(), symbols.end(), relAddr);
@@ -45,20 +45,20 @@ SymbolCache::SymbolCacheEntry SymbolCache::findSymbol(const std::string& filePat
             entry.symname = demangle(entry.symname);
             entry.demangled = true;
         }
-        return entry;
+        return &entry;
     };
 
     if (it != symbols.end() && it->offset == relAddr)
         return lazyDemangle(*it);
     if (it == symbols.begin())
-        return {};
+        return nullptr;
 
     --it;
 
     if (it->offset <= relAddr && (it->offset + it->size > relAddr || (it->size == 0))) {
         return lazyDemangle(*it);
     }
-    return {};
+    return nullptr;
 }
 
 void SymbolCache::setSymbols(const std::string& filePath, Symbols symbols)
@@ -49,7 +49,8 @@ public:
     void setSymbols(const std::string& filePath, Symbols symbols);
     /// find the symbol that encompasses @p relAddr in @p filePath
     /// if the found symbol wasn't yet demangled, it will be demangled now
-    SymbolCacheEntry findSymbol(const std::string& filePath, uint64_t relAddr);
+    /// @return the symbol, valid until the next call to setSymbols, or nullptr if none was found
+    const SymbolCacheEntry* findSymbol(const std::string& filePath, uint64_t relAddr);
 
 private:
     tsl::robin_map<std::string, Symbols> m_symbolCache;
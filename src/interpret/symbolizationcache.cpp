@@ -0,0 +1,342 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "symbolizationcache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char MAGIC[8] = {'H', 'T', 'S', 'Y', 'M', 'C', 'A', 'C'};
+// increment whenever the format or the way addresses get symbolized changes
+const uint32_t VERSION = 1;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t numEntries;
+    uint32_t numFrames;
+    uint32_t stringsSize;
+};
+static_assert(sizeof(Header) == 24, "unexpected padding in the header");
+
+struct Entry
+{
+    uint64_t address;
+    uint32_t firstFrame;
+    uint32_t numFrames;
+};
+static_assert(sizeof(Entry) == 16, "unexpected padding in the entries");
+
+struct FrameData
+{
+    uint32_t function;
+    uint32_t file;
+    int32_t line;
+};
+static_assert(sizeof(FrameData) == 12, "unexpected padding in the frames");
+
+bool isHex(const std::string& str)
+{
+    return !str.empty() && std::all_of(str.begin(), str.end(), [](char c) {
+        return ('0' <= c && c <= '9') || ('a' <= c && c <= 'f');
+    });
+}
+
+void createDirectories(const std::string& path)
+{
+    for (auto pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+        mkdir(path.substr(0, pos).c_str(), 0755);
+    }
+    mkdir(path.c_str(), 0755);
+}
+
+/// an exclusive lock on a file next to the cache file, held while merging new entries into it
+class LockFile
+{
+public:
+    explicit LockFile(const std::string& path)
+        : m_fd(open(path.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644))
+    {
+        while (m_fd != -1 && flock(m_fd, LOCK_EX) != 0 && errno == EINTR) {
+        }
+    }
+
+    ~LockFile()
+    {
+        if (m_fd != -1) {
+            close(m_fd);
+        }
+    }
+
+private:
+    int m_fd;
+};
+}
+
+struct SymbolizationCache::File
+{
+    ~File()
+    {
+        if (data) {
+            munmap(data, size);
+        }
+    }
+
+    void load(const std::string& path)
+    {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) == 0 && static_cast<size_t>(fileStat.st_size) >= sizeof(Header)) {
+            size = fileStat.st_size;
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                data = nullptr;
+            }
+        }
+        close(fd);
+
+        if (data && !validate()) {
+            fprintf(stderr, "WARNING: ignoring invalid symbolization cache file %s\n", path.c_str());
+            munmap(data, size);
+            data = nullptr;
+        }
+    }
+
+    bool validate()
+    {
+        const auto* bytes = static_cast<const char*>(data);
+        header = reinterpret_cast<const Header*>(bytes);
+        if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION) {
+            return false;
+        }
+        const auto entriesSize = static_cast<size_t>(header->numEntries) * sizeof(Entry);
+        const auto framesSize = static_cast<size_t>(header->numFrames) * sizeof(FrameData);
+        if (size != sizeof(Header) + entriesSize + framesSize + header->stringsSize || !header->stringsSize) {
+            return false;
+        }
+        entries = reinterpret_cast<const Entry*>(bytes + sizeof(Header));
+        frames = reinterpret_cast<const FrameData*>(bytes + sizeof(Header) + entriesSize);
+        strings = bytes + sizeof(Header) + entriesSize + framesSize;
+        return strings[header->stringsSize - 1] == '\0';
+    }
+
+    const Entry* findEntry(uint64_t address) const
+    {
+        if (!data) {
+            return nullptr;
+        }
+        const auto* end = entries + header->numEntries;
+        auto it = std::lower_bound(entries, end, address,
+                                   [](const Entry& entry, uint64_t address) { return entry.address < address; });
+        if (it == end || it->address != address) {
+            return nullptr;
+        }
+        return it;
+    }
+
+    bool readFrames(const Entry& entry, Frames* ret) const
+    {
+        if (entry.firstFrame > header->numFrames || entry.numFrames > header->numFrames - entry.firstFrame) {
+            return false;
+        }
+        ret->clear();
+        ret->reserve(entry.numFrames);
+        for (uint32_t i = 0; i < entry.numFrames; ++i) {
+            const auto& frame = frames[entry.firstFrame + i];
+            if (frame.function >= header->stringsSize || frame.file >= header->stringsSize) {
+                return false;
+            }
+            ret->push_back({strings + frame.function, strings + frame.file, frame.line});
+        }
+        return true;
+    }
+
+    void* data = nullptr;
+    size_t size = 0;
+    const Header* header = nullptr;
+    const Entry* entries = nullptr;
+    const FrameData* frames = nullptr;
+    const char* strings = nullptr;
+
+    // the entries that were not found in the file, they get written when the cache gets destroyed
+    tsl::robin_map<uint64_t, Frames> newEntries;
+};
+
+SymbolizationCache::SymbolizationCache(std::string directory)
+    : m_directory(std::move(directory))
+{
+}
+
+SymbolizationCache::~SymbolizationCache()
+{
+    for (const auto& file : m_files) {
+        if (!file.second->newEntries.empty()) {
+            write(file.first, *file.second);
+        }
+    }
+}
+
+std::shared_ptr<SymbolizationCache> SymbolizationCache::fromConfiguration()
+{
+    auto directory = configuredDirectory();
+    if (directory.empty()) {
+        return {};
+    }
+    return std::make_shared<SymbolizationCache>(std::move(directory));
+}
+
+std::string SymbolizationCache::configuredDirectory()
+{
+    if (auto directory = getenv("HEAPTRACK_SYMBOL_CACHE_DIR")) {
+        if (directory[0]) {
+            return directory;
+        }
+    }
+
+    auto enable = getenv("HEAPTRACK_SYMBOL_CACHE");
+    if (!enable || !atoi(enable)) {
+        return {};
+    }
+
+    if (auto cacheHome = getenv("XDG_CACHE_HOME")) {
+        if (cacheHome[0] == '/') {
+            return std::string(cacheHome) + "/heaptrack/symbols";
+        }
+    }
+    if (auto home = getenv("HOME")) {
+        if (home[0] == '/') {
+            return std::string(home) + "/.cache/heaptrack/symbols";
+        }
+    }
+    return {};
+}
+
+bool SymbolizationCache::find(const std::string& buildId, uint64_t address, Frames* frames)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto* cacheFile = file(buildId);
+    if (!cacheFile) {
+        return false;
+    }
+
+    auto it = cacheFile->newEntries.find(address);
+    if (it != cacheFile->newEntries.end()) {
+        *frames = it->second;
+        return true;
+    }
+
+    auto* entry = cacheFile->findEntry(address);
+    return entry && cacheFile->readFrames(*entry, frames);
+}
+
+void SymbolizationCache::insert(const std::string& buildId, uint64_t address, Frames frames)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (auto* cacheFile = file(buildId)) {
+        cacheFile->newEntries[address] = std::move(frames);
+    }
+}
+
+SymbolizationCache::File* SymbolizationCache::file(const std::string& buildId)
+{
+    // the build-id is read from the input, don't let it escape the cache directory
+    if (!isHex(buildId)) {
+        return nullptr;
+    }
+
+    auto& ret = m_files[buildId];
+    if (!ret) {
+        ret = std::make_unique<File>();
+        ret->load(m_directory + '/' + buildId);
+    }
+    return ret.get();
+}
+
+void SymbolizationCache::write(const std::string& buildId, const File& file) const
+{
+    createDirectories(m_directory);
+    const auto path = m_directory + '/' + buildId;
+
+    // another process may have updated the file since we loaded it, merge into its latest version
+    LockFile lock(path + ".lock");
+    File current;
+    current.load(path);
+
+    std::vector<std::pair<uint64_t, Frames>> entries;
+    entries.reserve(file.newEntries.size() + (current.data ? current.header->numEntries : 0));
+    for (const auto& entry : file.newEntries) {
+        entries.push_back(entry);
+    }
+    for (uint32_t i = 0; current.data && i < current.header->numEntries; ++i) {
+        const auto& entry = current.entries[i];
+        Frames frames;
+        if (!file.newEntries.contains(entry.address) && current.readFrames(entry, &frames)) {
+            entries.emplace_back(entry.address, std::move(frames));
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const std::pair<uint64_t, Frames>& lhs, const std::pair<uint64_t, Frames>& rhs) {
+                  return lhs.first < rhs.first;
+              });
+
+    std::vector<Entry> entryData;
+    entryData.reserve(entries.size());
+    std::vector<FrameData> frameData;
+    frameData.reserve(entries.size());
+    std::string strings(1, '\0');
+    tsl::robin_map<std::string, uint32_t> stringOffsets;
+    stringOffsets[{}] = 0;
+    auto intern = [&](const std::string& str) {
+        auto inserted = stringOffsets.insert({str, static_cast<uint32_t>(strings.size())});
+        if (inserted.second) {
+            strings.append(str.c_str(), str.size() + 1);
+        }
+        return inserted.first->second;
+    };
+    for (const auto& entry : entries) {
+        entryData.push_back({entry.first, static_cast<uint32_t>(frameData.size()),
+                             static_cast<uint32_t>(entry.second.size())});
+        for (const auto& frame : entry.second) {
+            frameData.push_back({intern(frame.function), intern(frame.file), frame.line});
+        }
+    }
+
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.numEntries = entryData.size();
+    header.numFrames = frameData.size();
+    header.stringsSize = strings.size();
+
+    // write into a temporary file first, the file could be mapped by another process concurrently
+    const auto tmpPath = path + ".tmp." + std::to_string(getpid());
+    auto* out = fopen(tmpPath.c_str(), "wbe");
+    bool success = out && fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(entryData.data(), sizeof(Entry), entryData.size(), out) == entryData.size()
+        && fwrite(frameData.data(), sizeof(FrameData), frameData.size(), out) == frameData.size()
+        && fwrite(strings.data(), 1, strings.size(), out) == strings.size();
+    if (out) {
+        success = fclose(out) == 0 && success;
+    }
+    if (!success || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "WARNING: failed to write symbolization cache file %s: %s\n", path.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+    }
+}
@@ -0,0 +1,82 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef SYMBOLIZATIONCACHE_H
+#define SYMBOLIZATIONCACHE_H
+
+#include <tsl/robin_map.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Persists the symbolized addresses of modules with a GNU build-id across runs of heaptrack_interpret.
+ *
+ * Every module gets a file named after its build-id in the cache directory, which maps addresses relative
+ * to the start of the module to their frames. When all addresses of a module are found in there, the module
+ * doesn't have to be loaded at all, which saves the DWARF work for unchanged libraries.
+ *
+ * The files get mapped into memory and are looked up via binary search:
+ *
+ * - a header with a magic, the version of the format and the counts of the following arrays
+ * - the entries, sorted by address: `<address> <index of the first frame> <number of frames>`
+ * - the frames: `<function string offset> <file string offset> <line>`
+ * - the zero terminated strings, the empty string is at offset zero
+ *
+ * New entries are kept in memory and get merged into the files when the cache gets destroyed. The files
+ * get replaced atomically, such that concurrent runs never read partially written files. The merge happens
+ * under a lock file and takes the latest version of the file into account, such that concurrent runs don't
+ * drop each other's entries.
+ *
+ * The cache is thread safe, such that all symbolizers of a process can share it.
+ */
+class SymbolizationCache
+{
+public:
+    struct Frame
+    {
+        std::string function;
+        std::string file;
+        int line = 0;
+    };
+    /// the frame of an address, followed by the frames it got inlined into, if any
+    using Frames = std::vector<Frame>;
+
+    explicit SymbolizationCache(std::string directory);
+    ~SymbolizationCache();
+
+    SymbolizationCache(const SymbolizationCache&) = delete;
+    SymbolizationCache& operator=(const SymbolizationCache&) = delete;
+
+    /**
+     * @return the directory configured via HEAPTRACK_SYMBOL_CACHE and HEAPTRACK_SYMBOL_CACHE_DIR,
+     *         or an empty string when the cache is disabled
+     */
+    static std::string configuredDirectory();
+
+    /// @return a cache in the configured directory, or nullptr when the cache is disabled
+    static std::shared_ptr<SymbolizationCache> fromConfiguration();
+
+    /// find the frames of the @p address relative to the start of the module with @p buildId
+    bool find(const std::string& buildId, uint64_t address, Frames* frames);
+    /// remember the frames of the @p address relative to the start of the module with @p buildId
+    void insert(const std::string& buildId, uint64_t address, Frames frames);
+
+private:
+    struct File;
+
+    File* file(const std::string& buildId);
+    void write(const std::string& buildId, const File& file) const;
+
+    std::string m_directory;
+    std::mutex m_mutex;
+    tsl::robin_map<std::string, std::unique_ptr<File>> m_files;
+};
+
+#endif // SYMBOLIZATIONCACHE_H
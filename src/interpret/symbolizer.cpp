@@ -0,0 +1,385 @@
+/*
+    SPDX-FileCopyrightText: 2014-2022 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "symbolizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <dwarf.h>
+#include <elfutils/libdwelf.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+bool isArmArch()
+{
+#ifdef __arm__
+    return true;
+#else
+    return false;
+#endif
+}
+
+#define error_out cerr << __FILE__ << ':' << __LINE__ << " ERROR:"
+
+bool startsWith(const std::string& haystack, const char* needle)
+{
+    return haystack.compare(0, strlen(needle), needle) == 0;
+}
+
+/// @return the GNU build-id of the ELF file at @p path as a hex string, or an empty string if it has none
+string readBuildId(const string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return {};
+    }
+
+    string buildId;
+    if (auto* elf = elf_begin(fd, ELF_C_READ_MMAP, nullptr)) {
+        const void* bits = nullptr;
+        const auto size = dwelf_elf_gnu_build_id(elf, &bits);
+        static const char hexChars[] = "0123456789abcdef";
+        for (ssize_t i = 0; i < size; ++i) {
+            const auto byte = static_cast<const unsigned char*>(bits)[i];
+            buildId.push_back(hexChars[byte >> 4]);
+            buildId.push_back(hexChars[byte & 0xf]);
+        }
+        elf_end(elf);
+    }
+    close(fd);
+    return buildId;
+}
+
+/// @return the raw bytes of the hex encoded @p buildId
+vector<unsigned char> buildIdBits(const string& buildId)
+{
+    vector<unsigned char> bits(buildId.size() / 2);
+    for (size_t i = 0; i < bits.size(); ++i) {
+        bits[i] = static_cast<unsigned char>(std::stoul(buildId.substr(2 * i, 2), nullptr, 16));
+    }
+    return bits;
+}
+
+static uint64_t alignedAddress(uint64_t addr, bool isArmArch)
+{
+    // Adjust addr back. The symtab entries are 1 off for all practical purposes.
+    return (isArmArch && (addr & 1)) ? addr - 1 : addr;
+}
+
+static SymbolCache::Symbols extractSymbols(Dwfl_Module* module, uint64_t elfStart, bool isArmArch)
+{
+    SymbolCache::Symbols symbols;
+
+    const auto numSymbols = dwfl_module_getsymtab(module);
+    if (numSymbols <= 0)
+        return symbols;
+
+    symbols.reserve(numSymbols);
+    for (int i = 0; i < numSymbols; ++i) {
+        GElf_Sym sym;
+        GElf_Addr symAddr;
+        const auto symbol = dwfl_module_getsym_info(module, i, &sym, &symAddr, nullptr, nullptr, nullptr);
+        if (symbol) {
+            const uint64_t start = alignedAddress(sym.st_value, isArmArch);
+            symbols.push_back({symAddr - elfStart, start, sym.st_size, symbol});
+        }
+    }
+    return symbols;
+}
+
+SymbolizationCache::Frames toFrames(const AddressInformation& info)
+{
+    SymbolizationCache::Frames frames;
+    frames.reserve(info.inlined.size() + 1);
+    frames.push_back({info.frame.function, info.frame.file, info.frame.line});
+    for (const auto& inlined : info.inlined) {
+        frames.push_back({inlined.function, inlined.file, inlined.line});
+    }
+    return frames;
+}
+
+AddressInformation toAddressInformation(SymbolizationCache::Frames frames)
+{
+    AddressInformation info;
+    if (frames.empty()) {
+        return info;
+    }
+    info.frame = {std::move(frames[0].function), std::move(frames[0].file), frames[0].line};
+    for (auto it = std::next(frames.begin()); it != frames.end(); ++it) {
+        info.inlined.emplace_back(std::move(it->function), std::move(it->file), it->line);
+    }
+    return info;
+}
+}
+
+bool Module::hasDebugInfo() const
+{
+    Dwarf_Addr bias = 0;
+    return module && dwfl_module_getdwarf(module, &bias);
+}
+
+AddressInformation Module::resolveAddress(uintptr_t address) const
+{
+    AddressInformation info;
+
+    if (!module) {
+        return info;
+    }
+
+    // the symbol table is only needed when the debug information doesn't know the function
+    auto useSymbolName = [&]() -> AddressInformation& {
+        if (!symbolCache->hasSymbols(symbolCacheKey)) {
+            // cache all symbols in a sorted lookup table and demangle them on-demand
+            // note that the symbols within the symtab aren't necessarily sorted,
+            // which makes searching repeatedly via dwfl_module_addrinfo potentially very slow
+            symbolCache->setSymbols(symbolCacheKey, extractSymbols(module, addressStart, isArmArch()));
+        }
+
+        if (auto* symbol = symbolCache->findSymbol(symbolCacheKey, address - addressStart)) {
+            info.frame.function = symbol->symname;
+        }
+        return info;
+    };
+
+    auto cuDie = dieCache.findCuDie(address);
+    if (!cuDie) {
+        return useSymbolName();
+    }
+
+    const auto offset = address - cuDie->bias();
+    auto srcloc = dwarf_getsrc_die(cuDie->cudie(), offset);
+    if (srcloc) {
+        const char* srcfile = dwarf_linesrc(srcloc, nullptr, nullptr);
+        if (srcfile) {
+            info.frame.file = srcfile;
+            dwarf_lineno(srcloc, &info.frame.line);
+        }
+    }
+
+    auto* subprogram = cuDie->findSubprogramDie(offset);
+    if (!subprogram) {
+        return useSymbolName();
+    }
+
+    // resolve the inline chain if possible
+    // the scopes and their call sites get cached per subprogram, as hot code gets resolved repeatedly
+    const auto scopes = subprogram->findInlineScopes(offset, cuDie->cudie());
+
+    if (scopes.empty()) {
+        // no inline frames, use subprogram name directly and return
+        info.frame.function = cuDie->dieName(subprogram->die());
+        return info;
+    }
+
+    // use name of the last inlined function as symbol
+    info.frame.function = cuDie->dieName(&scopes.back()->die);
+    info.inlined.reserve(scopes.size());
+
+    auto handleDie = [&](Dwarf_Die* scope, const SubProgramDie::InlineScope* prevScope) {
+        const auto& call = prevScope->callSite;
+        info.inlined.push_back({cuDie->dieName(scope), call.file, call.line});
+    };
+
+    // iterate in reverse, to properly rebuild the inline stack
+    // note that we need to take the DW_AT_call_{file,line} from the previous scope DIE
+    const auto numScopes = scopes.size();
+    for (std::size_t scopeIndex = numScopes - 1; scopeIndex >= 1; --scopeIndex) {
+        handleDie(&scopes[scopeIndex - 1]->die, scopes[scopeIndex]);
+    }
+
+    // the very last frame is the one where all the code got inlined into
+    handleDie(subprogram->die(), scopes.front());
+
+    return info;
+}
+
+void ModuleFragments::setBuildId(const string& buildId)
+{
+    if (m_fragments.empty()) {
+        return;
+    }
+    const auto moduleIndex = m_fragments.back().moduleIndex;
+    const auto addressStart = m_fragments.back().addressStart;
+    for (auto it = m_fragments.rbegin(); it != m_fragments.rend(); ++it) {
+        if (it->moduleIndex != moduleIndex || it->addressStart != addressStart) {
+            break;
+        }
+        it->buildId = buildId;
+    }
+}
+
+bool ModuleFragments::update()
+{
+    if (!m_dirty) {
+        return false;
+    }
+
+    sort(m_fragments.begin(), m_fragments.end());
+
+#ifndef NDEBUG
+    for (size_t i = 0; i < m_fragments.size(); ++i) {
+        const auto& m1 = m_fragments[i];
+        for (size_t j = i + 1; j < m_fragments.size(); ++j) {
+            if (i == j) {
+                continue;
+            }
+            const auto& m2 = m_fragments[j];
+            if ((m1.fragmentStart <= m2.fragmentStart && m1.fragmentEnd > m2.fragmentStart)
+                || (m1.fragmentStart < m2.fragmentEnd && m1.fragmentEnd >= m2.fragmentEnd)) {
+                cerr << "OVERLAPPING MODULES: " << hex << m1.moduleIndex << " (" << m1.fragmentStart << " to "
+                     << m1.fragmentEnd << ") and " << m1.moduleIndex << " (" << m2.fragmentStart << " to "
+                     << m2.fragmentEnd << ")\n"
+                     << dec;
+            } else if (m2.fragmentStart >= m1.fragmentEnd) {
+                break;
+            }
+        }
+    }
+#endif
+
+    m_dirty = false;
+    return true;
+}
+
+const ModuleFragment* ModuleFragments::find(const uintptr_t ip) const
+{
+    auto fragment = lower_bound(
+        m_fragments.begin(), m_fragments.end(), ip,
+        [](const ModuleFragment& fragment, const uintptr_t ip) -> bool { return fragment.fragmentEnd < ip; });
+    if (fragment != m_fragments.end() && fragment->fragmentStart <= ip && fragment->fragmentEnd >= ip) {
+        return &(*fragment);
+    }
+    return nullptr;
+}
+
+pair<uintptr_t, uintptr_t> ModuleFragments::moduleRange(const ModuleFragment& module) const
+{
+    uintptr_t start = UINTPTR_MAX;
+    uintptr_t end = 0;
+    for (const auto& fragment : m_fragments) {
+        if (fragment.moduleIndex == module.moduleIndex && fragment.addressStart == module.addressStart) {
+            start = std::min(start, fragment.fragmentStart);
+            end = std::max(end, fragment.fragmentEnd);
+        }
+    }
+    return {start, end};
+}
+
+Symbolizer::Symbolizer(std::shared_ptr<SymbolizationCache> cache)
+    : m_cache(std::move(cache))
+{
+    {
+        std::string debugPath(":.debug:/usr/lib/debug");
+        const auto length = debugPath.size() + 1;
+        m_debugPath = new char[length];
+        std::memcpy(m_debugPath, debugPath.data(), length);
+    }
+
+    m_callbacks = {
+        &dwfl_build_id_find_elf,
+        &dwfl_standard_find_debuginfo,
+        &dwfl_offline_section_address,
+        &m_debugPath,
+    };
+
+    m_dwfl = dwfl_begin(&m_callbacks);
+}
+
+Symbolizer::~Symbolizer()
+{
+    delete[] m_debugPath;
+    dwfl_end(m_dwfl);
+}
+
+SymbolizedIP Symbolizer::symbolize(const uintptr_t ip)
+{
+    if (m_fragments.update()) {
+        // reset dwfl state
+        m_modules.clear();
+
+        dwfl_report_begin(m_dwfl);
+        dwfl_report_end(m_dwfl, nullptr, nullptr);
+    }
+
+    SymbolizedIP data;
+    // find module for this instruction pointer
+    if (auto fragment = m_fragments.find(ip)) {
+        data.moduleName = fragment->fileName;
+
+        // only modules with a build-id can be cached, otherwise we cannot detect when they change
+        const auto cacheable = m_cache && !fragment->buildId.empty();
+        SymbolizationCache::Frames frames;
+        if (cacheable && m_cache->find(fragment->buildId, ip - fragment->addressStart, &frames)) {
+            data.info = toAddressInformation(std::move(frames));
+        } else if (auto module = reportModule(*fragment)) {
+            // the module may be shared with an identical library that got loaded from another path
+            data.info = module->resolveAddress(ip - fragment->addressStart + module->addressStart);
+            // without debug information, installing it later on would not invalidate the cached results
+            if (cacheable && module->hasDebugInfo()) {
+                m_cache->insert(fragment->buildId, ip - fragment->addressStart, toFrames(data.info));
+            }
+        }
+    }
+    return data;
+}
+
+Module* Symbolizer::reportModule(const ModuleFragment& module)
+{
+    if (startsWith(module.fileName, "linux-vdso.so")) {
+        return nullptr;
+    }
+
+    // identical libraries loaded via different paths share the same build-id, reuse their dwfl module
+    // and DIE cache instead of reporting the ELF file again
+    auto& ret = m_modules[module.buildId.empty() ? module.fileName : module.buildId];
+    if (ret.module)
+        return &ret;
+
+    auto dwflModule = dwfl_addrmodule(m_dwfl, module.addressStart);
+    if (!dwflModule) {
+        dwfl_report_begin_add(m_dwfl);
+        if (module.buildId.empty() || readBuildId(module.fileName) == module.buildId) {
+            dwflModule = dwfl_report_elf(m_dwfl, module.fileName.c_str(), module.fileName.c_str(), -1,
+                                         module.addressStart, false);
+        } else {
+            // the file is missing or got replaced since, e.g. when the data was recorded on another host
+            // let dwfl_build_id_find_elf look for the right file in the .build-id dirs of the debug path
+            dwflModule = reportModuleByBuildId(module);
+        }
+        dwfl_report_end(m_dwfl, nullptr, nullptr);
+
+        if (!dwflModule) {
+            error_out << "Failed to report module for " << module.fileName << ": " << dwfl_errmsg(dwfl_errno())
+                      << endl;
+            return nullptr;
+        }
+    }
+
+    ret = Module(module.fileName, module.buildId.empty() ? module.fileName : module.buildId, module.addressStart,
+                 dwflModule, &m_symbolCache);
+    return &ret;
+}
+
+Dwfl_Module* Symbolizer::reportModuleByBuildId(const ModuleFragment& module)
+{
+    const auto range = m_fragments.moduleRange(module);
+    auto dwflModule = dwfl_report_module(m_dwfl, module.fileName.c_str(), range.first, range.second);
+    if (!dwflModule) {
+        return nullptr;
+    }
+    const auto bits = buildIdBits(module.buildId);
+    if (dwfl_module_report_build_id(dwflModule, bits.data(), bits.size(), 0) != 0) {
+        error_out << "Failed to report build-id for " << module.fileName << ": " << dwfl_errmsg(dwfl_errno())
+                  << endl;
+    }
+    return dwflModule;
+}
@@ -0,0 +1,203 @@
+/*
+    SPDX-FileCopyrightText: 2014-2022 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef SYMBOLIZER_H
+#define SYMBOLIZER_H
+
+#include "dwarfdiecache.h"
+#include "symbolcache.h"
+#include "symbolizationcache.h"
+
+#include <tsl/robin_map.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+struct Frame
+{
+    Frame(std::string function = {}, std::string file = {}, int line = 0)
+        : function(function)
+        , file(file)
+        , line(line)
+    {
+    }
+
+    bool isValid() const
+    {
+        return !function.empty();
+    }
+
+    std::string function;
+    std::string file;
+    int line;
+};
+
+struct AddressInformation
+{
+    Frame frame;
+    std::vector<Frame> inlined;
+};
+
+struct ModuleFragment
+{
+    ModuleFragment(std::string fileName, uintptr_t addressStart, uintptr_t fragmentStart, uintptr_t fragmentEnd,
+                   size_t moduleIndex)
+        : fileName(fileName)
+        , addressStart(addressStart)
+        , fragmentStart(fragmentStart)
+        , fragmentEnd(fragmentEnd)
+        , moduleIndex(moduleIndex)
+    {
+    }
+
+    bool operator<(const ModuleFragment& module) const
+    {
+        return std::tie(addressStart, fragmentStart, fragmentEnd, moduleIndex)
+            < std::tie(module.addressStart, module.fragmentStart, module.fragmentEnd, module.moduleIndex);
+    }
+
+    bool operator!=(const ModuleFragment& module) const
+    {
+        return std::tie(addressStart, fragmentStart, fragmentEnd, moduleIndex)
+            != std::tie(module.addressStart, module.fragmentStart, module.fragmentEnd, module.moduleIndex);
+    }
+
+    std::string fileName;
+    uintptr_t addressStart;
+    uintptr_t fragmentStart;
+    uintptr_t fragmentEnd;
+    size_t moduleIndex;
+    // the GNU build-id as hex string, if the module has one
+    std::string buildId;
+};
+
+struct Module
+{
+    Module(std::string fileName, std::string symbolCacheKey, uintptr_t addressStart, Dwfl_Module* module,
+           SymbolCache* symbolCache)
+        : fileName(std::move(fileName))
+        , symbolCacheKey(std::move(symbolCacheKey))
+        , addressStart(addressStart)
+        , module(module)
+        , dieCache(module)
+        , symbolCache(symbolCache)
+    {
+    }
+
+    Module()
+        : Module({}, {}, 0, nullptr, nullptr)
+    {
+    }
+
+    AddressInformation resolveAddress(uintptr_t address) const;
+
+    /// @return true when DWARF debug information got found for the module, not only its symbol table
+    bool hasDebugInfo() const;
+
+    std::string fileName;
+    // the build-id when known, such that the same library loaded via different paths shares its symbols
+    std::string symbolCacheKey;
+    uintptr_t addressStart;
+    Dwfl_Module* module;
+    mutable DwarfDieCache dieCache;
+    SymbolCache* symbolCache;
+};
+
+struct SymbolizedIP
+{
+    // the name of the module that contains the instruction pointer, or empty if unknown
+    std::string moduleName;
+    AddressInformation info;
+};
+
+/**
+ * The address ranges of all loaded modules, sorted lazily for the lookups.
+ */
+class ModuleFragments
+{
+public:
+    ModuleFragments()
+    {
+        m_fragments.reserve(256);
+    }
+
+    void add(std::string fileName, const size_t moduleIndex, const uintptr_t addressStart,
+             const uintptr_t fragmentStart, const uintptr_t fragmentEnd)
+    {
+        m_fragments.emplace_back(std::move(fileName), addressStart, fragmentStart, fragmentEnd, moduleIndex);
+        m_dirty = true;
+    }
+
+    /// set the build-id of the module that got added last
+    void setBuildId(const std::string& buildId);
+
+    void clear()
+    {
+        // TODO: optimize this, reuse modules that are still valid
+        m_fragments.clear();
+        m_dirty = true;
+    }
+
+    /**
+     * Sort the fragments by address, which is required for find.
+     *
+     * @return true when the fragments changed since the last call
+     */
+    bool update();
+
+    /// @return the fragment that contains @p ip, or nullptr; update must have been called before
+    const ModuleFragment* find(const uintptr_t ip) const;
+
+    /// @return the address range spanned by all fragments of the same module as @p module
+    std::pair<uintptr_t, uintptr_t> moduleRange(const ModuleFragment& module) const;
+
+private:
+    std::vector<ModuleFragment> m_fragments;
+    bool m_dirty = false;
+};
+
+/**
+ * Resolves instruction pointers to their module, function and source location.
+ *
+ * Not thread safe, but multiple instances can be used in parallel as they each have their own Dwfl.
+ * They can share the @p cache, which may be nullptr when the symbolization cache is disabled.
+ */
+class Symbolizer
+{
+public:
+    explicit Symbolizer(std::shared_ptr<SymbolizationCache> cache = SymbolizationCache::fromConfiguration());
+    ~Symbolizer();
+
+    Symbolizer(const Symbolizer&) = delete;
+    Symbolizer& operator=(const Symbolizer&) = delete;
+
+    ModuleFragments& fragments()
+    {
+        return m_fragments;
+    }
+
+    SymbolizedIP symbolize(const uintptr_t ip);
+
+private:
+    Module* reportModule(const ModuleFragment& module);
+    Dwfl_Module* reportModuleByBuildId(const ModuleFragment& module);
+
+    ModuleFragments m_fragments;
+    Dwfl* m_dwfl = nullptr;
+    char* m_debugPath = nullptr;
+    Dwfl_Callbacks m_callbacks;
+    SymbolCache m_symbolCache;
+    // keyed by the build-id when known, otherwise by the file name
+    tsl::robin_map<std::string, Module> m_modules;
+    // persists the symbolized addresses across runs, when enabled
+    std::shared_ptr<SymbolizationCache> m_cache;
+};
+
+#endif // SYMBOLIZER_H
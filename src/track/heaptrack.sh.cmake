@@ -30,6 +30,8 @@ usage() {
     echo "  -p, --pid PID  The process ID of a running process into which"
     echo "                 heaptrack will be injected. This only works with"
     echo "                 applications that already link against libdl."
+    echo "                 The options that configure the recording in the debuggee, like --max-depth,"
+    echo "                 --stop-at or --leaks-only, cannot be used together with this."
     echo "  WARNING: Runtime-attaching heaptrack is UNSTABLE and can lead to CRASHES"
     echo "           in your application, especially after you detach heaptrack again."
     echo "           You are hereby warned, use it at your own risk!"
@@ -42,6 +44,38 @@ usage() {
     echo " --asan          Enables running heaptrack on binaries built with gcc's address sanitizer enabled."
     echo "                 Implies --use-inject."
     echo " --record-only   Only record and interpret the data, do not attempt to analyze it."
+    echo " --max-depth N   Limit the number of frames that get unwound for every backtrace."
+    echo "                 Deeper backtraces are truncated, which makes recording deeply recursive code faster."
+    echo " --stop-at RULES Stop unwinding once a backtrace reaches one of the colon separated RULES,"
+    echo "                 which are either substrings of module names or hexadecimal address ranges with a 0x prefix,"
+    echo "                 e.g. \"libQt5Core:0x401000-0x402000\". Truncated backtraces are marked as such."
+    echo " --async-unwind  Only copy the top of the stack when memory gets allocated and unwind it in a"
+    echo "                 background thread. This reduces the overhead in the allocating threads, but requires"
+    echo "                 heaptrack to be built with a libunwind that supports remote unwinding."
+    echo " --follow-fork   Also trace forked child processes. The data of every child is written to a separate"
+    echo "                 file which has the PID of the child appended to its name."
+    echo " --fragmentation Replay the allocation addresses to analyze the fragmentation of the heap over time."
+    echo "                 This increases the memory consumption and runtime of the interpreter."
+    echo " --allocator-stats"
+    echo "                 Periodically record the statistics of the allocator (mallinfo2) and the proportional,"
+    echo "                 anonymous and swapped memory of the process, to compare them with the heap consumption."
+    echo " --leaks-only    Only record the allocations that are not freed when the application exits. The live"
+    echo "                 allocations are kept in memory instead of writing every event out, which makes the"
+    echo "                 output much smaller. Peak and temporary allocations cannot be analyzed then."
+    echo " --sampling      Only record every n-th allocation while the application is blocked for too long waiting"
+    echo "                 for the data to be written out, until the pressure goes away again. The costs within the"
+    echo "                 affected intervals are incomplete, which the analyzer reports. n is a power of two up to"
+    echo "                 1024, set HEAPTRACK_MAX_SAMPLING_RATE to change that limit."
+    echo " --symbol-cache  Cache the symbolized addresses of libraries with a build-id in \$XDG_CACHE_HOME/heaptrack,"
+    echo "                 such that repeated runs don't need to load their debug information again."
+    echo "                 Set HEAPTRACK_SYMBOL_CACHE_DIR to use another directory."
+    echo " --defer-symbolization"
+    echo "                 Do not resolve the backtraces while recording, which keeps the overhead on the host minimal."
+    echo "                 Run heaptrack_symbolize on the data afterwards, e.g. on another host with the debug information."
+    echo " --compression-level N"
+    echo "                 Compress the interpreted data with level N instead of the default level of gzip or zstd."
+    echo " --compression-threads N"
+    echo "                 Compress the interpreted data with N additional threads, which requires zstd."
     echo "  ARGUMENT       Any number of arguments that will be passed verbatim"
     echo "                 to the debuggee."
     echo "  -h, --help     Show this help message and exit."
@@ -68,6 +102,18 @@ client=
 use_inject_lib=
 write_raw_data=
 record_only=
+max_depth=
+stop_at=
+async_unwind=
+follow_fork=
+fragmentation=
+allocator_stats=
+leaks_only=
+sampling=
+symbol_cache=
+defer_symbolization=
+compression_level=
+compression_threads=
 asan=
 asan_ld_preload=
 
@@ -113,6 +159,70 @@ while true; do
             record_only=1
             shift 1
             ;;
+        "--max-depth")
+            if [ -z "$2" ]; then
+                echo "Missing max depth argument."
+                exit 1
+            fi
+            max_depth=$2
+            shift 2
+            ;;
+        "--async-unwind")
+            async_unwind=1
+            shift 1
+            ;;
+        "--follow-fork")
+            follow_fork=1
+            shift 1
+            ;;
+        "--fragmentation")
+            fragmentation=1
+            shift 1
+            ;;
+        "--allocator-stats")
+            allocator_stats=1
+            shift 1
+            ;;
+        "--leaks-only")
+            leaks_only=1
+            shift 1
+            ;;
+        "--sampling")
+            sampling=1
+            shift 1
+            ;;
+        "--symbol-cache")
+            symbol_cache=1
+            shift 1
+            ;;
+        "--defer-symbolization")
+            defer_symbolization=1
+            shift 1
+            ;;
+        "--compression-level")
+            if [ -z "$2" ]; then
+                echo "Missing compression level argument."
+                exit 1
+            fi
+            compression_level=$2
+            shift 2
+            ;;
+        "--compression-threads")
+            if [ -z "$2" ]; then
+                echo "Missing compression threads argument."
+                exit 1
+            fi
+            compression_threads=$2
+            shift 2
+            ;;
+        "--stop-at")
+            if [ -z "$2" ]; then
+                echo "Missing stop rules argument."
+                exit 1
+            fi
+            stop_at=$2
+            shift 2
+            ;;
         "-h" | "--help")
             usage
             exit 0
@@ -134,7 +244,7 @@ while true; do
             shift 2
             ;;
         "-p" | "--pid")
-            if [ -z "$(command -v gdb 2> /dev/null)" ]; then
+            if [ ! -x "$EXE_PATH/@LIBEXEC_REL_PATH@/heaptrack_attach" ] && [ -z "$(command -v gdb 2> /dev/null)" ]; then
                 echo "GDB is not installed, cannot attach to running process."
                 exit 1
             fi
@@ -207,6 +317,24 @@ while true; do
     esac
 done
 
+# libheaptrack reads these options from its environment when the debuggee starts,
+# an injected libheaptrack only sees the environment of the running process
+rejectWithPid() {
+    if [ -n "$2" ]; then
+        echo "Cannot use $1 when attaching to a running process."
+        exit 1
+    fi
+}
+if [ ! -z "$pid" ]; then
+    rejectWithPid --max-depth "$max_depth"
+    rejectWithPid --stop-at "$stop_at"
+    rejectWithPid --async-unwind "$async_unwind"
+    rejectWithPid --follow-fork "$follow_fork"
+    rejectWithPid --allocator-stats "$allocator_stats"
+    rejectWithPid --leaks-only "$leaks_only"
+    rejectWithPid --sampling "$sampling"
+fi
+
 # put output into current pwd
 if [ -z "$output" ]; then
     output=$(pwd)/heaptrack.$(basename "$client").$$
@@ -229,6 +357,7 @@ if [ -z "$write_raw_data" ] && [ ! -f "$INTERPRETER" ]; then
     exit 1
 fi
 INTERPRETER=$(readlink -f "$INTERPRETER")
+SYMBOLIZER="$EXE_PATH/$LIBEXEC_REL_PATH/heaptrack_symbolize"
 
 if [ -z "$use_inject_lib" ]; then
     LIBHEAPTRACK_PRELOAD="$EXE_PATH/$LIB_REL_PATH/libheaptrack_preload.so"
@@ -248,6 +377,14 @@ if [ ! -f "$LIBHEAPTRACK_INJECT" ]; then
 fi
 LIBHEAPTRACK_INJECT=$(readlink -f "$LIBHEAPTRACK_INJECT")
 
+# optional, we fall back to GDB for runtime-attaching without it
+ATTACHER="$EXE_PATH/$LIBEXEC_REL_PATH/heaptrack_attach"
+if [ -x "$ATTACHER" ]; then
+    ATTACHER=$(readlink -f "$ATTACHER")
+else
+    ATTACHER=
+fi
+
 if [ -n "$asan" ]; then
   asan_ld_preload=$(ldd $client | grep libasan | sed -e 's/.*=> //;s/ (.*//')
   if [ -z "$asan_ld_preload" ]; then
@@ -258,10 +395,47 @@ if [ -n "$asan" ]; then
   asan_ld_preload="$asan_ld_preload:"
 fi
 
+if [ -n "$max_depth" ]; then
+    export HEAPTRACK_MAX_DEPTH="$max_depth"
+fi
+if [ -n "$stop_at" ]; then
+    export HEAPTRACK_STOP_AT="$stop_at"
+fi
+if [ -n "$async_unwind" ]; then
+    # size of the stack snapshots in KiB
+    export HEAPTRACK_ASYNC_UNWIND=16
+fi
+if [ -n "$fragmentation" ]; then
+    # evaluated by the interpreter
+    export HEAPTRACK_FRAGMENTATION=1
+fi
+if [ -n "$allocator_stats" ]; then
+    export HEAPTRACK_ALLOCATOR_STATS=1
+fi
+if [ -n "$leaks_only" ]; then
+    export HEAPTRACK_LEAKS_ONLY=1
+fi
+if [ -n "$sampling" ] && [ -z "$HEAPTRACK_MAX_SAMPLING_RATE" ]; then
+    export HEAPTRACK_MAX_SAMPLING_RATE=1024
+fi
+if [ -n "$symbol_cache" ]; then
+    # evaluated by the interpreter
+    export HEAPTRACK_SYMBOL_CACHE=1
+fi
+if [ -n "$defer_symbolization" ]; then
+    # evaluated by the interpreter
+    export HEAPTRACK_DEFER_SYMBOLIZATION=1
+fi
+
 # setup named pipe to read data from
 pipe=/tmp/heaptrack_fifo$$
 mkfifo $pipe
 
+if [ -n "$follow_fork" ]; then
+    # forked children create their own named pipe, the $$ gets replaced with their PID
+    export HEAPTRACK_FOLLOW_FORK="$pipe.child.\$\$"
+fi
+
 # if root is profiling a process for non root
 # give profiled process write access to the pipe
 if [ ! -z "$pid" ]; then
@@ -289,33 +463,98 @@ if [ "@ZSTD_FOUND@" = "TRUE" ] && [ ! -z "$(command -v zstd 2> /dev/null)" ]; th
     UNCOMPRESSOR="zstd -dc"
 fi
 
+output_base="$output"
 output_non_raw="$output.$output_suffix"
 
 if [ ! -z "$write_raw_data" ]; then
     output_suffix="raw.$output_suffix"
+elif [ -n "$defer_symbolization" ]; then
+    output_suffix="unsymbolized.$output_suffix"
+fi
+
+# interpret the data and compress the output on the fly, the interpreter compresses it in-process
+interpreter_args=
+if [ -n "$compression_level" ]; then
+    interpreter_args="$interpreter_args --compression-level $compression_level"
+fi
+if [ -n "$compression_threads" ]; then
+    interpreter_args="$interpreter_args --compression-threads $compression_threads"
 fi
 
-# interpret the data and compress the output on the fly
 output="$output.$output_suffix"
 if [ -z "$write_raw_data" ]; then
-    "$INTERPRETER" < $pipe | $COMPRESSOR > "$output" &
+    "$INTERPRETER" --output "$output" $interpreter_args < $pipe &
 else
     $COMPRESSOR < $pipe > "$output" &
 fi
 debuggee=$!
 
+# start one interpreter for every named pipe that a forked child process creates
+watchChildPipes() {
+    started=" "
+    while [ -p "$pipe" ]; do
+        for child_pipe in "$pipe".child.*; do
+            if [ ! -p "$child_pipe" ]; then
+                continue
+            fi
+            child_pid=${child_pipe##*.}
+            case "$started" in
+                *" $child_pid "*)
+                    continue
+                    ;;
+            esac
+            started="$started$child_pid "
+            child_output="$output_base.$child_pid.$output_suffix"
+            echo "heaptrack output of forked child $child_pid will be written to \"$child_output\""
+            if [ -z "$write_raw_data" ]; then
+                "$INTERPRETER" --output "$child_output" $interpreter_args < "$child_pipe" &
+            else
+                $COMPRESSOR < "$child_pipe" > "$child_output" &
+            fi
+        done
+        sleep 0.1
+    done
+    # a child that exec'd or exited abruptly before it opened its named pipe leaves the interpreter
+    # waiting for a writer, briefly opening the pipe without blocking ends its input instead
+    for child_pid in $started; do
+        while kill -0 "$child_pid" 2> /dev/null; do
+            sleep 0.1
+        done
+        if [ -p "$pipe.child.$child_pid" ]; then
+            exec 3<> "$pipe.child.$child_pid"
+            exec 3>&-
+        fi
+    done
+    wait
+}
+
+child_watcher=
+if [ -n "$follow_fork" ]; then
+    watchChildPipes &
+    child_watcher=$!
+fi
+
 cleanup() {
     if [ ! -z "$pid" ] && [ -d "/proc/$pid" ]; then
-        echo "removing heaptrack injection via GDB, this might take some time..."
-        gdb --batch-silent -n -iex="set auto-solib-add off" \
-            -iex="set language c" -p $pid \
-            --eval-command="sharedlibrary libheaptrack_inject" \
-            --eval-command="call (void) heaptrack_stop()" \
-            --eval-command="detach"
+        if [ -n "$attached" ] && "$ATTACHER" "$pid" stop "$LIBHEAPTRACK_INJECT"; then
+            echo "removed heaptrack injection"
+        else
+            echo "removing heaptrack injection via GDB, this might take some time..."
+            gdb --batch-silent -n -iex="set auto-solib-add off" \
+                -iex="set language c" -p $pid \
+                --eval-command="sharedlibrary libheaptrack_inject" \
+                --eval-command="call (void) heaptrack_stop()" \
+                --eval-command="detach"
+        fi
         # NOTE: we do not call dlclose here, as that has the tendency to trigger
         #       crashes in the debuggee. So instead, we keep heaptrack loaded.
     fi
     rm -f "$pipe"
+    if [ -n "$child_watcher" ]; then
+        echo "waiting for traced child processes to finish..."
+        wait "$child_watcher"
+        rm -f "$pipe".child.*
+    fi
     case $(uname) in
         FreeBSD*)
             rm -f "$pipe.lock"
@@ -327,12 +566,20 @@ cleanup() {
     echo
 
     if [ ! -z "$write_raw_data" ]; then
-        echo "  $UNCOMPRESSOR < \"$output\" | $INTERPRETER | $COMPRESSOR > \"$output_non_raw\""
+        if [ -n "$fragmentation" ]; then
+            echo "  $UNCOMPRESSOR < \"$output\" | HEAPTRACK_FRAGMENTATION=1 $INTERPRETER | $COMPRESSOR > \"$output_non_raw\""
+        else
+            echo "  $UNCOMPRESSOR < \"$output\" | $INTERPRETER | $COMPRESSOR > \"$output_non_raw\""
+        fi
+    elif [ -n "$defer_symbolization" ]; then
+        echo "  $UNCOMPRESSOR < \"$output\" | $SYMBOLIZER | $COMPRESSOR > \"$output_non_raw\""
+        echo "  heaptrack --analyze \"$output_non_raw\""
     else
         echo "  heaptrack --analyze \"$output\""
     fi
 
-    if [ -z "$record_only" ] && [ -z "$write_raw_data" ] && [ -x "$EXE_PATH/heaptrack_gui" ]; then
+    if [ -z "$record_only" ] && [ -z "$write_raw_data" ] && [ -z "$defer_symbolization" ] \
+        && [ -x "$EXE_PATH/heaptrack_gui" ]; then
         echo ""
         echo "heaptrack_gui detected, automatically opening the file..."
         "$EXE_PATH/heaptrack_gui" "$output"
@@ -354,7 +601,14 @@ else
         --eval-command="set startup-with-shell off" \
         --eval-command="run" --args "$client" "$@"
     EXIT_CODE=$?
+  elif [ -z "$debug" ] && [ -n "$ATTACHER" ] && "$ATTACHER" "$pid" inject "$LIBHEAPTRACK_INJECT" "$pipe"; then
+    attached=1
+    EXIT_CODE=0
+    echo "injection finished"
   else
+    if [ -n "$ATTACHER" ] && [ -z "$debug" ]; then
+        echo "failed to inject heaptrack directly, falling back to GDB"
+    fi
     echo "injecting heaptrack into application via GDB, this might take some time..."
     dlopen=$($ENVCHECKER dlopen "$LIBHEAPTRACK_INJECT")
     if [ -z "$debug" ]; then
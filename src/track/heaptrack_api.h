@@ -16,6 +16,28 @@
  * Once you run your code within heaptrack though, this information will be
  * picked up and included in the heap profile data.
  *
+ * Pool allocators can report many allocations from the same call site at once
+ * with @c heaptrack_report_alloc_batch, which only unwinds the stack once, and
+ * release them again with @c heaptrack_report_free_batch. Allocations that
+ * are tied to an arena can also be released all at once with
+ * @c heaptrack_report_arena_reset.
+ *
+ * Additionally, @c heaptrack_report_mark records a named point in time and
+ * @c heaptrack_report_push_phase and @c heaptrack_report_pop_phase enclose a
+ * named phase of the application, such as "startup" or "compaction". Phases
+ * can be nested and form a single stack for the whole process. The analyzer
+ * can then restrict the data to the allocations that happened within a phase.
+ *
+ * To attribute allocations to a tenant, request type or similar, register a
+ * name for a small integer tag with @c heaptrack_report_register_tag and then
+ * set it on the current thread with @c heaptrack_report_set_tag. All
+ * allocations of that thread carry the tag until it gets changed or cleared
+ * again with @c heaptrack_report_clear_tag. Tag zero means untagged.
+ *
+ * When recording only leaks, heaptrack writes out the allocations that are
+ * still alive when the application exits. Call @c heaptrack_report_dump_leaks
+ * to write them out earlier, e.g. before the application gets killed.
+ *
  * Note: If you use static linking, or have a custom allocator in your main
  * executable, then you must define HEAPTRACK_API_DLSYM before including
  * this header and link against libdl to make this work properly. The other,
@@ -48,6 +70,16 @@ extern "C" {
 __attribute__((weak)) void heaptrack_malloc(void* ptr, size_t size);
 __attribute__((weak)) void heaptrack_realloc(void* ptr_in, size_t size, void* ptr_out);
 __attribute__((weak)) void heaptrack_free(void* ptr);
+__attribute__((weak)) void heaptrack_malloc_batch(void* arena, void* const* ptrs, const size_t* sizes, size_t count);
+__attribute__((weak)) void heaptrack_free_batch(void* const* ptrs, size_t count);
+__attribute__((weak)) void heaptrack_arena_reset(void* arena);
+__attribute__((weak)) void heaptrack_mark(const char* name);
+__attribute__((weak)) void heaptrack_push_phase(const char* name);
+__attribute__((weak)) void heaptrack_pop_phase();
+__attribute__((weak)) void heaptrack_register_tag(unsigned int tag, const char* name);
+__attribute__((weak)) void heaptrack_set_tag(unsigned int tag);
+__attribute__((weak)) void heaptrack_clear_tag();
+__attribute__((weak)) void heaptrack_dump_leaks();
 
 #ifdef __cplusplus
 }
@@ -65,6 +97,46 @@ __attribute__((weak)) void heaptrack_free(void* ptr);
     if (heaptrack_free)                                                                                                \
     heaptrack_free(ptr)
 
+#define heaptrack_report_alloc_batch(arena, ptrs, sizes, count)                                                        \
+    if (heaptrack_malloc_batch)                                                                                        \
+    heaptrack_malloc_batch(arena, ptrs, sizes, count)
+
+#define heaptrack_report_free_batch(ptrs, count)                                                                       \
+    if (heaptrack_free_batch)                                                                                          \
+    heaptrack_free_batch(ptrs, count)
+
+#define heaptrack_report_arena_reset(arena)                                                                            \
+    if (heaptrack_arena_reset)                                                                                         \
+    heaptrack_arena_reset(arena)
+
+#define heaptrack_report_mark(name)                                                                                    \
+    if (heaptrack_mark)                                                                                                \
+    heaptrack_mark(name)
+
+#define heaptrack_report_push_phase(name)                                                                              \
+    if (heaptrack_push_phase)                                                                                          \
+    heaptrack_push_phase(name)
+
+#define heaptrack_report_pop_phase()                                                                                   \
+    if (heaptrack_pop_phase)                                                                                           \
+    heaptrack_pop_phase()
+
+#define heaptrack_report_register_tag(tag, name)                                                                       \
+    if (heaptrack_register_tag)                                                                                        \
+    heaptrack_register_tag(tag, name)
+
+#define heaptrack_report_set_tag(tag)                                                                                  \
+    if (heaptrack_set_tag)                                                                                             \
+    heaptrack_set_tag(tag)
+
+#define heaptrack_report_clear_tag()                                                                                   \
+    if (heaptrack_clear_tag)                                                                                           \
+    heaptrack_clear_tag()
+
+#define heaptrack_report_dump_leaks()                                                                                  \
+    if (heaptrack_dump_leaks)                                                                                          \
+    heaptrack_dump_leaks()
+
 #else // HEAPTRACK_API_DLSYM
 
 /**
@@ -91,8 +163,18 @@ struct heaptrack_api_t
     void (*malloc)(void*, size_t);
     void (*free)(void*);
     void (*realloc)(void*, size_t, void*);
+    void (*malloc_batch)(void*, void* const*, const size_t*, size_t);
+    void (*free_batch)(void* const*, size_t);
+    void (*arena_reset)(void*);
+    void (*mark)(const char*);
+    void (*push_phase)(const char*);
+    void (*pop_phase)();
+    void (*register_tag)(unsigned int, const char*);
+    void (*set_tag)(unsigned int);
+    void (*clear_tag)();
+    void (*dump_leaks)();
 };
-static struct heaptrack_api_t heaptrack_api = {0, 0, 0};
+static struct heaptrack_api_t heaptrack_api = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
 void heaptrack_init_api()
 {
@@ -110,6 +192,46 @@ void heaptrack_init_api()
         if (sym)
             heaptrack_api.free = (void (*)(void*))sym;
 
+        sym = dlsym(RTLD_NEXT, "heaptrack_malloc_batch");
+        if (sym)
+            heaptrack_api.malloc_batch = (void (*)(void*, void* const*, const size_t*, size_t))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_free_batch");
+        if (sym)
+            heaptrack_api.free_batch = (void (*)(void* const*, size_t))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_arena_reset");
+        if (sym)
+            heaptrack_api.arena_reset = (void (*)(void*))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_mark");
+        if (sym)
+            heaptrack_api.mark = (void (*)(const char*))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_push_phase");
+        if (sym)
+            heaptrack_api.push_phase = (void (*)(const char*))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_pop_phase");
+        if (sym)
+            heaptrack_api.pop_phase = (void (*)())sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_register_tag");
+        if (sym)
+            heaptrack_api.register_tag = (void (*)(unsigned int, const char*))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_set_tag");
+        if (sym)
+            heaptrack_api.set_tag = (void (*)(unsigned int))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_clear_tag");
+        if (sym)
+            heaptrack_api.clear_tag = (void (*)())sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_dump_leaks");
+        if (sym)
+            heaptrack_api.dump_leaks = (void (*)())sym;
+
         initialized = 1;
     }
 }
@@ -135,6 +257,76 @@ void heaptrack_init_api()
             heaptrack_api.free(ptr);                                                                                   \
     } while (0)
 
+#define heaptrack_report_alloc_batch(arena, ptrs, sizes, count)                                                        \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.malloc_batch)                                                                                \
+            heaptrack_api.malloc_batch(arena, ptrs, sizes, count);                                                     \
+    } while (0)
+
+#define heaptrack_report_free_batch(ptrs, count)                                                                       \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.free_batch)                                                                                  \
+            heaptrack_api.free_batch(ptrs, count);                                                                     \
+    } while (0)
+
+#define heaptrack_report_arena_reset(arena)                                                                            \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.arena_reset)                                                                                 \
+            heaptrack_api.arena_reset(arena);                                                                          \
+    } while (0)
+
+#define heaptrack_report_mark(name)                                                                                    \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.mark)                                                                                        \
+            heaptrack_api.mark(name);                                                                                  \
+    } while (0)
+
+#define heaptrack_report_push_phase(name)                                                                              \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.push_phase)                                                                                  \
+            heaptrack_api.push_phase(name);                                                                            \
+    } while (0)
+
+#define heaptrack_report_pop_phase()                                                                                   \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.pop_phase)                                                                                   \
+            heaptrack_api.pop_phase();                                                                                 \
+    } while (0)
+
+#define heaptrack_report_register_tag(tag, name)                                                                       \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.register_tag)                                                                                \
+            heaptrack_api.register_tag(tag, name);                                                                     \
+    } while (0)
+
+#define heaptrack_report_set_tag(tag)                                                                                  \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.set_tag)                                                                                     \
+            heaptrack_api.set_tag(tag);                                                                                \
+    } while (0)
+
+#define heaptrack_report_clear_tag()                                                                                   \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.clear_tag)                                                                                   \
+            heaptrack_api.clear_tag();                                                                                 \
+    } while (0)
+
+#define heaptrack_report_dump_leaks()                                                                                  \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.dump_leaks)                                                                                  \
+            heaptrack_api.dump_leaks();                                                                                \
+    } while (0)
+
 #endif // HEAPTRACK_API_DLSYM
 
 /**
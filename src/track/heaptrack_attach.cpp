@@ -0,0 +1,435 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * @file heaptrack_attach.cpp
+ *
+ * @brief Inject heaptrack into a running process without going through GDB.
+ *
+ * We ptrace the main thread of the target, let it call dlopen for libheaptrack_inject.so
+ * and then heaptrack_inject or heaptrack_stop, and restore its registers afterwards.
+ * The function addresses get computed from the mappings of the target, which is much
+ * faster than letting GDB load all the symbols of a large application.
+ *
+ * Only x86_64 and aarch64 are supported, heaptrack.sh falls back to GDB otherwise.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define HEAPTRACK_ATTACH_SUPPORTED 1
+#else
+#define HEAPTRACK_ATTACH_SUPPORTED 0
+#endif
+
+extern "C" {
+__attribute__((weak)) void* __libc_dlopen_mode(const char* filename, int flag);
+}
+
+namespace {
+
+#if HEAPTRACK_ATTACH_SUPPORTED
+
+using Registers = user_regs_struct;
+
+/**
+ * Find the address at which the file @p path got mapped into @p pid, i.e. the start of its mapping at offset zero.
+ */
+uintptr_t mappingStart(pid_t pid, const std::string& path)
+{
+    char realPath[PATH_MAX];
+    if (!realpath(path.c_str(), realPath)) {
+        return 0;
+    }
+
+    std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+    std::string line;
+    while (std::getline(maps, line)) {
+        // start-end perms offset dev inode path
+        uintptr_t start = 0;
+        uintptr_t offset = 0;
+        int pathStart = 0;
+        if (sscanf(line.c_str(), "%zx-%*x %*s %zx %*s %*u %n", &start, &offset, &pathStart) < 2 || !pathStart) {
+            continue;
+        }
+        if (offset == 0 && line.compare(pathStart, std::string::npos, realPath) == 0) {
+            return start;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Find the offset of the dynamic symbol @p name relative to the start of the mapping of the ELF file at @p path.
+ */
+uintptr_t symbolOffset(const std::string& path, const char* name)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+    struct stat fileStat;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &fileStat) == 0 && static_cast<size_t>(fileStat.st_size) >= sizeof(Elf64_Ehdr)) {
+        data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+
+    const auto size = static_cast<size_t>(fileStat.st_size);
+    const auto* base = static_cast<const char*>(data);
+    const auto* header = static_cast<const Elf64_Ehdr*>(data);
+    auto inFile = [&](uint64_t offset, uint64_t length) { return offset <= size && length <= size - offset; };
+
+    uintptr_t result = 0;
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) == 0 && header->e_ident[EI_CLASS] == ELFCLASS64
+        && inFile(header->e_phoff, header->e_phnum * sizeof(Elf64_Phdr))
+        && inFile(header->e_shoff, header->e_shnum * sizeof(Elf64_Shdr))) {
+        // the mapping starts at the page of the first loaded segment
+        uint64_t firstLoad = UINT64_MAX;
+        const auto* programHeaders = reinterpret_cast<const Elf64_Phdr*>(base + header->e_phoff);
+        for (int i = 0; i < header->e_phnum; ++i) {
+            if (programHeaders[i].p_type == PT_LOAD && programHeaders[i].p_vaddr < firstLoad) {
+                firstLoad = programHeaders[i].p_vaddr & ~(static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) - 1);
+            }
+        }
+
+        const auto* sections = reinterpret_cast<const Elf64_Shdr*>(base + header->e_shoff);
+        for (int i = 0; i < header->e_shnum && !result && firstLoad != UINT64_MAX; ++i) {
+            const auto& symbols = sections[i];
+            if (symbols.sh_type != SHT_DYNSYM || symbols.sh_link >= header->e_shnum
+                || !inFile(symbols.sh_offset, symbols.sh_size)) {
+                continue;
+            }
+            const auto& strings = sections[symbols.sh_link];
+            if (!inFile(strings.sh_offset, strings.sh_size)) {
+                continue;
+            }
+            const auto* symbol = reinterpret_cast<const Elf64_Sym*>(base + symbols.sh_offset);
+            const auto* end = symbol + symbols.sh_size / sizeof(Elf64_Sym);
+            for (; symbol != end; ++symbol) {
+                if (symbol->st_shndx != SHN_UNDEF && ELF64_ST_TYPE(symbol->st_info) == STT_FUNC
+                    && symbol->st_name < strings.sh_size
+                    && strncmp(base + strings.sh_offset + symbol->st_name, name, strings.sh_size - symbol->st_name)
+                        == 0) {
+                    result = symbol->st_value - firstLoad;
+                    break;
+                }
+            }
+        }
+    }
+
+    munmap(data, size);
+    return result;
+}
+
+/**
+ * A function in the target process and the arguments to call it with.
+ */
+struct RemoteCall
+{
+    uintptr_t function = 0;
+    std::vector<uintptr_t> arguments;
+    // strings to copy onto the stack of the target, the arguments at the given indices point to them
+    std::vector<std::pair<size_t, std::string>> strings;
+};
+
+bool getRegisters(pid_t pid, Registers* registers)
+{
+#if defined(__x86_64__)
+    return ptrace(PTRACE_GETREGS, pid, nullptr, registers) == 0;
+#else
+    iovec io = {registers, sizeof(*registers)};
+    return ptrace(PTRACE_GETREGSET, pid, reinterpret_cast<void*>(NT_PRSTATUS), &io) == 0;
+#endif
+}
+
+bool setRegisters(pid_t pid, const Registers& registers)
+{
+#if defined(__x86_64__)
+    return ptrace(PTRACE_SETREGS, pid, nullptr, &registers) == 0;
+#else
+    iovec io = {const_cast<Registers*>(&registers), sizeof(registers)};
+    return ptrace(PTRACE_SETREGSET, pid, reinterpret_cast<void*>(NT_PRSTATUS), &io) == 0;
+#endif
+}
+
+bool writeMemory(pid_t pid, uintptr_t address, const void* data, size_t size)
+{
+    const auto* bytes = static_cast<const char*>(data);
+    for (size_t i = 0; i < size; i += sizeof(long)) {
+        long word = 0;
+        const auto chunk = std::min(sizeof(long), size - i);
+        if (chunk < sizeof(long)) {
+            // keep the remaining bytes of a partially written word intact
+            errno = 0;
+            word = ptrace(PTRACE_PEEKDATA, pid, reinterpret_cast<void*>(address + i), nullptr);
+            if (errno) {
+                return false;
+            }
+        }
+        memcpy(&word, bytes + i, chunk);
+        if (ptrace(PTRACE_POKEDATA, pid, reinterpret_cast<void*>(address + i), reinterpret_cast<void*>(word)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Let the stopped thread @p pid call a function and wait for it to return.
+ *
+ * The function returns to address zero, which raises a SIGSEGV that we intercept.
+ * The registers of the thread get restored afterwards, also when the call failed.
+ */
+bool callFunction(pid_t pid, RemoteCall call, uintptr_t* result)
+{
+    Registers saved;
+    if (!getRegisters(pid, &saved)) {
+        fprintf(stderr, "failed to read registers: %s\n", strerror(errno));
+        return false;
+    }
+
+#if defined(__x86_64__)
+    uintptr_t stack = saved.rsp;
+#else
+    uintptr_t stack = saved.sp;
+#endif
+    // skip the red zone and put the strings below it
+    stack -= 128;
+    for (const auto& string : call.strings) {
+        stack -= string.second.size() + 1;
+        if (!writeMemory(pid, stack, string.second.c_str(), string.second.size() + 1)) {
+            fprintf(stderr, "failed to write to the stack: %s\n", strerror(errno));
+            return false;
+        }
+        call.arguments[string.first] = stack;
+    }
+    stack &= ~uintptr_t(15);
+
+    auto registers = saved;
+#if defined(__x86_64__)
+    // push the return address, the stack is then misaligned by eight like after a regular call
+    const uintptr_t returnAddress = 0;
+    stack -= sizeof(returnAddress);
+    if (!writeMemory(pid, stack, &returnAddress, sizeof(returnAddress))) {
+        fprintf(stderr, "failed to write to the stack: %s\n", strerror(errno));
+        return false;
+    }
+    unsigned long long* argumentRegisters[] = {&registers.rdi, &registers.rsi, &registers.rdx, &registers.rcx};
+    registers.rsp = stack;
+    registers.rip = call.function;
+    registers.rax = 0;
+    // don't let the kernel restart an interrupted syscall at our function
+    registers.orig_rax = -1;
+#else
+    unsigned long long* argumentRegisters[] = {&registers.regs[0], &registers.regs[1], &registers.regs[2],
+                                               &registers.regs[3]};
+    registers.sp = stack;
+    registers.pc = call.function;
+    registers.regs[30] = 0;
+    // don't let the kernel restart an interrupted syscall at our function
+    int syscallNumber = -1;
+    iovec syscallIo = {&syscallNumber, sizeof(syscallNumber)};
+    ptrace(PTRACE_SETREGSET, pid, reinterpret_cast<void*>(NT_ARM_SYSTEM_CALL), &syscallIo);
+#endif
+    if (call.arguments.size() > sizeof(argumentRegisters) / sizeof(argumentRegisters[0])) {
+        fprintf(stderr, "too many arguments\n");
+        return false;
+    }
+    for (size_t i = 0; i < call.arguments.size(); ++i) {
+        *argumentRegisters[i] = call.arguments[i];
+    }
+
+    bool returned = false;
+    if (!setRegisters(pid, registers)) {
+        fprintf(stderr, "failed to write registers: %s\n", strerror(errno));
+    } else if (ptrace(PTRACE_CONT, pid, nullptr, nullptr) != 0) {
+        fprintf(stderr, "failed to continue the process: %s\n", strerror(errno));
+    } else {
+        int status = 0;
+        while (waitpid(pid, &status, __WALL) == pid) {
+            if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                fprintf(stderr, "the process terminated during the call\n");
+                return false;
+            }
+            const int signal = WSTOPSIG(status);
+            if (signal == SIGSEGV && getRegisters(pid, &registers)) {
+#if defined(__x86_64__)
+                returned = registers.rip == 0;
+                *result = registers.rax;
+#else
+                returned = registers.pc == 0;
+                *result = registers.regs[0];
+#endif
+                if (!returned) {
+                    fprintf(stderr, "the process crashed during the call\n");
+                }
+                break;
+            }
+            // deliver unrelated signals, group-stops are reported with the event in the high bits
+            const bool isEventStop = (status >> 16) != 0;
+            ptrace(PTRACE_CONT, pid, nullptr,
+                   reinterpret_cast<void*>(static_cast<uintptr_t>(isEventStop ? 0 : signal)));
+        }
+    }
+
+    if (!setRegisters(pid, saved)) {
+        fprintf(stderr, "failed to restore registers: %s\n", strerror(errno));
+        return false;
+    }
+    return returned;
+}
+
+/**
+ * Find a way to dlopen a library in the target, mirroring what heaptrack_env prints for GDB.
+ *
+ * We assume the target uses the same libc as we do, which is the common case.
+ */
+bool dlopenCall(pid_t pid, const char* lib, RemoteCall* call)
+{
+    void* function = nullptr;
+    if (&__libc_dlopen_mode) {
+        // __libc_dlopen_mode was available directly in glibc before libdl got merged into it
+        function = reinterpret_cast<void*>(&__libc_dlopen_mode);
+        call->arguments = {0, 0x80000000 | RTLD_NOW};
+        call->strings = {{0, lib}};
+    } else {
+#ifdef __USE_GNU
+        function = dlsym(RTLD_DEFAULT, "dlmopen");
+        call->arguments = {static_cast<uintptr_t>(LM_ID_BASE), 0, RTLD_NOW};
+        call->strings = {{1, lib}};
+#else
+        function = dlsym(RTLD_DEFAULT, "dlopen");
+        call->arguments = {0, RTLD_NOW};
+        call->strings = {{0, lib}};
+#endif
+    }
+
+    Dl_info info;
+    if (!function || !dladdr(function, &info) || !info.dli_fname) {
+        fprintf(stderr, "failed to find dlopen\n");
+        return false;
+    }
+    const auto start = mappingStart(pid, info.dli_fname);
+    if (!start) {
+        fprintf(stderr, "failed to find %s in the process\n", info.dli_fname);
+        return false;
+    }
+    call->function = start + (static_cast<const char*>(function) - static_cast<const char*>(info.dli_fbase));
+    return true;
+}
+
+bool heaptrackCall(pid_t pid, const char* lib, const char* name, RemoteCall* call)
+{
+    const auto start = mappingStart(pid, lib);
+    const auto offset = symbolOffset(lib, name);
+    if (!start || !offset) {
+        fprintf(stderr, "failed to find %s in the process\n", name);
+        return false;
+    }
+    call->function = start + offset;
+    return true;
+}
+
+bool attach(pid_t pid)
+{
+    if (ptrace(PTRACE_SEIZE, pid, nullptr, nullptr) != 0) {
+        fprintf(stderr, "failed to attach to %d: %s\n", pid, strerror(errno));
+        return false;
+    }
+    int status = 0;
+    if (ptrace(PTRACE_INTERRUPT, pid, nullptr, nullptr) != 0 || waitpid(pid, &status, __WALL) != pid
+        || !WIFSTOPPED(status)) {
+        fprintf(stderr, "failed to stop %d: %s\n", pid, strerror(errno));
+        ptrace(PTRACE_DETACH, pid, nullptr, nullptr);
+        return false;
+    }
+    return true;
+}
+
+int run(pid_t pid, const char* mode, const char* lib, const char* pipe)
+{
+    const bool inject = strcmp(mode, "inject") == 0;
+    if (!inject && strcmp(mode, "stop") != 0) {
+        fprintf(stderr, "unsupported mode %s\n", mode);
+        return EXIT_FAILURE;
+    }
+
+    if (!attach(pid)) {
+        return EXIT_FAILURE;
+    }
+
+    bool success = false;
+    uintptr_t result = 0;
+    RemoteCall call;
+    if (inject) {
+        if (!mappingStart(pid, lib)) {
+            success = dlopenCall(pid, lib, &call) && callFunction(pid, call, &result);
+            if (success && !result) {
+                fprintf(stderr, "failed to dlopen %s in the process\n", lib);
+                success = false;
+            }
+        } else {
+            success = true;
+        }
+        call = {};
+        call.arguments = {0};
+        call.strings = {{0, pipe}};
+        success = success && heaptrackCall(pid, lib, "heaptrack_inject", &call) && callFunction(pid, call, &result);
+    } else {
+        // NOTE: we do not call dlclose, as that has the tendency to trigger crashes in the debuggee
+        success = heaptrackCall(pid, lib, "heaptrack_stop", &call) && callFunction(pid, call, &result);
+    }
+
+    if (ptrace(PTRACE_DETACH, pid, nullptr, nullptr) != 0) {
+        fprintf(stderr, "failed to detach from %d: %s\n", pid, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4 || (strcmp(argv[2], "inject") == 0 && argc != 5)) {
+        fprintf(stderr, "usage: %s PID inject LIBHEAPTRACK_INJECT PIPE\n", argv[0]);
+        fprintf(stderr, "       %s PID stop LIBHEAPTRACK_INJECT\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+#if HEAPTRACK_ATTACH_SUPPORTED
+    return run(atoi(argv[1]), argv[2], argv[3], argc == 5 ? argv[4] : nullptr);
+#else
+    fprintf(stderr, "runtime attaching without GDB is not supported on this architecture\n");
+    return EXIT_FAILURE;
+#endif
+}
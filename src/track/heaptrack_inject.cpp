@@ -111,7 +111,7 @@ struct malloc
     static void* hook(size_t size) noexcept
     {
         auto ptr = original(size);
-        heaptrack_malloc(ptr, size);
+        heaptrack::trackMalloc(ptr, size);
         return ptr;
     }
 };
@@ -123,7 +123,7 @@ struct free
 
     static void hook(void* ptr) noexcept
     {
-        heaptrack_free(ptr);
+        heaptrack::trackFree(ptr);
         original(ptr);
     }
 };
@@ -137,7 +137,7 @@ struct realloc
     {
         auto inPtr = reinterpret_cast<uintptr_t>(ptr);
         auto ret = original(ptr, size);
-        heaptrack_realloc2(inPtr, size, reinterpret_cast<uintptr_t>(ret));
+        heaptrack::trackRealloc2(inPtr, size, reinterpret_cast<uintptr_t>(ret));
 
         return ret;
     }
@@ -151,7 +151,7 @@ struct calloc
     static void* hook(size_t num, size_t size) noexcept
     {
         auto ptr = original(num, size);
-        heaptrack_malloc(ptr, num * size);
+        heaptrack::trackMalloc(ptr, num * size);
         return ptr;
     }
 };
@@ -164,7 +164,7 @@ struct cfree
 
     static void hook(void* ptr) noexcept
     {
-        heaptrack_free(ptr);
+        heaptrack::trackFree(ptr);
         original(ptr);
     }
 };
@@ -210,7 +210,7 @@ struct posix_memalign
     {
         auto ret = original(memptr, alignment, size);
         if (!ret) {
-            heaptrack_malloc(*memptr, size);
+            heaptrack::trackMalloc(*memptr, size);
         }
         return ret;
     }
@@ -225,7 +225,7 @@ struct mi_malloc
     static void* hook(size_t size) noexcept
     {
         auto ptr = original(size);
-        heaptrack_malloc(ptr, size);
+        heaptrack::trackMalloc(ptr, size);
         return ptr;
     }
 };
@@ -237,7 +237,7 @@ struct mi_free
 
     static void hook(void* ptr) noexcept
     {
-        heaptrack_free(ptr);
+        heaptrack::trackFree(ptr);
         original(ptr);
     }
 };
@@ -250,7 +250,7 @@ struct mi_realloc
     static void* hook(void* ptr, size_t size) noexcept
     {
         auto ret = original(ptr, size);
-        heaptrack_realloc(ptr, size, ret);
+        heaptrack::trackRealloc(ptr, size, ret);
         return ret;
     }
 };
@@ -263,7 +263,7 @@ struct mi_calloc
     static void* hook(size_t num, size_t size) noexcept
     {
         auto ptr = original(num, size);
-        heaptrack_malloc(ptr, num * size);
+        heaptrack::trackMalloc(ptr, num * size);
         return ptr;
     }
 };
@@ -211,7 +211,7 @@ void* malloc(size_t size) LIBC_FUN_ATTRS
     }
 
     void* ptr = hooks::malloc(size);
-    heaptrack_malloc(ptr, size);
+    heaptrack::trackMalloc(ptr, size);
     return ptr;
 }
 
@@ -228,7 +228,7 @@ void free(void* ptr) LIBC_FUN_ATTRS
     // call handler before handing over the real free implementation
     // to ensure the ptr is not reused in-between and thus the output
     // stays consistent
-    heaptrack_free(ptr);
+    heaptrack::trackFree(ptr);
 
     hooks::free(ptr);
 }
@@ -242,7 +242,7 @@ void* realloc(void* ptr, size_t size) LIBC_FUN_ATTRS
     void* ret = hooks::realloc(ptr, size);
 
     if (ret) {
-        heaptrack_realloc(ptr, size, ret);
+        heaptrack::trackRealloc(ptr, size, ret);
     }
 
     return ret;
@@ -257,7 +257,7 @@ void* calloc(size_t num, size_t size) LIBC_FUN_ATTRS
     void* ret = hooks::calloc(num, size);
 
     if (ret) {
-        heaptrack_malloc(ret, num * size);
+        heaptrack::trackMalloc(ret, num * size);
     }
 
     return ret;
@@ -274,7 +274,7 @@ void cfree(void* ptr) LIBC_FUN_ATTRS
     // to ensure the ptr is not reused in-between and thus the output
     // stays consistent
     if (ptr) {
-        heaptrack_free(ptr);
+        heaptrack::trackFree(ptr);
     }
 
     hooks::cfree(ptr);
@@ -290,7 +290,7 @@ int posix_memalign(void** memptr, size_t alignment, size_t size) LIBC_FUN_ATTRS
     int ret = hooks::posix_memalign(memptr, alignment, size);
 
     if (!ret) {
-        heaptrack_malloc(*memptr, size);
+        heaptrack::trackMalloc(*memptr, size);
     }
 
     return ret;
@@ -306,7 +306,7 @@ void* aligned_alloc(size_t alignment, size_t size) LIBC_FUN_ATTRS
     void* ret = hooks::aligned_alloc(alignment, size);
 
     if (ret) {
-        heaptrack_malloc(ret, size);
+        heaptrack::trackMalloc(ret, size);
     }
 
     return ret;
@@ -323,7 +323,7 @@ void* valloc(size_t size) LIBC_FUN_ATTRS
     void* ret = hooks::valloc(size);
 
     if (ret) {
-        heaptrack_malloc(ret, size);
+        heaptrack::trackMalloc(ret, size);
     }
 
     return ret;
@@ -380,7 +380,7 @@ void* mi_malloc(size_t size) LIBC_FUN_ATTRS
     }
 
     void* ptr = hooks::mi_malloc(size);
-    heaptrack_malloc(ptr, size);
+    heaptrack::trackMalloc(ptr, size);
     return ptr;
 }
 
@@ -393,7 +393,7 @@ void* mi_realloc(void* ptr, size_t size) LIBC_FUN_ATTRS
     void* ret = hooks::mi_realloc(ptr, size);
 
     if (ret) {
-        heaptrack_realloc(ptr, size, ret);
+        heaptrack::trackRealloc(ptr, size, ret);
     }
 
     return ret;
@@ -408,7 +408,7 @@ void* mi_calloc(size_t num, size_t size) LIBC_FUN_ATTRS
     void* ret = hooks::mi_calloc(num, size);
 
     if (ret) {
-        heaptrack_malloc(ret, num * size);
+        heaptrack::trackMalloc(ret, num * size);
     }
 
     return ret;
@@ -427,7 +427,7 @@ void mi_free(void* ptr) LIBC_FUN_ATTRS
     // call handler before handing over the real free implementation
     // to ensure the ptr is not reused in-between and thus the output
     // stays consistent
-    heaptrack_free(ptr);
+    heaptrack::trackFree(ptr);
 
     hooks::mi_free(ptr);
 }
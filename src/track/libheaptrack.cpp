@@ -14,6 +14,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
 #include <link.h>
 #include <pthread.h>
@@ -30,14 +31,20 @@
 #include <sys/user.h>
 #endif
 #include <sys/file.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cctype>
 #include <cinttypes>
+#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "tracetree.h"
 #include "util/config.h"
@@ -45,6 +52,10 @@
 #include "util/linewriter.h"
 #include "util/macroutils.h"
 
+#if HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
 extern "C" {
 // see upstream "documentation" at:
 // https://github.com/llvm-mirror/compiler-rt/blob/master/include/sanitizer/lsan_interface.h#L76
@@ -61,6 +72,8 @@ __attribute__((weak)) extern void __freeres();
  */
 // #define DEBUG_MALLOC_PTRS
 
+#include <tsl/robin_map.h>
+
 #ifdef DEBUG_MALLOC_PTRS
 #include <tsl/robin_set.h>
 #endif
@@ -90,6 +103,8 @@ pid_t gettid()
 #endif
 }
 
+using heaptrack::t_state;
+
 /**
  * A per-thread handle guard to prevent infinite recursion, which should be
  * acquired before doing any special symbol handling.
@@ -97,21 +112,40 @@ pid_t gettid()
 struct RecursionGuard
 {
     RecursionGuard()
-        : wasLocked(isActive)
+        : wasLocked(t_state.isActive())
     {
-        isActive = true;
+        t_state.setActive(true);
     }
 
     ~RecursionGuard()
     {
-        isActive = wasLocked;
+        t_state.setActive(wasLocked);
     }
 
     const bool wasLocked;
-    static thread_local bool isActive;
 };
 
-thread_local bool RecursionGuard::isActive = false;
+/**
+ * Per-thread buffer for the stack snapshot of the next allocation, when unwinding asynchronously.
+ *
+ * The snapshot is taken outside of the lock and then handed over to the unwind thread,
+ * in exchange for a previously recycled buffer.
+ */
+struct ThreadSnapshot
+{
+    ~ThreadSnapshot()
+    {
+        RecursionGuard guard;
+        Trace::freeSnapshot(snapshot);
+    }
+
+    StackSnapshot* snapshot = nullptr;
+};
+
+thread_local ThreadSnapshot t_threadSnapshot HEAPTRACK_TLS_MODEL;
+
+// true while the forking thread holds the locks it took in prepare_fork, HEAPTRACK_FOLLOW_FORK can change meanwhile
+thread_local bool t_lockedForFork HEAPTRACK_TLS_MODEL = false;
 
 enum DebugVerbosity
 {
@@ -248,6 +282,211 @@ int createFile(const char* fileName)
     return out;
 }
 
+/**
+ * Writes to a named pipe once heaptrack.sh started to read from it, buffering the data until then.
+ *
+ * Opening a named pipe for writing blocks until there is a reader, which forked children would otherwise
+ * have to wait for. Instead we try to open it without blocking whenever data gets written, and only wait
+ * for the reader when the output gets closed.
+ */
+class FifoSink : public LineWriter::Sink
+{
+public:
+    explicit FifoSink(string fileName)
+        : fileName(std::move(fileName))
+    {
+    }
+
+    ~FifoSink()
+    {
+        close();
+    }
+
+    bool write(const char* data, size_t size) override
+    {
+        if (fd == -1 && !open(O_NONBLOCK)) {
+            if (errno != ENXIO) {
+                return false;
+            }
+            pending.append(data, size);
+            return true;
+        }
+        return writeAll(data, size);
+    }
+
+    bool close() override
+    {
+        if (closed) {
+            return true;
+        }
+        closed = true;
+        // wait for the reader, the data buffered for it would get lost otherwise
+        if (fd == -1 && !open(0)) {
+            return false;
+        }
+        const auto ret = ::close(fd);
+        fd = -1;
+        return ret == 0;
+    }
+
+private:
+    bool open(int flags)
+    {
+        fd = ::open(fileName.c_str(), O_WRONLY | O_CLOEXEC | flags);
+        if (fd == -1) {
+            return false;
+        }
+        // once a reader is there, block while the pipe is full like for any other output
+        if (flags & O_NONBLOCK) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        }
+        const auto ret = writeAll(pending.data(), pending.size());
+        string().swap(pending);
+        return ret;
+    }
+
+    bool writeAll(const char* data, size_t size)
+    {
+        while (size) {
+            const auto ret = ::write(fd, data, size);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            } else if (ret < 0) {
+                return false;
+            }
+            data += ret;
+            size -= ret;
+        }
+        return true;
+    }
+
+    string fileName;
+    string pending;
+    int fd = -1;
+    bool closed = false;
+};
+
+using AddressRange = Trace::AddressRange;
+
+/**
+ * Rules to stop unwinding once a backtrace reaches a given module or address range.
+ *
+ * These are read from the HEAPTRACK_STOP_AT environment variable, a colon separated
+ * list of either module name substrings or hexadecimal address ranges such as
+ * `0x1000-0x2000`.
+ */
+struct StopRules
+{
+    StopRules(const char* rules)
+    {
+        if (!rules) {
+            return;
+        }
+
+        std::istringstream stream(rules);
+        string rule;
+        while (getline(stream, rule, ':')) {
+            if (rule.empty()) {
+                continue;
+            }
+            // require the 0x prefix, module names like "cafe-1.so" could otherwise be taken for ranges
+            const auto separator = rule.find('-');
+            if (isHexAddress(rule, 0, separator) && isHexAddress(rule, separator + 1, rule.size())) {
+                const auto start = strtoull(rule.c_str(), nullptr, 16);
+                const auto stop = strtoull(rule.c_str() + separator + 1, nullptr, 16);
+                if (start < stop) {
+                    addressRanges.push_back({static_cast<uintptr_t>(start), static_cast<uintptr_t>(stop)});
+                    continue;
+                }
+            }
+            modules.push_back(rule);
+        }
+    }
+
+    bool matchesModule(const char* fileName) const
+    {
+        return any_of(modules.begin(), modules.end(),
+                      [fileName](const string& module) { return strstr(fileName, module.c_str()); });
+    }
+
+    /// @return true when the characters of @p str in [@p begin, @p end) are a hex number with a 0x prefix
+    static bool isHexAddress(const string& str, size_t begin, size_t end)
+    {
+        if (end == string::npos || end > str.size() || end < begin + 3 || str.compare(begin, 2, "0x") != 0) {
+            return false;
+        }
+        return all_of(str.begin() + begin + 2, str.begin() + end, [](char c) { return isxdigit(static_cast<unsigned char>(c)); });
+    }
+
+    vector<string> modules;
+    vector<AddressRange> addressRanges;
+};
+
+/**
+ * Allocator-internal statistics and the kernel's view of the process memory.
+ *
+ * These are sampled without holding the heaptrack lock, as mallinfo2 takes the locks of the allocator.
+ */
+struct MemoryStats
+{
+    void read(int procSmapsRollup)
+    {
+#if HAVE_MALLINFO2
+        const auto info = mallinfo2();
+        arena = info.arena;
+        mmapped = info.hblkhd;
+        inUse = info.uordblks;
+        freeChunks = info.fordblks;
+        hasAllocatorStats = true;
+#endif
+
+#ifdef __linux__
+        if (procSmapsRollup == -1) {
+            return;
+        }
+        const int BUF_SIZE = 4096;
+        char buf[BUF_SIZE + 1];
+        const auto bytesRead = pread(procSmapsRollup, buf, BUF_SIZE, 0);
+        if (bytesRead <= 0) {
+            return;
+        }
+        buf[bytesRead] = 0;
+        hasProcessStats = readKiB(buf, "\nAnonymous:", &anonymous) && readKiB(buf, "\nPss:", &pss)
+            && readKiB(buf, "\nSwap:", &swap);
+#else
+        (void)procSmapsRollup;
+#endif
+    }
+
+    /// find the @p key in the smaps_rollup contents and parse its value in KiB into @p bytes
+    static bool readKiB(const char* buf, const char* key, size_t* bytes)
+    {
+        const auto* value = strstr(buf, key);
+        if (!value) {
+            return false;
+        }
+        value += strlen(key);
+        char* end = nullptr;
+        const auto kiB = strtoull(value, &end, 10);
+        if (end == value) {
+            return false;
+        }
+        *bytes = static_cast<size_t>(kiB) * 1024;
+        return true;
+    }
+
+    bool hasAllocatorStats = false;
+    size_t arena = 0;
+    size_t mmapped = 0;
+    size_t inUse = 0;
+    size_t freeChunks = 0;
+
+    bool hasProcessStats = false;
+    size_t anonymous = 0;
+    size_t pss = 0;
+    size_t swap = 0;
+};
+
 /**
  * Thread-Safe heaptrack API
  *
@@ -256,6 +495,8 @@ int createFile(const char* fileName)
  */
 class HeapTrack
 {
+    struct LockedData;
+
 public:
     template <typename Op>
     static bool op(const RecursionGuard& /*recursionGuard*/, const Op& op)
@@ -270,6 +511,9 @@ public:
         debugLog<VeryVerboseOutput>("%s", "lock acquired");
 
         HeapTrack heaptrack(locked);
+        if (s_forkedParentData) {
+            heaptrack.reinitializeChild();
+        }
         op(heaptrack);
 
         return true;
@@ -304,8 +548,25 @@ public:
 
             Trace::setup();
 
-            // do not trace forked child processes
-            // TODO: make this configurable
+            if (auto maxDepth = getenv("HEAPTRACK_MAX_DEPTH")) {
+                Trace::setMaxDepth(atoi(maxDepth));
+            }
+
+            if (auto allocatorStats = getenv("HEAPTRACK_ALLOCATOR_STATS")) {
+                s_allocatorStats = atoi(allocatorStats) > 0;
+            }
+
+            if (auto asyncUnwind = getenv("HEAPTRACK_ASYNC_UNWIND")) {
+                const auto stackSizeKiB = atoi(asyncUnwind);
+                if (stackSizeKiB <= 0) {
+                    // disabled
+                } else if (!Trace::canUnwindSnapshots()) {
+                    fprintf(stderr, "WARNING: Asynchronous unwinding is not supported, unwinding synchronously.\n");
+                } else {
+                    s_asyncUnwindStackSize = static_cast<size_t>(stackSizeKiB) * 1024;
+                }
+            }
+
             pthread_atfork(&prepare_fork, &parent_fork, &child_fork);
 
             atexit([]() {
@@ -325,6 +586,31 @@ public:
             });
         });
 
+        // read for every output, the header written below depends on it
+        const auto leaksOnly = getenv("HEAPTRACK_LEAKS_ONLY");
+        s_leaksOnly = leaksOnly && atoi(leaksOnly) > 0;
+
+        // forked child processes are only traced when they get their own output
+        free(const_cast<char*>(s_followForkOutput.exchange(nullptr)));
+        if (auto followFork = getenv("HEAPTRACK_FOLLOW_FORK")) {
+            string output = followFork;
+            if (output.find("$$") == string::npos) {
+                output += ".$$";
+            }
+            s_followForkOutput = strdup(output.c_str());
+        }
+
+        // every output starts with all allocations getting recorded
+        s_samplingRate.store(1, memory_order_relaxed);
+        s_maxSamplingRate = 1;
+        if (auto maxSamplingRate = getenv("HEAPTRACK_MAX_SAMPLING_RATE")) {
+            // only powers of two, such that sampling is a cheap bit mask check
+            while (s_maxSamplingRate * 2 <= static_cast<uint32_t>(max(1, atoi(maxSamplingRate)))
+                   && s_maxSamplingRate < (1u << 30)) {
+                s_maxSamplingRate *= 2;
+            }
+        }
+
         const auto out = createFile(fileName);
 
         if (out == -1) {
@@ -335,12 +621,7 @@ public:
         }
 
         s_data = new LockedData(out, stopCallback);
-
-        writeVersion();
-        writeExe();
-        writeCommandLine();
-        writeSystemInfo();
-        writeSuppressions();
+        writeHeader();
 
         if (initAfterCallback) {
             debugLog<MinimalOutput>("%s", "calling initAfterCallback");
@@ -351,6 +632,18 @@ public:
         debugLog<MinimalOutput>("%s", "initialization done");
     }
 
+    void writeHeader()
+    {
+        writeVersion();
+        writeExe();
+        writeCommandLine();
+        writeSystemInfo();
+        writeSuppressions();
+        if (s_leaksOnly) {
+            s_data->out.write("l\n");
+        }
+    }
+
     void shutdown()
     {
         if (!s_data) {
@@ -359,6 +652,10 @@ public:
 
         debugLog<MinimalOutput>("%s", "shutdown()");
 
+        s_data->stopUnwindThread();
+        handlePendingEvents();
+        writeLeaks();
+
         writeTimestamp();
         writeRSS();
 
@@ -375,12 +672,147 @@ public:
         debugLog<MinimalOutput>("%s", "shutdown() done");
     }
 
+    /**
+     * Unwind and write out all pending events while holding the lock.
+     */
+    void handlePendingEvents()
+    {
+        while (!s_data->pendingEvents.empty()) {
+            const auto event = s_data->pendingEvents.front();
+            Trace trace;
+            if (event.snapshot) {
+                trace.fill(event.snapshot, event.skip);
+            }
+            handlePendingEvent(trace);
+        }
+    }
+
+    /**
+     * Write out the oldest pending event, using the @p trace unwound from its snapshot.
+     */
+    void handlePendingEvent(Trace& trace)
+    {
+        const auto event = s_data->pendingEvents.front();
+        s_data->pendingEvents.pop_front();
+        if (s_numPendingEvents-- == MAX_PENDING_EVENTS) {
+            // wake up the threads blocked in waitForPendingEvents
+            lock_guard<mutex> lock(s_unwindMutex);
+            s_unwindCondition.notify_all();
+        }
+
+        if (event.snapshot) {
+            handleMalloc(event.ptr, event.size, trace, event.tag);
+            // the unwind thread may still read the snapshot outside the lock, it recycles it once done
+            if (event.id != s_data->inFlightEventId) {
+                s_data->freeSnapshots.push_back(event.snapshot);
+            }
+        } else {
+            handleFree(event.ptr);
+        }
+    }
+
     void invalidateModuleCache()
     {
         if (!s_data) {
             return;
         }
         s_data->moduleCacheDirty = true;
+        if (s_asyncUnwindStackSize) {
+            Trace::invalidateSnapshotCache();
+        }
+    }
+
+    /**
+     * Write a named marker (!) or the start of a named phase (>), time stamped to the millisecond.
+     */
+    void writeMarker(char type, const char* name)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        // allocations that are still waiting to be unwound happened before the marker
+        handlePendingEvents();
+
+        writeTimestamp();
+        // a new line would corrupt the data stream, so cut the name off there
+        const auto length = min(strcspn(name, "\n"), size_t(MAX_MARKER_LENGTH));
+        s_data->out.write("%c %zx %.*s\n", type, length, static_cast<int>(length), name);
+    }
+
+    /**
+     * Write the name of a @p tag (G), later allocations only refer to the tag.
+     */
+    void writeTagName(uint32_t tag, const char* name)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        const auto length = min(strcspn(name, "\n"), size_t(MAX_MARKER_LENGTH));
+        s_data->out.write("G %x %zx %.*s\n", tag, length, static_cast<int>(length), name);
+    }
+
+    /**
+     * Write the end of the innermost phase (<).
+     */
+    void writePhaseEnd()
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        handlePendingEvents();
+
+        writeTimestamp();
+        s_data->out.write("<\n");
+    }
+
+    /**
+     * Sample allocations when the application threads spend too much time waiting for the output to be written,
+     * e.g. because heaptrack_interpret or the disk cannot keep up. Full fidelity gets restored once the pressure
+     * goes away again. Every change of the sampling rate gets recorded (D), such that the analyzer knows about it.
+     *
+     * This is called on every tick of the timer thread, @p elapsed since the last one.
+     */
+    void updateSamplingRate(chrono::nanoseconds elapsed)
+    {
+        if (!s_data || !s_data->out.canWrite() || s_maxSamplingRate <= 1) {
+            return;
+        }
+
+        const auto flushTime = s_data->out.totalFlushTime();
+        const auto blocked = flushTime - s_data->lastFlushTime;
+        s_data->lastFlushTime = flushTime;
+
+        auto rate = s_samplingRate.load(memory_order_relaxed);
+        if (blocked * 2 > elapsed) {
+            s_data->relaxedTicks = 0;
+            if (++s_data->congestedTicks < CONGESTED_TICKS || rate >= s_maxSamplingRate) {
+                return;
+            }
+            rate *= 2;
+        } else if (blocked * 20 < elapsed) {
+            s_data->congestedTicks = 0;
+            if (rate == 1 || ++s_data->relaxedTicks < RELAXED_TICKS) {
+                return;
+            }
+            rate /= 2;
+        } else {
+            // only react to sustained pressure
+            s_data->congestedTicks = 0;
+            s_data->relaxedTicks = 0;
+            return;
+        }
+
+        s_data->congestedTicks = 0;
+        s_data->relaxedTicks = 0;
+        s_samplingRate.store(rate, memory_order_relaxed);
+
+        debugLog<MinimalOutput>("sampling every %u. allocation", rate);
+
+        writeTimestamp();
+        s_data->out.writeHexLine('D', rate);
     }
 
     void writeTimestamp()
@@ -444,6 +876,20 @@ public:
         s_data->out.writeHexLine('R', rss);
     }
 
+    void writeMemoryStats(const MemoryStats& stats)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        if (stats.hasAllocatorStats) {
+            s_data->out.writeHexLine('M', stats.arena, stats.mmapped, stats.inUse, stats.freeChunks);
+        }
+        if (stats.hasProcessStats) {
+            s_data->out.writeHexLine('P', stats.anonymous, stats.pss, stats.swap);
+        }
+    }
+
     void writeVersion()
     {
         s_data->out.writeHexLine('v', static_cast<size_t>(HEAPTRACK_VERSION),
@@ -519,59 +965,364 @@ public:
         }
     }
 
-    void handleMalloc(void* ptr, size_t size, const Trace& trace)
+    void handleMalloc(void* ptr, size_t size, Trace& trace, uint32_t tag)
     {
         if (!s_data || !s_data->out.canWrite()) {
             return;
         }
-        updateModuleCache();
-
-        const auto index = s_data->traceTree.index(trace, [](uintptr_t ip, uint32_t index) {
-            // decrement addresses by one - otherwise we misattribute the cost to the wrong instruction
-            // for some reason, it seems like we always get the instruction _after_ the one we are interested in
-            // see also: https://github.com/libunwind/libunwind/issues/287
-            // and https://bugs.kde.org/show_bug.cgi?id=439897
-            --ip;
-
-            return s_data->out.writeHexLine('t', ip, index);
-        });
-
-#ifdef DEBUG_MALLOC_PTRS
-        auto it = s_data->known.find(ptr);
-        assert(it == s_data->known.end());
-        s_data->known.insert(ptr);
-#endif
 
-        s_data->out.writeHexLine('+', size, index, reinterpret_cast<uintptr_t>(ptr));
+        writeMalloc(ptr, size, writeTrace(trace), nullptr, tag);
     }
 
-    void handleFree(void* ptr)
+    /**
+     * Write out @p count allocations that share the same @p trace, optionally tied to an @p arena.
+     */
+    void handleMallocBatch(void* arena, void* const* ptrs, const size_t* sizes, size_t count, Trace& trace,
+                           uint32_t tag)
     {
         if (!s_data || !s_data->out.canWrite()) {
             return;
         }
 
-#ifdef DEBUG_MALLOC_PTRS
-        auto it = s_data->known.find(ptr);
-        assert(it != s_data->known.end());
-        s_data->known.erase(it);
-#endif
+        // pending frees could refer to the pointers that get reused here
+        handlePendingEvents();
 
-        s_data->out.writeHexLine('-', reinterpret_cast<uintptr_t>(ptr));
+        const auto index = writeTrace(trace);
+        for (size_t i = 0; i < count; ++i) {
+            if (ptrs[i]) {
+                writeMalloc(ptrs[i], sizes[i], index, arena, tag);
+            }
+        }
     }
 
-    static bool isPaused()
+    void handleFreeBatch(void* const* ptrs, size_t count)
     {
-        return s_paused;
-    }
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
 
-    static void setPaused(bool state)
-    {
-        s_paused = state;
+        handlePendingEvents();
+
+        for (size_t i = 0; i < count; ++i) {
+            if (ptrs[i]) {
+                handleFree(ptrs[i]);
+            }
+        }
     }
 
-private:
-    static int dl_iterate_phdr_callback(struct dl_phdr_info* info, size_t /*size*/, void* data)
+    /**
+     * Release all allocations that are tied to the @p arena with a single record.
+     */
+    void handleArenaReset(void* arena)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        handlePendingEvents();
+
+        if (s_leaksOnly) {
+            // only tell the interpreter about the reset when it knows about some of the allocations
+            bool anyWritten = false;
+            auto& live = s_data->liveAllocations;
+            for (auto it = live.begin(); it != live.end();) {
+                if (it->second.arena == reinterpret_cast<uintptr_t>(arena)) {
+                    anyWritten |= it->second.written;
+                    it = live.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if (!anyWritten) {
+                return;
+            }
+        }
+
+        s_data->out.writeHexLine('r', reinterpret_cast<uintptr_t>(arena));
+    }
+
+    /**
+     * Write out the allocations that are still alive in leak-only mode,
+     * together with the parts of the trace tree they need.
+     *
+     * Allocations that get freed afterwards are written out as such, so this can be called repeatedly.
+     */
+    void writeLeaks()
+    {
+        if (!s_leaksOnly || !s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        handlePendingEvents();
+
+        writeTimestamp();
+        for (auto it = s_data->liveAllocations.begin(); it != s_data->liveAllocations.end(); ++it) {
+            auto& allocation = it.value();
+            if (allocation.written) {
+                continue;
+            }
+            allocation.written = true;
+            writeMallocLine(reinterpret_cast<void*>(it->first), allocation.size, writeTraceEntry(allocation.traceIndex),
+                            reinterpret_cast<void*>(allocation.arena), allocation.tag);
+        }
+    }
+
+    /**
+     * Write out the @p trace, if it was not encountered before.
+     *
+     * @return the index of the trace, to be referenced by the allocations
+     */
+    uint32_t writeTrace(Trace& trace)
+    {
+        if (updateModuleCache()) {
+            // the trace may have been unwound before the stop ranges of newly loaded modules were known
+            applyStopRanges(trace);
+        }
+
+        return s_data->traceTree.index(trace, [](uintptr_t ip, uint32_t index) {
+            // decrement addresses by one - otherwise we misattribute the cost to the wrong instruction
+            // for some reason, it seems like we always get the instruction _after_ the one we are interested in
+            // see also: https://github.com/libunwind/libunwind/issues/287
+            // and https://bugs.kde.org/show_bug.cgi?id=439897
+            if (ip != Trace::TRUNCATION_MARKER) {
+                --ip;
+            }
+
+            if (s_leaksOnly) {
+                // only written out once a leaked allocation needs it, see writeTraceEntry
+                s_data->traceEntries.push_back({ip, index, 0});
+                return true;
+            }
+
+            return s_data->out.writeHexLine('t', ip, index);
+        });
+    }
+
+    /**
+     * Write out the trace tree entry with the given @p index and all its parents, if not done already.
+     *
+     * @return the index of the entry in the output, which differs from the index in the trace tree
+     */
+    uint32_t writeTraceEntry(uint32_t index)
+    {
+        // the parents have smaller indices, so collect the chain up to the first written entry and write it top-down
+        auto& chain = s_data->traceChain;
+        chain.clear();
+        while (index && !s_data->traceEntries[index - 1].outputIndex) {
+            chain.push_back(index);
+            index = s_data->traceEntries[index - 1].parentIndex;
+        }
+
+        uint32_t outputIndex = index ? s_data->traceEntries[index - 1].outputIndex : 0;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            auto& entry = s_data->traceEntries[*it - 1];
+            s_data->out.writeHexLine('t', entry.ip, outputIndex);
+            entry.outputIndex = s_data->nextTraceOutputIndex++;
+            outputIndex = entry.outputIndex;
+        }
+        return outputIndex;
+    }
+
+    void writeMalloc(void* ptr, size_t size, uint32_t index, void* arena, uint32_t tag)
+    {
+#ifdef DEBUG_MALLOC_PTRS
+        auto it = s_data->known.find(ptr);
+        assert(it == s_data->known.end());
+        s_data->known.insert(ptr);
+#endif
+
+        if (s_leaksOnly) {
+            s_data->liveAllocations[reinterpret_cast<uintptr_t>(ptr)] = {
+                size, reinterpret_cast<uintptr_t>(arena), index, tag, false};
+            return;
+        }
+
+        writeMallocLine(ptr, size, index, arena, tag);
+    }
+
+    void writeMallocLine(void* ptr, size_t size, uint32_t index, void* arena, uint32_t tag)
+    {
+        // the tag rarely changes between allocations, so only write it out when it does
+        if (tag != s_data->lastTag) {
+            s_data->out.writeHexLine('g', tag);
+            s_data->lastTag = tag;
+        }
+
+        if (arena) {
+            s_data->out.writeHexLine('+', size, index, reinterpret_cast<uintptr_t>(ptr),
+                                     reinterpret_cast<uintptr_t>(arena));
+        } else {
+            s_data->out.writeHexLine('+', size, index, reinterpret_cast<uintptr_t>(ptr));
+        }
+    }
+
+    /**
+     * Queue an allocation for asynchronous unwinding of the snapshot in @p snapshot,
+     * which gets replaced by a recycled buffer.
+     */
+    void queueMalloc(void* ptr, size_t size, int skip, StackSnapshot*& snapshot, uint32_t tag)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        s_data->pendingEvents.push_back({s_data->nextEventId++, ptr, size, skip, snapshot, tag});
+        ++s_numPendingEvents;
+        snapshot = s_data->takeSnapshot();
+        if (s_data->pendingEvents.size() == 1) {
+            // the threads in waitForPendingEvents share the condition, so wake them all
+            s_unwindCondition.notify_all();
+        }
+    }
+
+    /**
+     * Like handleFree, but ensures the free gets written after all pending allocations.
+     */
+    void queueFree(void* ptr)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        if (s_data->pendingEvents.empty()) {
+            handleFree(ptr);
+            return;
+        }
+
+        s_data->pendingEvents.push_back({s_data->nextEventId++, ptr, 0, 0, nullptr});
+        ++s_numPendingEvents;
+    }
+
+    void handleFree(void* ptr)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+#ifdef DEBUG_MALLOC_PTRS
+        auto it = s_data->known.find(ptr);
+        assert(it != s_data->known.end());
+        s_data->known.erase(it);
+#endif
+
+        if (s_leaksOnly) {
+            auto it = s_data->liveAllocations.find(reinterpret_cast<uintptr_t>(ptr));
+            if (it == s_data->liveAllocations.end()) {
+                return;
+            }
+            const bool written = it->second.written;
+            s_data->liveAllocations.erase(it);
+            if (!written) {
+                return;
+            }
+        }
+
+        s_data->out.writeHexLine('-', reinterpret_cast<uintptr_t>(ptr));
+    }
+
+    static bool isTracking()
+    {
+        return heaptrack::isTracking();
+    }
+
+    /**
+     * While the output cannot keep up, we only record every n-th allocation of each thread.
+     * All deallocations still get written, heaptrack_interpret ignores those of unknown pointers.
+     *
+     * @return true when the allocation should not be recorded
+     */
+    static bool isSampledOut()
+    {
+        const auto rate = s_samplingRate.load(memory_order_relaxed);
+        return rate > 1 && (++t_state.allocations & (rate - 1)) != 0;
+    }
+
+    /**
+     * Size of the stack snapshots to take when unwinding asynchronously,
+     * or zero when we unwind synchronously in the allocating thread.
+     */
+    static size_t asyncUnwindStackSize()
+    {
+        return s_asyncUnwindStackSize;
+    }
+
+    /**
+     * Block the calling thread while too many events are waiting to be unwound.
+     */
+    static void waitForPendingEvents()
+    {
+        if (s_numPendingEvents < MAX_PENDING_EVENTS) {
+            return;
+        }
+        unique_lock<mutex> lock(s_unwindMutex);
+        s_unwindCondition.wait(lock, [] { return s_numPendingEvents < MAX_PENDING_EVENTS; });
+    }
+
+    static void setPaused(bool state)
+    {
+        using heaptrack::ThreadState;
+        auto epoch = heaptrack::s_epoch.load(memory_order_relaxed);
+        uint32_t next = 0;
+        do {
+            next = (epoch & ~ThreadState::PAUSED) + ThreadState::EPOCH_STEP;
+            if (state) {
+                next |= ThreadState::PAUSED;
+            }
+        } while (!heaptrack::s_epoch.compare_exchange_weak(epoch, next, memory_order_relaxed));
+    }
+
+private:
+    /**
+     * Write the GNU build-id of the module as a `B` line, which applies to the preceding `m` line.
+     *
+     * The notes are part of a loaded segment, so we can read them straight from memory.
+     */
+    static bool writeBuildId(LineWriter& out, const struct dl_phdr_info* info)
+    {
+        // the note header consists of 32bit words for both, ELF32 and ELF64
+        struct NoteHeader
+        {
+            uint32_t nameSize;
+            uint32_t descSize;
+            uint32_t type;
+        };
+        const uint32_t NT_GNU_BUILD_ID_TYPE = 3;
+        auto align4 = [](size_t size) { return (size + 3) & ~size_t(3); };
+
+        for (int i = 0; i < info->dlpi_phnum; i++) {
+            const auto& phdr = info->dlpi_phdr[i];
+            if (phdr.p_type != PT_NOTE) {
+                continue;
+            }
+            auto note = reinterpret_cast<const char*>(info->dlpi_addr + phdr.p_vaddr);
+            const auto notesEnd = note + phdr.p_memsz;
+            while (note + sizeof(NoteHeader) <= notesEnd) {
+                const auto* header = reinterpret_cast<const NoteHeader*>(note);
+                const auto* name = note + sizeof(NoteHeader);
+                const auto* desc = name + align4(header->nameSize);
+                note = desc + align4(header->descSize);
+                if (note > notesEnd) {
+                    break;
+                }
+                if (header->type != NT_GNU_BUILD_ID_TYPE || header->nameSize != 4 || memcmp(name, "GNU", 4) != 0
+                    || !header->descSize || header->descSize > 64) {
+                    continue;
+                }
+
+                char buildId[128];
+                static const char hexChars[] = "0123456789abcdef";
+                for (uint32_t j = 0; j < header->descSize; ++j) {
+                    const auto byte = static_cast<unsigned char>(desc[j]);
+                    buildId[2 * j] = hexChars[byte >> 4];
+                    buildId[2 * j + 1] = hexChars[byte & 0xf];
+                }
+                return out.write("B %x %.*s\n", 2 * header->descSize, static_cast<int>(2 * header->descSize), buildId);
+            }
+        }
+        return true;
+    }
+
+    static int dl_iterate_phdr_callback(struct dl_phdr_info* info, size_t /*size*/, void* data)
     {
         auto heaptrack = reinterpret_cast<HeapTrack*>(data);
         const char* fileName = info->dlpi_name;
@@ -598,21 +1349,66 @@ private:
             return 1;
         }
 
+        if (!writeBuildId(heaptrack->s_data->out, info)) {
+            return 1;
+        }
+
+        if (heaptrack->s_data->stopRules.matchesModule(fileName)) {
+            for (int i = 0; i < info->dlpi_phnum; i++) {
+                const auto& phdr = info->dlpi_phdr[i];
+                if (phdr.p_type == PT_LOAD) {
+                    const auto start = info->dlpi_addr + phdr.p_vaddr;
+                    heaptrack->s_data->stopRanges.push_back({start, start + phdr.p_memsz});
+                }
+            }
+        }
+
         return 0;
     }
 
+    /**
+     * Truncate the trace after the first frame that lies within one of the stop ranges
+     */
+    void applyStopRanges(Trace& trace)
+    {
+        const auto& ranges = s_data->stopRanges;
+        if (ranges.empty()) {
+            return;
+        }
+
+        for (int i = 0; i < trace.size() - 1; ++i) {
+            const auto ip = reinterpret_cast<uintptr_t>(trace[i]);
+            if (any_of(ranges.begin(), ranges.end(), [ip](const AddressRange& range) { return range.contains(ip); })) {
+                trace.truncate(i + 1);
+                return;
+            }
+        }
+    }
+
     static void prepare_fork()
     {
         debugLog<MinimalOutput>("%s", "prepare_fork()");
         // don't do any custom malloc handling while inside fork
-        RecursionGuard::isActive = true;
+        t_state.setActive(true);
+        if (s_followForkOutput) {
+            // ensure no other thread is in the middle of writing data when we fork
+            // otherwise the child could inherit a locked mutex and inconsistent data
+            s_lock.lock();
+            s_unwindMutex.lock();
+            t_lockedForFork = true;
+        }
     }
 
     static void parent_fork()
     {
         debugLog<MinimalOutput>("%s", "parent_fork()");
+        if (t_lockedForFork) {
+            t_lockedForFork = false;
+            s_unwindMutex.unlock();
+            s_lock.unlock();
+        }
         // the parent process can now continue its custom malloc tracking
-        RecursionGuard::isActive = false;
+        t_state.setActive(false);
     }
 
     static void child_fork()
@@ -620,21 +1416,87 @@ private:
         debugLog<MinimalOutput>("%s", "child_fork()");
         // but the forked child process cleans up itself
         // this is important to prevent two processes writing to the same file
+        auto parentData = s_data;
         s_data = nullptr;
-        RecursionGuard::isActive = true;
+        t_state.setActive(true);
+
+        if (!t_lockedForFork) {
+            return;
+        }
+        t_lockedForFork = false;
+        s_unwindMutex.unlock();
+
+        {
+            // we inherited the lock from prepare_fork, the destructor releases it again
+            HeapTrack heaptrack(LockStatus(true));
+            // the parent's events cannot be written anymore, and nobody may wait for them
+            s_numPendingEvents = 0;
+            // initializing the child is deferred to its first call into heaptrack, which keeps the fork handler
+            // cheap and children that exec right away without allocating anything don't get an output
+            s_forkedParentData = parentData;
+        }
+        t_state.setActive(!parentData);
+    }
+
+    /**
+     * Continue tracing a forked child process, writing its data to a new output file.
+     *
+     * The parent's data got copied into the child on fork, which the child must not write to.
+     */
+    void reinitializeChild()
+    {
+        auto* parentData = s_forkedParentData;
+        s_forkedParentData = nullptr;
+
+        // the threads of the parent do not exist in the child, so we cannot cleanly destroy its data
+        // instead we intentionally leak it, but close the files without flushing the parent's buffered data
+        parentData->out.close();
+        if (parentData->procStatm != -1) {
+            close(parentData->procStatm);
+        }
+
+        string fileName = s_followForkOutput.load();
+        replaceAll(fileName, "$$", to_string(getpid()));
+        if (!parentData->outputIsFifo) {
+            // the child inherits all allocations of its parent, which is similar to attaching at runtime
+            initialize(
+                fileName.c_str(), nullptr, [](LineWriter& out) { out.write("A\n"); }, parentData->stopCallback);
+        } else if (mkfifo(fileName.c_str(), 0600) != 0 && errno != EEXIST) {
+            fprintf(stderr, "WARNING: Failed to create named pipe %s for forked child: %s, not tracing it.\n",
+                    fileName.c_str(), strerror(errno));
+        } else {
+            // heaptrack.sh starts reading from the named pipe once it shows up, but we don't wait for that
+            s_data = new LockedData(-1, parentData->stopCallback);
+            s_data->out.setSink(unique_ptr<LineWriter::Sink>(new FifoSink(fileName)));
+            s_data->outputIsFifo = true;
+            writeHeader();
+            s_data->out.write("A\n");
+        }
+
+        if (!s_data) {
+            // don't bother unwinding the allocations of a child that we cannot trace
+            setPaused(true);
+        }
     }
 
-    void updateModuleCache()
+    /**
+     * @return true when the module cache got updated
+     */
+    bool updateModuleCache()
     {
         if (!s_data || !s_data->out.canWrite() || !s_data->moduleCacheDirty) {
-            return;
+            return false;
         }
         debugLog<MinimalOutput>("%s", "updateModuleCache()");
         if (!s_data->out.write("m 1 -\n")) {
-            return;
+            return false;
         }
+        s_data->stopRanges = s_data->stopRules.addressRanges;
         dl_iterate_phdr(&dl_iterate_phdr_callback, this);
+        // the unwinding checks the stop ranges, such that it can stop early
+        Trace::setStopRanges(s_data->stopRanges);
         s_data->moduleCacheDirty = false;
+        return true;
     }
 
     void writeError()
@@ -691,15 +1553,27 @@ private:
     {
         LockedData(int out, heaptrack_callback_t stopCallback)
             : out(out)
+            , stopRules(getenv("HEAPTRACK_STOP_AT"))
             , stopCallback(stopCallback)
         {
 
             debugLog<MinimalOutput>("%s", "constructing LockedData");
+
+            struct stat outStat;
+            outputIsFifo = fstat(out, &outStat) == 0 && S_ISFIFO(outStat.st_mode);
+
 #ifdef __linux__
             procStatm = open("/proc/self/statm", O_RDONLY);
             if (procStatm == -1) {
                 fprintf(stderr, "WARNING: Failed to open /proc/self/statm for reading: %s.\n", strerror(errno));
             }
+            if (s_allocatorStats) {
+                procSmapsRollup = open("/proc/self/smaps_rollup", O_RDONLY);
+                if (procSmapsRollup == -1) {
+                    fprintf(stderr, "WARNING: Failed to open /proc/self/smaps_rollup for reading: %s.\n",
+                            strerror(errno));
+                }
+            }
 #endif
 
             // ensure this utility thread is not handling any signals
@@ -717,25 +1591,101 @@ private:
 
             // the mask we set above will be inherited by the thread that we spawn below
             timerThread = std::thread([&]() {
-                RecursionGuard::isActive = true;
+                t_state.setActive(true);
                 debugLog<MinimalOutput>("%s", "timer thread started");
 
                 // now loop and repeatedly print the timestamp and RSS usage to the data stream
+                uint64_t ticks = 0;
+                auto lastTick = chrono::steady_clock::now();
                 while (!stopTimerThread) {
                     // TODO: make interval customizable
                     this_thread::sleep_for(chrono::milliseconds(10));
 
+                    // the allocator statistics are more expensive to gather, so sample them less often
+                    // and do it before taking our lock, as mallinfo2 takes the locks of the allocator
+                    const auto tick = ticks++;
+                    const bool sampleMemoryStats = s_allocatorStats && (tick % MEMORY_STATS_INTERVAL) == 0;
+                    MemoryStats memoryStats;
+                    if (sampleMemoryStats) {
+                        memoryStats.read(procSmapsRollup);
+                    }
+
                     const auto locked = tryLock([&] { return stopTimerThread.load(); });
                     if (!locked) {
                         break;
                     }
 
                     HeapTrack heaptrack(locked);
-                    heaptrack.writeTimestamp();
-                    heaptrack.writeRSS();
+                    Trace::reclaimStopRanges();
+                    const auto now = chrono::steady_clock::now();
+                    heaptrack.updateSamplingRate(now - lastTick);
+                    lastTick = now;
+                    // in leak-only mode, the time series is only good for orientation, so keep it coarse
+                    if (!s_leaksOnly || (tick % LEAKS_ONLY_TIMESTAMP_INTERVAL) == 0) {
+                        heaptrack.writeTimestamp();
+                        heaptrack.writeRSS();
+                    }
+                    if (sampleMemoryStats) {
+                        heaptrack.writeMemoryStats(memoryStats);
+                    }
                 }
             });
 
+            if (s_asyncUnwindStackSize) {
+                unwindThread = std::thread([&]() {
+                    t_state.setActive(true);
+                    debugLog<MinimalOutput>("%s", "unwind thread started");
+
+                    auto stopCheck = [&] { return stopUnwinding.load(); };
+                    while (!stopUnwinding) {
+                        PendingEvent event;
+                        {
+                            const auto locked = tryLock(stopCheck);
+                            if (!locked) {
+                                break;
+                            }
+                            HeapTrack heaptrack(locked);
+                            if (pendingEvents.empty()) {
+                                event.id = UINT64_MAX;
+                            } else {
+                                event = pendingEvents.front();
+                                if (event.snapshot) {
+                                    // keep the snapshot from getting recycled while we unwind it
+                                    inFlightEventId = event.id;
+                                    inFlightSnapshot = event.snapshot;
+                                }
+                            }
+                        }
+
+                        if (event.id == UINT64_MAX) {
+                            unique_lock<mutex> lock(s_unwindMutex);
+                            s_unwindCondition.wait_for(lock, chrono::milliseconds(10));
+                            continue;
+                        }
+
+                        // the expensive part happens outside the lock, allowing other threads to continue
+                        Trace trace;
+                        if (event.snapshot) {
+                            trace.fill(event.snapshot, event.skip);
+                        }
+
+                        const auto locked = tryLock(stopCheck);
+                        if (!locked) {
+                            break;
+                        }
+                        HeapTrack heaptrack(locked);
+                        inFlightEventId = UINT64_MAX;
+                        inFlightSnapshot = nullptr;
+                        if (!pendingEvents.empty() && pendingEvents.front().id == event.id) {
+                            heaptrack.handlePendingEvent(trace);
+                        } else if (event.snapshot) {
+                            // handlePendingEvents wrote the event meanwhile and left the snapshot to us
+                            freeSnapshots.push_back(event.snapshot);
+                        }
+                    }
+                });
+            }
+
             // now restore the previous mask as if nothing ever happened
             if (pthread_sigmask(SIG_SETMASK, &previousMask, nullptr) != 0) {
                 fprintf(stderr, "WARNING: Failed to restore the signal mask.\n");
@@ -753,12 +1703,29 @@ private:
                 }
             }
 
+            stopUnwindThread();
+            for (const auto& event : pendingEvents) {
+                Trace::freeSnapshot(event.snapshot);
+            }
+            s_numPendingEvents -= pendingEvents.size();
+            {
+                lock_guard<mutex> lock(s_unwindMutex);
+                s_unwindCondition.notify_all();
+            }
+            for (auto* snapshot : freeSnapshots) {
+                Trace::freeSnapshot(snapshot);
+            }
+
             out.close();
 
             if (procStatm != -1) {
                 close(procStatm);
             }
 
+            if (procSmapsRollup != -1) {
+                close(procSmapsRollup);
+            }
+
             if (stopCallback && (!s_atexit || s_forceCleanup)) {
                 stopCallback();
             }
@@ -770,6 +1737,9 @@ private:
         /// /proc/self/statm file descriptor to read RSS value from
         int procStatm = -1;
 
+        /// /proc/self/smaps_rollup file descriptor, only read by the timer thread when sampling memory statistics
+        int procSmapsRollup = -1;
+
         /**
          * Calls to dlopen/dlclose mark the cache as dirty.
          * When this happened, all modules and their section addresses
@@ -779,13 +1749,110 @@ private:
          */
         bool moduleCacheDirty = true;
 
+        /// backtraces get truncated once they reach any of these rules
+        StopRules stopRules;
+        /// the address ranges of the stop rules, updated together with the module cache
+        vector<AddressRange> stopRanges;
+
         TraceTree traceTree;
 
         atomic<bool> stopTimerThread {false};
         std::thread timerThread;
 
+        /// stop the unwind thread, which can be called while holding the lock
+        void stopUnwindThread()
+        {
+            stopUnwinding = true;
+            s_unwindCondition.notify_all();
+            if (unwindThread.joinable()) {
+                try {
+                    unwindThread.join();
+                } catch (const std::system_error&) {
+                }
+            }
+            if (inFlightSnapshot) {
+                // the thread stopped before it could hand back the snapshot of an event that got written meanwhile
+                const bool pending = any_of(pendingEvents.begin(), pendingEvents.end(),
+                                            [this](const PendingEvent& event) { return event.id == inFlightEventId; });
+                if (!pending) {
+                    freeSnapshots.push_back(inFlightSnapshot);
+                }
+                inFlightEventId = UINT64_MAX;
+                inFlightSnapshot = nullptr;
+            }
+        }
+
+        /// @return a recycled snapshot buffer, or a new one if none is available
+        StackSnapshot* takeSnapshot()
+        {
+            if (freeSnapshots.empty()) {
+                return Trace::allocateSnapshot(s_asyncUnwindStackSize);
+            }
+            auto* snapshot = freeSnapshots.back();
+            freeSnapshots.pop_back();
+            return snapshot;
+        }
+
+        struct PendingEvent
+        {
+            uint64_t id = 0;
+            void* ptr = nullptr;
+            size_t size = 0;
+            int skip = 0;
+            /// the snapshot to unwind for allocations, or nullptr for deallocations
+            StackSnapshot* snapshot = nullptr;
+            uint32_t tag = 0;
+        };
+        /// events waiting to be written in order, once the allocations got unwound
+        deque<PendingEvent> pendingEvents;
+        uint64_t nextEventId = 0;
+        vector<StackSnapshot*> freeSnapshots;
+        /// the event whose snapshot the unwind thread currently reads outside the lock, if any
+        uint64_t inFlightEventId = UINT64_MAX;
+        StackSnapshot* inFlightSnapshot = nullptr;
+
+        atomic<bool> stopUnwinding {false};
+        std::thread unwindThread;
+
         heaptrack_callback_t stopCallback = nullptr;
 
+        /// true when we write to a named pipe, used to decide how forked children write their data
+        bool outputIsFifo = false;
+
+        /// the tag of the last allocation we wrote out
+        uint32_t lastTag = 0;
+
+        struct LiveAllocation
+        {
+            uint64_t size;
+            uintptr_t arena;
+            uint32_t traceIndex;
+            uint32_t tag;
+            /// true once writeLeaks wrote the allocation out, its deallocation must then be written too
+            bool written;
+        };
+        /// in leak-only mode: the allocations that did not get freed yet, indexed by their address
+        tsl::robin_map<uintptr_t, LiveAllocation> liveAllocations;
+
+        struct TraceEntry
+        {
+            uintptr_t ip;
+            uint32_t parentIndex;
+            /// the index of the entry in the output once it got written, or zero
+            uint32_t outputIndex;
+        };
+        /// in leak-only mode: the trace tree entries, indexed by their trace tree index minus one
+        vector<TraceEntry> traceEntries;
+        uint32_t nextTraceOutputIndex = 1;
+        /// scratch space for writeTraceEntry
+        vector<uint32_t> traceChain;
+
+        /// the total flush time of the output when the sampling rate got updated last
+        chrono::nanoseconds lastFlushTime {0};
+        /// number of consecutive ticks of the timer thread with high and low pressure on the output, respectively
+        uint32_t congestedTicks = 0;
+        uint32_t relaxedTicks = 0;
+
 #ifdef DEBUG_MALLOC_PTRS
         tsl::robin_set<void*> known;
 #endif
@@ -795,21 +1862,94 @@ private:
     static LockedData* s_data;
 
 private:
-    static std::atomic<bool> s_paused;
+    /// limits the memory consumed by stack snapshots, when the unwind thread cannot keep up
+    static constexpr const size_t MAX_PENDING_EVENTS = 256;
+    /// names of markers and phases get truncated to this length
+    static constexpr const size_t MAX_MARKER_LENGTH = 1024;
+    static size_t s_asyncUnwindStackSize;
+    static std::atomic<size_t> s_numPendingEvents;
+    /// wakes up the unwind thread when events got queued, and the threads waiting for pending events to drain
+    static std::mutex s_unwindMutex;
+    static std::condition_variable s_unwindCondition;
+
+    /// sample the allocator statistics and smaps_rollup every n-th tick of the timer thread
+    static constexpr const uint64_t MEMORY_STATS_INTERVAL = 10;
+    static bool s_allocatorStats;
+
+    /// only keep track of the live allocations in-process and write out those that are leaked in the end
+    static bool s_leaksOnly;
+    /// write the timestamp and RSS only every n-th tick of the timer thread in leak-only mode
+    static constexpr const uint64_t LEAKS_ONLY_TIMESTAMP_INTERVAL = 100;
+
+    /// only every n-th allocation gets recorded, a power of two that gets raised while the output cannot keep up
+    static std::atomic<uint32_t> s_samplingRate;
+    /// sampling is opt-in via HEAPTRACK_MAX_SAMPLING_RATE, by default all allocations get recorded
+    static uint32_t s_maxSamplingRate;
+    /// the number of ticks of the timer thread with high pressure before the sampling rate gets raised
+    static constexpr const uint32_t CONGESTED_TICKS = 5;
+    /// the number of ticks of the timer thread without pressure before the sampling rate gets lowered again
+    static constexpr const uint32_t RELAXED_TICKS = 100;
+
+    /// output file name template for forked child processes, or nullptr when they should not be traced
+    static std::atomic<const char*> s_followForkOutput;
+    /// in a forked child process that did not call into heaptrack yet: the data inherited from its parent
+    static LockedData* s_forkedParentData;
 };
 
 std::mutex HeapTrack::s_lock;
 HeapTrack::LockedData* HeapTrack::s_data {nullptr};
-std::atomic<bool> HeapTrack::s_paused {false};
+size_t HeapTrack::s_asyncUnwindStackSize {0};
+std::atomic<size_t> HeapTrack::s_numPendingEvents {0};
+std::mutex HeapTrack::s_unwindMutex;
+std::condition_variable HeapTrack::s_unwindCondition;
+bool HeapTrack::s_allocatorStats {false};
+bool HeapTrack::s_leaksOnly {false};
+std::atomic<uint32_t> HeapTrack::s_samplingRate {1};
+uint32_t HeapTrack::s_maxSamplingRate {1};
+std::atomic<const char*> HeapTrack::s_followForkOutput {nullptr};
+HeapTrack::LockedData* HeapTrack::s_forkedParentData {nullptr};
+}
+
+__thread heaptrack::ThreadState heaptrack::t_state HEAPTRACK_TLS_MODEL;
+std::atomic<uint32_t> heaptrack::s_epoch {0};
+
+static StackSnapshot*& threadSnapshot()
+{
+    auto& snapshot = t_threadSnapshot.snapshot;
+    if (!snapshot) {
+        snapshot = Trace::allocateSnapshot(HeapTrack::asyncUnwindStackSize());
+    }
+    return snapshot;
 }
 
 static void heaptrack_realloc_impl(void* ptr_in, size_t size, void* ptr_out)
 {
-    if (!HeapTrack::isPaused() && ptr_out && !RecursionGuard::isActive) {
+    if (ptr_out && HeapTrack::isTracking()) {
         RecursionGuard guard;
 
         debugLog<VeryVerboseOutput>("heaptrack_realloc(%p, %zu, %p)", ptr_in, size, ptr_out);
 
+        if (HeapTrack::isSampledOut()) {
+            if (ptr_in) {
+                HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.queueFree(ptr_in); });
+            }
+            return;
+        }
+
+        if (HeapTrack::asyncUnwindStackSize()) {
+            HeapTrack::waitForPendingEvents();
+            auto& snapshot = threadSnapshot();
+            if (Trace::captureSnapshot(snapshot)) {
+                HeapTrack::op(guard, [&](HeapTrack& heaptrack) {
+                    if (ptr_in) {
+                        heaptrack.queueFree(ptr_in);
+                    }
+                    heaptrack.queueMalloc(ptr_out, size, 2 + HEAPTRACK_DEBUG_BUILD * 3, snapshot, t_state.tag);
+                });
+                return;
+            }
+        }
+
         Trace trace;
         trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 3);
 
@@ -817,7 +1957,7 @@ static void heaptrack_realloc_impl(void* ptr_in, size_t size, void* ptr_out)
             if (ptr_in) {
                 heaptrack.handleFree(ptr_in);
             }
-            heaptrack.handleMalloc(ptr_out, size, trace);
+            heaptrack.handleMalloc(ptr_out, size, trace, t_state.tag);
         });
     }
 }
@@ -869,26 +2009,76 @@ void heaptrack_resume()
 
 void heaptrack_malloc(void* ptr, size_t size)
 {
-    if (!HeapTrack::isPaused() && ptr && !RecursionGuard::isActive) {
+    if (ptr && HeapTrack::isTracking() && !HeapTrack::isSampledOut()) {
         RecursionGuard guard;
 
         debugLog<VeryVerboseOutput>("heaptrack_malloc(%p, %zu)", ptr, size);
 
+        if (HeapTrack::asyncUnwindStackSize()) {
+            HeapTrack::waitForPendingEvents();
+            auto& snapshot = threadSnapshot();
+            if (Trace::captureSnapshot(snapshot)) {
+                HeapTrack::op(guard, [&](HeapTrack& heaptrack) {
+                    heaptrack.queueMalloc(ptr, size, 2 + HEAPTRACK_DEBUG_BUILD * 2, snapshot, t_state.tag);
+                });
+                return;
+            }
+        }
+
         Trace trace;
         trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 2);
 
-        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleMalloc(ptr, size, trace); });
+        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleMalloc(ptr, size, trace, t_state.tag); });
     }
 }
 
 void heaptrack_free(void* ptr)
 {
-    if (!HeapTrack::isPaused() && ptr && !RecursionGuard::isActive) {
+    if (ptr && HeapTrack::isTracking()) {
         RecursionGuard guard;
 
         debugLog<VeryVerboseOutput>("heaptrack_free(%p)", ptr);
 
-        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleFree(ptr); });
+        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.queueFree(ptr); });
+    }
+}
+
+void heaptrack_malloc_batch(void* arena, void* const* ptrs, const size_t* sizes, size_t count)
+{
+    if (ptrs && sizes && count && HeapTrack::isTracking() && !HeapTrack::isSampledOut()) {
+        RecursionGuard guard;
+
+        debugLog<VeryVerboseOutput>("heaptrack_malloc_batch(%p, %p, %zu)", arena, ptrs, count);
+
+        // all allocations of a batch share the same backtrace, so we only unwind once and do so synchronously
+        Trace trace;
+        trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 2);
+
+        HeapTrack::op(guard, [&](HeapTrack& heaptrack) {
+            heaptrack.handleMallocBatch(arena, ptrs, sizes, count, trace, t_state.tag);
+        });
+    }
+}
+
+void heaptrack_free_batch(void* const* ptrs, size_t count)
+{
+    if (ptrs && count && HeapTrack::isTracking()) {
+        RecursionGuard guard;
+
+        debugLog<VeryVerboseOutput>("heaptrack_free_batch(%p, %zu)", ptrs, count);
+
+        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleFreeBatch(ptrs, count); });
+    }
+}
+
+void heaptrack_arena_reset(void* arena)
+{
+    if (arena && HeapTrack::isTracking()) {
+        RecursionGuard guard;
+
+        debugLog<VeryVerboseOutput>("heaptrack_arena_reset(%p)", arena);
+
+        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleArenaReset(arena); });
     }
 }
 
@@ -902,6 +2092,74 @@ void heaptrack_realloc2(uintptr_t ptr_in, size_t size, uintptr_t ptr_out)
     heaptrack_realloc_impl(reinterpret_cast<void*>(ptr_in), size, reinterpret_cast<void*>(ptr_out));
 }
 
+void heaptrack_mark(const char* name)
+{
+    if (!name) {
+        return;
+    }
+
+    RecursionGuard guard;
+
+    debugLog<VerboseOutput>("heaptrack_mark(%s)", name);
+
+    HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.writeMarker('!', name); });
+}
+
+void heaptrack_push_phase(const char* name)
+{
+    if (!name) {
+        return;
+    }
+
+    RecursionGuard guard;
+
+    debugLog<VerboseOutput>("heaptrack_push_phase(%s)", name);
+
+    HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.writeMarker('>', name); });
+}
+
+void heaptrack_pop_phase()
+{
+    RecursionGuard guard;
+
+    debugLog<VerboseOutput>("%s", "heaptrack_pop_phase()");
+
+    HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.writePhaseEnd(); });
+}
+
+void heaptrack_register_tag(unsigned int tag, const char* name)
+{
+    if (!tag || !name) {
+        return;
+    }
+
+    RecursionGuard guard;
+
+    debugLog<VerboseOutput>("heaptrack_register_tag(%u, %s)", tag, name);
+
+    HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.writeTagName(tag, name); });
+}
+
+void heaptrack_set_tag(unsigned int tag)
+{
+    // no need to lock, the tag gets written out lazily with the next allocation of this thread
+    t_state.tag = tag;
+}
+
+void heaptrack_clear_tag()
+{
+    t_state.tag = 0;
+}
+
+void heaptrack_dump_leaks()
+{
+    RecursionGuard guard;
+
+    debugLog<VerboseOutput>("%s", "heaptrack_dump_leaks()");
+
+    HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.writeLeaks(); });
+}
+
 void heaptrack_invalidate_module_cache()
 {
     RecursionGuard guard;
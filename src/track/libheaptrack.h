@@ -4,6 +4,9 @@
     SPDX-License-Identifier: LGPL-2.1-or-later
 */
 
+#ifndef LIBHEAPTRACK_H
+#define LIBHEAPTRACK_H
+
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -32,8 +35,22 @@ void heaptrack_malloc(void* ptr, size_t size);
 void heaptrack_free(void* ptr);
 
 void heaptrack_realloc(void* ptr_in, size_t size, void* ptr_out);
+
+void heaptrack_malloc_batch(void* arena, void* const* ptrs, const size_t* sizes, size_t count);
+void heaptrack_free_batch(void* const* ptrs, size_t count);
+void heaptrack_arena_reset(void* arena);
 void heaptrack_realloc2(uintptr_t ptr_in, size_t size, uintptr_t ptr_out);
 
+void heaptrack_mark(const char* name);
+void heaptrack_push_phase(const char* name);
+void heaptrack_pop_phase();
+
+void heaptrack_register_tag(unsigned int tag, const char* name);
+void heaptrack_set_tag(unsigned int tag);
+void heaptrack_clear_tag();
+
+void heaptrack_dump_leaks();
+
 void heaptrack_invalidate_module_cache();
 
 typedef void (*heaptrack_warning_callback_t)(FILE*);
@@ -41,4 +58,119 @@ void heaptrack_warning(heaptrack_warning_callback_t callback);
 
 #ifdef __cplusplus
 }
+
+#include <atomic>
+
+/**
+ * The initial-exec TLS model lets the hooks access their per-thread state without calling __tls_get_addr.
+ *
+ * This is only safe for heaptrack_preload, which gets loaded at startup. heaptrack_inject gets dlopen'ed,
+ * where it would take from the small surplus of static TLS, which other modules may have exhausted already.
+ * The dlopen of heaptrack_inject would fail then. Instead, it gets built with TLS descriptors where supported.
+ */
+#if defined(HEAPTRACK_PRELOAD)
+#define HEAPTRACK_TLS_MODEL __attribute__((tls_model("initial-exec")))
+#else
+#define HEAPTRACK_TLS_MODEL
+#endif
+
+namespace heaptrack {
+
+/**
+ * All the per-thread state the hooks look at, kept together so that it shares one cache line.
+ *
+ * This is trivial and zero-initialized, such that accessing it from other translation units
+ * doesn't go through the initialization wrapper of thread_local.
+ */
+struct ThreadState
+{
+    enum : uint32_t
+    {
+        /// set in the state word while the thread is within heaptrack, see RecursionGuard
+        ACTIVE = 1,
+        /// set in the global epoch while tracking is paused
+        PAUSED = 2,
+        /// the epoch advances by this step whenever tracking gets paused or resumed
+        EPOCH_STEP = 4,
+    };
+
+    /// the ACTIVE flag and the last epoch in which the thread saw that tracking is enabled
+    uint32_t word;
+    /// the tag set via heaptrack_set_tag, attributed to all allocations of the thread
+    uint32_t tag;
+    /// counts the allocations of the thread while sampling, see HeapTrack::isSampledOut
+    uint32_t allocations;
+
+    bool isActive() const
+    {
+        return word & ACTIVE;
+    }
+
+    void setActive(bool active)
+    {
+        word = active ? (word | ACTIVE) : (word & ~ACTIVE);
+    }
+};
+
+extern __thread ThreadState t_state HEAPTRACK_TLS_MODEL;
+
+/// the PAUSED flag and a counter of the changes to it, see ThreadState
+extern std::atomic<uint32_t> s_epoch;
+
+/**
+ * The check on the fast path of all hooks: false while paused or within heaptrack itself.
+ *
+ * Usually, the state word of the thread equals the global epoch, which can only be the case
+ * while tracking is enabled and the thread is not within heaptrack.
+ */
+__attribute__((always_inline)) inline bool isTracking()
+{
+    const auto epoch = s_epoch.load(std::memory_order_relaxed);
+    if (__builtin_expect(t_state.word == epoch, true)) {
+        return true;
+    } else if (t_state.isActive() || (epoch & ThreadState::PAUSED)) {
+        return false;
+    }
+    // tracking got resumed since the thread looked the last time
+    t_state.word = epoch;
+    return true;
+}
+
+/*
+ * The hooks call these, which only leave the hook for allocations that get tracked.
+ *
+ * They must get inlined, as the unwinder skips a fixed number of frames.
+ */
+
+__attribute__((always_inline)) inline void trackMalloc(void* ptr, size_t size)
+{
+    if (ptr && isTracking()) {
+        heaptrack_malloc(ptr, size);
+    }
+}
+
+__attribute__((always_inline)) inline void trackFree(void* ptr)
+{
+    if (ptr && isTracking()) {
+        heaptrack_free(ptr);
+    }
+}
+
+__attribute__((always_inline)) inline void trackRealloc(void* ptr_in, size_t size, void* ptr_out)
+{
+    if (ptr_out && isTracking()) {
+        heaptrack_realloc(ptr_in, size, ptr_out);
+    }
+}
+
+__attribute__((always_inline)) inline void trackRealloc2(uintptr_t ptr_in, size_t size, uintptr_t ptr_out)
+{
+    // ptr_out gets checked out of line, otherwise GCC warns about using ptr_in after the realloc
+    if (isTracking()) {
+        heaptrack_realloc2(ptr_in, size, ptr_out);
+    }
+}
+}
 #endif
+
+#endif // LIBHEAPTRACK_H
@@ -7,8 +7,18 @@
 #ifndef TRACE_H
 #define TRACE_H
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <vector>
+
+/**
+ * Opaque copy of the registers and the top of the stack of a thread, which allows
+ * unwinding its backtrace at a later time from a different thread.
+ */
+struct StackSnapshot;
 
 /**
  * @brief Backtrace interface.
@@ -22,6 +32,28 @@ struct Trace
         MAX_SIZE = 64
     };
 
+    /**
+     * Fake instruction pointer that gets appended to traces which got truncated,
+     * either due to the configured max depth or a stop rule.
+     */
+    static constexpr uintptr_t TRUNCATION_MARKER = UINTPTR_MAX;
+
+    struct AddressRange
+    {
+        bool contains(uintptr_t address) const
+        {
+            return address >= start && address < end;
+        }
+
+        bool operator==(const AddressRange& other) const
+        {
+            return start == other.start && end == other.end;
+        }
+
+        uintptr_t start;
+        uintptr_t end;
+    };
+
     const ip_t* begin() const
     {
         return m_data + m_skip;
@@ -44,15 +76,26 @@ struct Trace
 
     bool fill(int skip)
     {
-        int size = unwind(m_data);
-        // filter bogus frames at the end, which sometimes get returned by tracer backend
-        // cf.: https://bugs.kde.org/show_bug.cgi?id=379082
-        while (size > 0 && !m_data[size - 1]) {
-            --size;
-        }
-        m_size = size > skip ? size - skip : 0;
-        m_skip = skip;
-        return m_size > 0;
+        return finishFill(unwind(m_data, unwindSize(skip), skip), skip);
+    }
+
+    /**
+     * Like fill(int), but unwinds the state captured previously via captureSnapshot().
+     */
+    bool fill(const StackSnapshot* snapshot, int skip)
+    {
+        return finishFill(unwind(snapshot, m_data, unwindSize(skip), skip), skip);
+    }
+
+    /**
+     * Only keep the first @p size frames, starting from the leaf, and append
+     * the TRUNCATION_MARKER as the new outermost frame.
+     */
+    void truncate(int size)
+    {
+        assert(size >= 0 && size < m_size);
+        m_data[m_skip + size] = reinterpret_cast<ip_t>(TRUNCATION_MARKER);
+        m_size = size + 1;
     }
 
     void fillTestData(uintptr_t n, uintptr_t leaf)
@@ -71,8 +114,208 @@ struct Trace
 
     static void print();
 
+    /**
+     * Limit the number of frames that get unwound, excluding skipped frames.
+     * Deeper traces get truncated, see truncate().
+     */
+    static void setMaxDepth(int depth)
+    {
+        maxDepth() = (depth > 0 && depth < MAX_SIZE) ? depth : MAX_SIZE;
+    }
+
+    static int& maxDepth()
+    {
+        static int s_maxDepth = MAX_SIZE;
+        return s_maxDepth;
+    }
+
+    /**
+     * Stop unwinding after the first frame that lies within any of the @p ranges,
+     * such traces get truncated after that frame, see truncate().
+     *
+     * Other threads may unwind concurrently, so the previous ranges only get freed once no thread
+     * uses them anymore, see reclaimStopRanges(). The caller must serialize the calls to both.
+     */
+    static void setStopRanges(std::vector<AddressRange> ranges)
+    {
+        auto& current = stopRanges();
+        auto* previous = current.load(std::memory_order_relaxed);
+        if (previous ? previous->ranges == ranges : ranges.empty()) {
+            return;
+        }
+        current.store(ranges.empty() ? nullptr : new StopRanges {std::move(ranges), nullptr});
+        if (previous) {
+            previous->nextRetired = retiredStopRanges();
+            retiredStopRanges() = previous;
+        }
+        reclaimStopRanges();
+    }
+
+    /**
+     * Free the replaced stop ranges, unless a thread is unwinding right now and thus may still use them.
+     *
+     * This is cheap and should be called regularly, e.g. by the timer thread.
+     */
+    static void reclaimStopRanges()
+    {
+        auto& retired = retiredStopRanges();
+        // any thread that starts unwinding after this check sees the current ranges, see FrameCollector
+        if (!retired || stopRangeUsers().load() != 0) {
+            return;
+        }
+        while (retired) {
+            auto* next = retired->nextRetired;
+            delete retired;
+            retired = next;
+        }
+    }
+
+    /**
+     * Collects the frames while a backend unwinds the stack, until @p maxSize frames got collected
+     * or a frame after the @p skip first ones lies within the stop ranges.
+     */
+    class FrameCollector
+    {
+    public:
+        FrameCollector(void** data, int maxSize, int skip)
+            : m_data(data)
+            , m_maxSize(maxSize)
+            , m_skip(skip)
+        {
+            // only announce ourselves when there are stop ranges, to not contend on the counter otherwise
+            if (!Trace::stopRanges().load(std::memory_order_relaxed)) {
+                return;
+            }
+            // must happen before loading the ranges again, such that they cannot get reclaimed in between
+            ++Trace::stopRangeUsers();
+            m_isUser = true;
+            if (const auto* stopRanges = Trace::stopRanges().load()) {
+                m_stopRanges = &stopRanges->ranges;
+            }
+        }
+
+        ~FrameCollector()
+        {
+            if (m_isUser) {
+                --Trace::stopRangeUsers();
+            }
+        }
+
+        FrameCollector(const FrameCollector&) = delete;
+        FrameCollector& operator=(const FrameCollector&) = delete;
+
+        /// @return true when add() checks the stop ranges, otherwise only the max size limits the unwinding
+        bool hasStopRanges() const
+        {
+            return m_stopRanges;
+        }
+
+        /// @return false when no more frames should be unwound
+        bool add(uintptr_t ip)
+        {
+            m_data[m_size++] = reinterpret_cast<ip_t>(ip);
+            if (m_size > m_skip && m_stopRanges
+                && std::any_of(m_stopRanges->begin(), m_stopRanges->end(),
+                               [ip](const AddressRange& range) { return range.contains(ip); })) {
+                if (m_size < m_maxSize) {
+                    m_data[m_size++] = reinterpret_cast<ip_t>(TRUNCATION_MARKER);
+                }
+                return false;
+            }
+            return m_size < m_maxSize;
+        }
+
+        int size() const
+        {
+            return m_size;
+        }
+
+    private:
+        void** m_data;
+        int m_maxSize;
+        int m_skip;
+        int m_size = 0;
+        const std::vector<AddressRange>* m_stopRanges = nullptr;
+        bool m_isUser = false;
+    };
+
+    /**
+     * @return true when the backend supports unwinding stack snapshots
+     */
+    static bool canUnwindSnapshots();
+
+    /**
+     * Forget the unwind info cached for snapshots, to be called when modules got loaded or unloaded.
+     */
+    static void invalidateSnapshotCache();
+
+    /**
+     * Allocate a snapshot that can hold up to @p stackSize bytes of the stack.
+     */
+    static StackSnapshot* allocateSnapshot(std::size_t stackSize);
+
+    static void freeSnapshot(StackSnapshot* snapshot);
+
+    /**
+     * Copy the current register state and the top of the stack into @p snapshot.
+     *
+     * Like for fill(int), the frame of the caller will be the first one after the skipped frames.
+     *
+     * @return false when the stack could not be copied safely, the caller must unwind synchronously then
+     */
+    static bool captureSnapshot(StackSnapshot* snapshot);
+
 private:
-    static int unwind(void** data);
+    int unwindSize(int skip) const
+    {
+        // when limited, unwind one frame more than needed to detect whether we truncate the trace
+        return skip + maxDepth() < MAX_SIZE ? skip + maxDepth() + 1 : MAX_SIZE;
+    }
+
+    bool finishFill(int size, int skip)
+    {
+        // filter bogus frames at the end, which sometimes get returned by tracer backend
+        // cf.: https://bugs.kde.org/show_bug.cgi?id=379082
+        while (size > 0 && !m_data[size - 1]) {
+            --size;
+        }
+        m_size = size > skip ? size - skip : 0;
+        m_skip = skip;
+        const int maxDepth = Trace::maxDepth();
+        if (skip + maxDepth < MAX_SIZE && m_size > maxDepth) {
+            truncate(maxDepth);
+        }
+        return m_size > 0;
+    }
+
+    struct StopRanges
+    {
+        std::vector<AddressRange> ranges;
+        /// the ranges that got replaced before these ones and await being freed
+        StopRanges* nextRetired;
+    };
+
+    static std::atomic<StopRanges*>& stopRanges()
+    {
+        static std::atomic<StopRanges*> s_stopRanges {nullptr};
+        return s_stopRanges;
+    }
+
+    /// the number of threads that are unwinding with the stop ranges
+    static std::atomic<int>& stopRangeUsers()
+    {
+        static std::atomic<int> s_users {0};
+        return s_users;
+    }
+
+    static StopRanges*& retiredStopRanges()
+    {
+        static StopRanges* s_retired = nullptr;
+        return s_retired;
+    }
+
+    static int unwind(void** data, int maxSize, int skip);
+    static int unwind(const StackSnapshot* snapshot, void** data, int maxSize, int skip);
 
 private:
     int m_size = 0;
@@ -62,7 +62,29 @@ void Trace::setup()
 #endif
 }
 
-int Trace::unwind(void** data)
+int Trace::unwind(void** data, int maxSize, int skip)
 {
-    return unw_backtrace(data, MAX_SIZE);
+#if LIBUNWIND_HAS_UNW_GETCONTEXT && LIBUNWIND_HAS_UNW_INIT_LOCAL
+    FrameCollector frames(data, maxSize, skip);
+    if (frames.hasStopRanges()) {
+        // unw_backtrace is faster per frame, but cannot stop once a frame reaches a stop range
+        unw_context_t context;
+        unw_getcontext(&context);
+
+        unw_cursor_t cursor;
+        unw_init_local(&cursor, &context);
+
+        // like for unw_backtrace, the first frame is the one of this function
+        do {
+            unw_word_t ip = 0;
+            if (unw_get_reg(&cursor, UNW_REG_IP, &ip) != 0 || !ip || !frames.add(ip)) {
+                break;
+            }
+        } while (unw_step(&cursor) > 0);
+        return frames.size();
+    }
+#else
+    (void)skip;
+#endif
+    return unw_backtrace(data, maxSize);
 }
@@ -0,0 +1,540 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * @brief Unwind copies of the stack via the remote API of libunwind, if available.
+ *
+ * The snapshots are taken in the allocating thread, which then can continue
+ * right away. The expensive unwinding happens later on in a different thread,
+ * by treating the snapshot like the stack of a remote process.
+ */
+
+#include "trace.h"
+
+#include "util/libunwind_config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include <link.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if LIBUNWIND_HAS_UNW_INIT_REMOTE && defined(__x86_64__)
+#define HEAPTRACK_HAS_SNAPSHOTS 1
+#else
+#define HEAPTRACK_HAS_SNAPSHOTS 0
+#endif
+
+#if HEAPTRACK_HAS_SNAPSHOTS
+
+#include <ucontext.h>
+
+#include <libunwind.h>
+
+extern "C" {
+// not part of the public API, but exported and used by other remote unwinders, like perf
+// FindLibunwind.cmake checks that it exists with this signature, otherwise we don't support snapshots
+extern int UNW_OBJ(dwarf_search_unwind_table)(unw_addr_space_t as, unw_word_t ip, unw_dyn_info_t* di,
+                                              unw_proc_info_t* pi, int need_unwind_info, void* arg);
+}
+
+struct StackSnapshot
+{
+    unw_context_t context;
+    /// the stack pointer at the time the snapshot was taken
+    uintptr_t stackStart = 0;
+    /// number of bytes copied from the stack
+    size_t stackSize = 0;
+    /// number of bytes that can be stored in the snapshot
+    size_t capacity = 0;
+
+    const char* stack() const
+    {
+        return reinterpret_cast<const char*>(this + 1);
+    }
+
+    char* stack()
+    {
+        return reinterpret_cast<char*>(this + 1);
+    }
+};
+
+namespace {
+
+// see also the pointer encoding section of the LSB specification for .eh_frame_hdr
+enum PointerEncoding : uint8_t
+{
+    DW_EH_PE_udata4 = 0x03,
+    DW_EH_PE_sdata4 = 0x0b,
+    DW_EH_PE_pcrel = 0x10,
+    DW_EH_PE_datarel = 0x30,
+};
+
+struct EhFrameHeader
+{
+    uint8_t version;
+    uint8_t ehFramePtrEncoding;
+    uint8_t fdeCountEncoding;
+    uint8_t tableEncoding;
+    int32_t ehFramePtr;
+    uint32_t fdeCount;
+};
+
+struct MemoryRange
+{
+    bool contains(uintptr_t address, size_t size) const
+    {
+        return address >= start && address + size <= end;
+    }
+
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+};
+
+/**
+ * State shared by the accessors while unwinding a single snapshot
+ */
+struct UnwindState
+{
+    const StackSnapshot* snapshot = nullptr;
+    pid_t pid = 0;
+
+    /// the loadable segments of the module containing the last looked up instruction pointer
+    enum
+    {
+        MAX_SEGMENTS = 8
+    };
+    MemoryRange segments[MAX_SEGMENTS];
+    int numSegments = 0;
+};
+
+struct FindModuleData
+{
+    uintptr_t ip = 0;
+    UnwindState* state = nullptr;
+    MemoryRange text;
+    uintptr_t ehFrameHeader = 0;
+    /// copied while the module cannot get unloaded, i.e. from within the dl_iterate_phdr callback
+    EhFrameHeader header;
+};
+
+int findModuleCallback(struct dl_phdr_info* info, size_t /*size*/, void* data)
+{
+    auto* find = static_cast<FindModuleData*>(data);
+
+    const ElfW(Phdr)* ehFrameHeader = nullptr;
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+        const auto& phdr = info->dlpi_phdr[i];
+        if (phdr.p_type == PT_LOAD) {
+            const auto start = info->dlpi_addr + phdr.p_vaddr;
+            if (find->ip >= start && find->ip < start + phdr.p_memsz) {
+                find->text = {start, start + phdr.p_memsz};
+            }
+        } else if (phdr.p_type == PT_GNU_EH_FRAME) {
+            ehFrameHeader = &phdr;
+        }
+    }
+
+    if (!find->text.end) {
+        return 0;
+    }
+
+    if (ehFrameHeader) {
+        find->ehFrameHeader = info->dlpi_addr + ehFrameHeader->p_vaddr;
+        memcpy(&find->header, reinterpret_cast<const void*>(find->ehFrameHeader), sizeof(EhFrameHeader));
+    }
+
+    auto* state = find->state;
+    state->numSegments = 0;
+    for (int i = 0; i < info->dlpi_phnum && state->numSegments < UnwindState::MAX_SEGMENTS; ++i) {
+        const auto& phdr = info->dlpi_phdr[i];
+        if (phdr.p_type == PT_LOAD) {
+            const auto start = info->dlpi_addr + phdr.p_vaddr;
+            state->segments[state->numSegments++] = {start, start + phdr.p_memsz};
+        }
+    }
+    return 1;
+}
+
+int findProcInfo(unw_addr_space_t addressSpace, unw_word_t ip, unw_proc_info_t* procInfo, int needUnwindInfo,
+                 void* arg)
+{
+    FindModuleData find;
+    find.ip = ip;
+    find.state = static_cast<UnwindState*>(arg);
+    if (!dl_iterate_phdr(&findModuleCallback, &find) || !find.ehFrameHeader) {
+        return -UNW_ENOINFO;
+    }
+
+    const auto* header = &find.header;
+    // dwarf_search_unwind_table only supports this (by far most common) encoding of the lookup table
+    if (header->version != 1 || header->ehFramePtrEncoding != (DW_EH_PE_pcrel | DW_EH_PE_sdata4)
+        || header->fdeCountEncoding != DW_EH_PE_udata4 || header->tableEncoding != (DW_EH_PE_datarel | DW_EH_PE_sdata4)) {
+        return -UNW_ENOINFO;
+    }
+
+    unw_dyn_info_t dynInfo;
+    memset(&dynInfo, 0, sizeof(dynInfo));
+    dynInfo.format = UNW_INFO_FORMAT_REMOTE_TABLE;
+    dynInfo.start_ip = find.text.start;
+    dynInfo.end_ip = find.text.end;
+    dynInfo.u.rti.segbase = find.ehFrameHeader;
+    dynInfo.u.rti.table_data = find.ehFrameHeader + sizeof(EhFrameHeader);
+    // every table entry consists of two 32bit values: the initial location and the address of the FDE
+    dynInfo.u.rti.table_len = header->fdeCount * 2 * sizeof(int32_t) / sizeof(unw_word_t);
+
+    return UNW_OBJ(dwarf_search_unwind_table)(addressSpace, ip, &dynInfo, procInfo, needUnwindInfo, arg);
+}
+
+void putUnwindInfo(unw_addr_space_t /*addressSpace*/, unw_proc_info_t* /*procInfo*/, void* /*arg*/)
+{
+}
+
+int getDynInfoListAddr(unw_addr_space_t /*addressSpace*/, unw_word_t* /*dilAddr*/, void* /*arg*/)
+{
+    return -UNW_ENOINFO;
+}
+
+/// process_vm_readv may be unavailable, e.g. when it is forbidden by a seccomp filter
+std::atomic<bool> s_canReadProcessMemory {true};
+
+/**
+ * Read a word of a module, which a concurrent dlclose may unmap at any time.
+ *
+ * process_vm_readv fails with EFAULT then, instead of crashing like a plain memory access.
+ * When it is not permitted, we fall back to reading the memory directly.
+ */
+bool readModuleMemory(pid_t pid, uintptr_t address, unw_word_t* value)
+{
+    if (s_canReadProcessMemory.load(std::memory_order_relaxed)) {
+        iovec local = {value, sizeof(*value)};
+        iovec remote = {reinterpret_cast<void*>(address), sizeof(*value)};
+        const auto read = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        if (read == static_cast<ssize_t>(sizeof(*value))) {
+            return true;
+        } else if (read != -1 || (errno != ENOSYS && errno != EPERM)) {
+            return false;
+        }
+        s_canReadProcessMemory.store(false, std::memory_order_relaxed);
+    }
+    memcpy(value, reinterpret_cast<const void*>(address), sizeof(*value));
+    return true;
+}
+
+int accessMem(unw_addr_space_t /*addressSpace*/, unw_word_t address, unw_word_t* value, int write, void* arg)
+{
+    if (write) {
+        return -UNW_EINVAL;
+    }
+
+    const auto* state = static_cast<const UnwindState*>(arg);
+    const auto* snapshot = state->snapshot;
+    const MemoryRange stack = {snapshot->stackStart, snapshot->stackStart + snapshot->stackSize};
+    if (stack.contains(address, sizeof(unw_word_t))) {
+        memcpy(value, snapshot->stack() + (address - stack.start), sizeof(unw_word_t));
+        return 0;
+    }
+
+    // only access memory of the module we are currently unwinding through, e.g. its .eh_frame
+    // all other memory could have been changed or unmapped since the snapshot was taken
+    for (int i = 0; i < state->numSegments; ++i) {
+        if (state->segments[i].contains(address, sizeof(unw_word_t))) {
+            return readModuleMemory(state->pid, address, value) ? 0 : -UNW_EINVAL;
+        }
+    }
+
+    return -UNW_EINVAL;
+}
+
+int mapRegister(unw_regnum_t reg)
+{
+    switch (reg) {
+    case UNW_X86_64_RAX:
+        return REG_RAX;
+    case UNW_X86_64_RDX:
+        return REG_RDX;
+    case UNW_X86_64_RCX:
+        return REG_RCX;
+    case UNW_X86_64_RBX:
+        return REG_RBX;
+    case UNW_X86_64_RSI:
+        return REG_RSI;
+    case UNW_X86_64_RDI:
+        return REG_RDI;
+    case UNW_X86_64_RBP:
+        return REG_RBP;
+    case UNW_X86_64_RSP:
+        return REG_RSP;
+    case UNW_X86_64_R8:
+        return REG_R8;
+    case UNW_X86_64_R9:
+        return REG_R9;
+    case UNW_X86_64_R10:
+        return REG_R10;
+    case UNW_X86_64_R11:
+        return REG_R11;
+    case UNW_X86_64_R12:
+        return REG_R12;
+    case UNW_X86_64_R13:
+        return REG_R13;
+    case UNW_X86_64_R14:
+        return REG_R14;
+    case UNW_X86_64_R15:
+        return REG_R15;
+    case UNW_X86_64_RIP:
+        return REG_RIP;
+    }
+    return -1;
+}
+
+int accessReg(unw_addr_space_t /*addressSpace*/, unw_regnum_t reg, unw_word_t* value, int write, void* arg)
+{
+    const auto index = mapRegister(reg);
+    if (write || index == -1) {
+        return -UNW_EBADREG;
+    }
+
+    const auto* state = static_cast<const UnwindState*>(arg);
+    *value = state->snapshot->context.uc_mcontext.gregs[index];
+    return 0;
+}
+
+int accessFpreg(unw_addr_space_t /*addressSpace*/, unw_regnum_t /*reg*/, unw_fpreg_t* /*value*/, int /*write*/,
+                void* /*arg*/)
+{
+    return -UNW_EBADREG;
+}
+
+int resume(unw_addr_space_t /*addressSpace*/, unw_cursor_t* /*cursor*/, void* /*arg*/)
+{
+    return -UNW_EINVAL;
+}
+
+int getProcName(unw_addr_space_t /*addressSpace*/, unw_word_t /*address*/, char* /*buffer*/, size_t /*length*/,
+                unw_word_t* /*offset*/, void* /*arg*/)
+{
+    return -UNW_EINVAL;
+}
+
+unw_addr_space_t snapshotAddressSpace()
+{
+    static const unw_addr_space_t s_addressSpace = []() {
+        unw_accessors_t accessors;
+        memset(&accessors, 0, sizeof(accessors));
+        accessors.find_proc_info = &findProcInfo;
+        accessors.put_unwind_info = &putUnwindInfo;
+        accessors.get_dyn_info_list_addr = &getDynInfoListAddr;
+        accessors.access_mem = &accessMem;
+        accessors.access_reg = &accessReg;
+        accessors.access_fpreg = &accessFpreg;
+        accessors.resume = &resume;
+        accessors.get_proc_name = &getProcName;
+
+        auto addressSpace = unw_create_addr_space(&accessors, 0);
+        if (!addressSpace) {
+            fprintf(stderr, "WARNING: Failed to create libunwind address space for stack snapshots.\n");
+        } else if (unw_set_caching_policy(addressSpace, UNW_CACHE_GLOBAL)) {
+            fprintf(stderr, "WARNING: Failed to enable libunwind caching for stack snapshots.\n");
+        }
+        return addressSpace;
+    }();
+    return s_addressSpace;
+}
+
+struct StackBounds
+{
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+    bool initialized = false;
+};
+
+/**
+ * @return the stack of the current thread as known to pthread, or an empty range when that is unknown
+ */
+const StackBounds& stackBounds()
+{
+    // not initial-exec TLS, this is also linked into the dlopen'ed heaptrack_inject
+    // the cost of __tls_get_addr is negligible compared to copying the stack anyway
+    static thread_local StackBounds s_bounds;
+    if (!s_bounds.initialized) {
+        s_bounds.initialized = true;
+        pthread_attr_t attributes;
+        if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+            void* stackAddress = nullptr;
+            size_t stackSize = 0;
+            if (pthread_attr_getstack(&attributes, &stackAddress, &stackSize) == 0) {
+                s_bounds.start = reinterpret_cast<uintptr_t>(stackAddress);
+                s_bounds.end = s_bounds.start + stackSize;
+            }
+            pthread_attr_destroy(&attributes);
+        }
+    }
+    return s_bounds;
+}
+
+/**
+ * Copy up to @p size bytes from @p address, stopping at the end of its mapping.
+ *
+ * This is used for stacks that pthread doesn't know about, e.g. the ones of coroutines,
+ * where we cannot tell how much of the memory after the stack pointer is accessible.
+ *
+ * @return the number of bytes copied, or 0 when the memory cannot be read safely
+ */
+size_t copyUnknownStack(char* buffer, uintptr_t address, size_t size)
+{
+    if (!s_canReadProcessMemory.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+
+    static const uintptr_t s_pageSize = sysconf(_SC_PAGESIZE);
+    const auto pid = getpid();
+
+    // process_vm_readv only transfers whole iovecs, one per page stops the copy at the first unreadable page
+    enum
+    {
+        MAX_PAGES = 64
+    };
+    iovec remote[MAX_PAGES];
+    size_t copied = 0;
+    while (copied < size) {
+        int numPages = 0;
+        size_t requested = 0;
+        while (numPages < MAX_PAGES && copied + requested < size) {
+            const auto pageAddress = address + copied + requested;
+            const auto pageSize = std::min<size_t>(s_pageSize - pageAddress % s_pageSize, size - copied - requested);
+            remote[numPages++] = {reinterpret_cast<void*>(pageAddress), pageSize};
+            requested += pageSize;
+        }
+
+        iovec local = {buffer + copied, requested};
+        const auto read = process_vm_readv(pid, &local, 1, remote, numPages, 0);
+        if (read <= 0) {
+            break;
+        }
+        copied += read;
+        if (static_cast<size_t>(read) < requested) {
+            break;
+        }
+    }
+    return copied;
+}
+}
+
+bool Trace::canUnwindSnapshots()
+{
+    return snapshotAddressSpace();
+}
+
+void Trace::invalidateSnapshotCache()
+{
+    // the cached unwind info could otherwise refer to a module that got unloaded, or a new one at its address
+    if (auto addressSpace = snapshotAddressSpace()) {
+        unw_flush_cache(addressSpace, 0, 0);
+    }
+}
+
+StackSnapshot* Trace::allocateSnapshot(size_t stackSize)
+{
+    auto* snapshot = new (::operator new(sizeof(StackSnapshot) + stackSize)) StackSnapshot;
+    snapshot->capacity = stackSize;
+    return snapshot;
+}
+
+void Trace::freeSnapshot(StackSnapshot* snapshot)
+{
+    if (snapshot) {
+        snapshot->~StackSnapshot();
+        ::operator delete(snapshot);
+    }
+}
+
+bool __attribute__((noinline)) Trace::captureSnapshot(StackSnapshot* snapshot)
+{
+    unw_getcontext(&snapshot->context);
+
+    const auto stackStart = static_cast<uintptr_t>(snapshot->context.uc_mcontext.gregs[REG_RSP]);
+    const auto& bounds = stackBounds();
+    auto stackSize = snapshot->capacity;
+    if (stackStart >= bounds.start && stackStart < bounds.end) {
+        stackSize = std::min<size_t>(stackSize, bounds.end - stackStart);
+        memcpy(snapshot->stack(), reinterpret_cast<const void*>(stackStart), stackSize);
+    } else {
+        stackSize = copyUnknownStack(snapshot->stack(), stackStart, stackSize);
+    }
+
+    snapshot->stackStart = stackStart;
+    snapshot->stackSize = stackSize;
+    return stackSize > 0;
+}
+
+int Trace::unwind(const StackSnapshot* snapshot, void** data, int maxSize, int skip)
+{
+    auto addressSpace = snapshotAddressSpace();
+    if (!addressSpace) {
+        return 0;
+    }
+
+    UnwindState state;
+    state.snapshot = snapshot;
+    state.pid = getpid();
+
+    unw_cursor_t cursor;
+    if (unw_init_remote(&cursor, addressSpace, &state) != 0) {
+        return 0;
+    }
+
+    FrameCollector frames(data, maxSize, skip);
+    do {
+        unw_word_t ip = 0;
+        if (unw_get_reg(&cursor, UNW_REG_IP, &ip) != 0 || !ip || !frames.add(ip)) {
+            break;
+        }
+    } while (unw_step(&cursor) > 0);
+
+    return frames.size();
+}
+
+#else
+
+struct StackSnapshot
+{
+};
+
+bool Trace::canUnwindSnapshots()
+{
+    return false;
+}
+
+void Trace::invalidateSnapshotCache()
+{
+}
+
+StackSnapshot* Trace::allocateSnapshot(size_t /*stackSize*/)
+{
+    return nullptr;
+}
+
+void Trace::freeSnapshot(StackSnapshot* /*snapshot*/)
+{
+}
+
+bool Trace::captureSnapshot(StackSnapshot* /*snapshot*/)
+{
+    return false;
+}
+
+int Trace::unwind(const StackSnapshot* /*snapshot*/, void** /*data*/, int /*maxSize*/, int /*skip*/)
+{
+    return 0;
+}
+
+#endif
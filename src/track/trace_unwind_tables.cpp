@@ -16,22 +16,15 @@
 
 namespace {
 
-struct backtrace
-{
-    void** data = nullptr;
-    int ctr = 0;
-    int max_size = 0;
-};
-
 _Unwind_Reason_Code unwind_backtrace_callback(struct _Unwind_Context* context, void* arg)
 {
-    backtrace* trace = static_cast<backtrace*>(arg);
+    auto* frames = static_cast<Trace::FrameCollector*>(arg);
 
     uintptr_t pc = _Unwind_GetIP(context);
-    if (pc && trace->ctr < trace->max_size - 1) {
-        trace->data[trace->ctr++] = (void*)(pc);
+    // don't walk further up the stack when we cannot store any more frames anyways, or reached a stop range
+    if (pc && !frames->add(pc)) {
+        return _URC_END_OF_STACK;
     }
-
     return _URC_NO_REASON;
 }
 
@@ -50,12 +43,9 @@ void Trace::print()
     }
 }
 
-int Trace::unwind(void** data)
+int Trace::unwind(void** data, int maxSize, int skip)
 {
-    backtrace trace;
-    trace.data = data;
-    trace.max_size = MAX_SIZE;
-
-    _Unwind_Backtrace(unwind_backtrace_callback, &trace);
-    return trace.ctr;
+    FrameCollector frames(data, maxSize, skip);
+    _Unwind_Backtrace(unwind_backtrace_callback, &frames);
+    return frames.size();
 }
@@ -22,4 +22,7 @@
 #cmakedefine01 HAVE_CFREE
 #cmakedefine01 HAVE_VALLOC
 
+// mallinfo2() was added in glibc 2.33, the older mallinfo() overflows beyond 4GB
+#cmakedefine01 HAVE_MALLINFO2
+
 #endif // HEAPTRACK_CONFIG_H
@@ -19,5 +19,7 @@
 
 #cmakedefine01 LIBUNWIND_HAS_UNW_CACHE_PER_THREAD
 
+#cmakedefine01 LIBUNWIND_HAS_UNW_INIT_REMOTE
+
 #endif // LIBUNWIND_CONFIG_H
 
@@ -7,9 +7,13 @@
 #ifndef LINEREADER_H
 #define LINEREADER_H
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <istream>
 #include <string>
+#include <vector>
 
 /**
  * Optimized class to speed up reading of the potentially big data files.
@@ -17,63 +21,110 @@
  * sscanf or istream are just slow when reading plain hex numbers. The
  * below does all we need and thus far less than what the generic functions
  * are capable of. We are not locale aware e.g.
+ *
+ * The input is read in large blocks and the lines are parsed in place, i.e.
+ * they only get copied into a string when line() is called. As such, a reader
+ * must be the only one reading from its stream.
  */
 class LineReader
 {
 public:
+    enum
+    {
+        BLOCK_SIZE = 64 * 1024
+    };
+
     LineReader()
+        : m_block(BLOCK_SIZE)
     {
         m_line.reserve(1024);
+        resetIterator();
     }
 
     bool getLine(std::istream& in)
     {
-        if (!in.good()) {
-            return false;
-        }
-        std::getline(in, m_line);
-        m_it = m_line.cbegin();
-        if (m_line.length() > 2) {
-            m_it += 2;
-        } else {
-            m_it = m_line.cend();
+        const char* newline = nullptr;
+        // memchr is vectorized by the C library, which beats any scalar loop by far
+        while (!(newline = static_cast<const char*>(
+                     memchr(m_block.data() + m_blockPos, '\n', m_blockEnd - m_blockPos)))) {
+            if (!readBlock(in)) {
+                if (m_blockPos == m_blockEnd) {
+                    return false;
+                }
+                // the last line has no trailing newline
+                newline = m_block.data() + m_blockEnd;
+                break;
+            }
         }
+
+        m_lineBegin = m_block.data() + m_blockPos;
+        m_lineEnd = newline;
+        m_lineIsString = false;
+        m_blockPos = std::min(static_cast<size_t>(newline - m_block.data()) + 1, m_blockEnd);
+        resetIterator();
         return true;
     }
 
+    /**
+     * Use @p line as the current line, e.g. when it got read on another thread.
+     *
+     * The previous line is returned in @p line, such that its memory can be reused.
+     */
+    void swapLine(std::string& line)
+    {
+        m_line.swap(line);
+        m_lineBegin = m_line.data();
+        m_lineEnd = m_lineBegin + m_line.size();
+        m_lineIsString = true;
+        resetIterator();
+    }
+
     char mode() const
     {
-        return m_line.empty() ? '#' : m_line[0];
+        return m_lineBegin == m_lineEnd ? '#' : *m_lineBegin;
     }
 
     const std::string& line() const
     {
+        if (!m_lineIsString) {
+            m_line.assign(m_lineBegin, m_lineEnd);
+            m_lineIsString = true;
+        }
         return m_line;
     }
 
+    /// @return the current line without the trailing newline, valid until the next line gets read
+    const char* lineData() const
+    {
+        return m_lineBegin;
+    }
+
+    size_t lineLength() const
+    {
+        return m_lineEnd - m_lineBegin;
+    }
+
     template <typename T>
     bool readHex(T& in)
     {
         auto it = m_it;
-        const auto end = m_line.cend();
+        const auto end = m_lineEnd;
         if (it == end) {
             return false;
         }
 
+        static constexpr HexDigits digits;
         T hex = 0;
         do {
-            const char c = *it;
-            if ('0' <= c && c <= '9') {
-                hex *= 16;
-                hex += c - '0';
-            } else if ('a' <= c && c <= 'f') {
+            const auto digit = digits.values[static_cast<unsigned char>(*it)];
+            if (digit >= 0) {
                 hex *= 16;
-                hex += c - 'a' + 10;
-            } else if (c == ' ') {
+                hex += digit;
+            } else if (*it == ' ') {
                 ++it;
                 break;
             } else {
-                fprintf(stderr, "unexpected non-hex char: %d %zx\n", c, std::distance(m_line.cbegin(), it));
+                fprintf(stderr, "unexpected non-hex char: %d %zx\n", *it, static_cast<size_t>(it - m_lineBegin));
                 return false;
             }
             ++it;
@@ -113,13 +164,13 @@ public:
     {
         if (m_expectSizedStrings) {
             uint64_t size = 0;
-            if (!(*this >> size) || size > static_cast<uint64_t>(std::distance(m_it, m_line.cend()))) {
+            if (!(*this >> size) || size > static_cast<uint64_t>(m_lineEnd - m_it)) {
                 return false;
             }
             auto start = m_it;
             m_it += size;
             str.assign(start, m_it);
-            if (m_it != m_line.cend()) {
+            if (m_it != m_lineEnd) {
                 // eat trailing whitespace
                 ++m_it;
             }
@@ -127,13 +178,13 @@ public:
         }
 
         auto it = m_it;
-        const auto end = m_line.cend();
+        const auto end = m_lineEnd;
         while (it != end && *it != ' ') {
             ++it;
         }
         if (it != m_it) {
-            str = std::string(m_it, it);
-            if (*it == ' ') {
+            str.assign(m_it, it);
+            if (it != end) {
                 ++it;
             }
             m_it = it;
@@ -145,10 +196,10 @@ public:
 
     bool operator>>(bool& flag)
     {
-        if (m_it != m_line.cend()) {
+        if (m_it != m_lineEnd) {
             flag = *m_it;
             m_it++;
-            if (*m_it == ' ') {
+            if (m_it != m_lineEnd && *m_it == ' ') {
                 ++m_it;
             }
             return true;
@@ -158,9 +209,71 @@ public:
     }
 
 private:
+    /// maps the lower case hex digits to their value, all other chars to -1
+    struct HexDigits
+    {
+        constexpr HexDigits()
+            : values()
+        {
+            for (int i = 0; i < 256; ++i) {
+                values[i] = -1;
+            }
+            for (int i = 0; i < 10; ++i) {
+                values['0' + i] = i;
+            }
+            for (int i = 0; i < 6; ++i) {
+                values['a' + i] = 10 + i;
+            }
+        }
+
+        signed char values[256];
+    };
+
+    /**
+     * Read the next block of @p in, after the incomplete line that remains of the current block.
+     *
+     * @return false when nothing could be read anymore
+     */
+    bool readBlock(std::istream& in)
+    {
+        const auto remaining = m_blockEnd - m_blockPos;
+        if (m_blockPos) {
+            memmove(m_block.data(), m_block.data() + m_blockPos, remaining);
+        } else if (remaining == m_block.size()) {
+            // a single line doesn't fit into the block
+            m_block.resize(m_block.size() * 2);
+        }
+        m_blockPos = 0;
+        m_blockEnd = remaining;
+
+        if (!in.good()) {
+            return false;
+        }
+        in.read(m_block.data() + remaining, m_block.size() - remaining);
+        const auto read = static_cast<size_t>(in.gcount());
+        m_blockEnd += read;
+        return read > 0;
+    }
+
+    void resetIterator()
+    {
+        if (m_lineEnd - m_lineBegin > 2) {
+            m_it = m_lineBegin + 2;
+        } else {
+            m_it = m_lineEnd;
+        }
+    }
+
     bool m_expectSizedStrings = false;
-    std::string m_line;
-    std::string::const_iterator m_it;
+    std::vector<char> m_block;
+    size_t m_blockPos = 0;
+    size_t m_blockEnd = 0;
+    // the current line, either in the block or in m_line
+    const char* m_lineBegin = nullptr;
+    const char* m_lineEnd = nullptr;
+    const char* m_it = nullptr;
+    mutable std::string m_line;
+    mutable bool m_lineIsString = false;
 };
 
 #endif // LINEREADER_H
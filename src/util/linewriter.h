@@ -8,6 +8,7 @@
 #define LINEWRITER_H
 
 #include <algorithm>
+#include <chrono>
 #include <iterator>
 #include <memory>
 #include <type_traits>
@@ -33,6 +34,21 @@ public:
         BUFFER_CAPACITY = PIPE_BUF
     };
 
+    /**
+     * Receives the buffered data instead of the file descriptor, e.g. to compress it on the fly.
+     */
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+
+        /// @return false when the data could not be written
+        virtual bool write(const char* data, size_t size) = 0;
+
+        /// write out everything that is still pending, nothing gets written afterwards
+        virtual bool close() = 0;
+    };
+
     LineWriter(int fd)
         : fd(fd)
         , buffer(new char[BUFFER_CAPACITY])
@@ -102,8 +118,14 @@ public:
      */
     bool write(const std::string& line)
     {
-        const auto length = line.length();
+        return writeString(line.data(), line.length());
+    }
 
+    /**
+     * write a string of @p length bytes at @p data to the buffer, prefixed by its size like write(std::string)
+     */
+    bool writeString(const char* data, size_t length)
+    {
         {
             // first write the size of the string
             constexpr const int maxHexCharsForSize = 16 + 1; // 2^64 == 16^16 + 1 space
@@ -122,14 +144,10 @@ public:
                 return false;
             }
             if (availableSpace() < length) {
-                int ret = 0;
-                do {
-                    ret = ::write(fd, line.data(), length);
-                } while (ret < 0 && errno == EINTR);
-                return ret >= 0;
+                return writeOut(data, length);
             }
         }
-        memcpy(out(), line.data(), length);
+        memcpy(out(), data, length);
         bufferSize += length;
         return true;
     }
@@ -252,12 +270,13 @@ public:
             return true;
         }
 
-        int ret = 0;
-        do {
-            ret = ::write(fd, buffer.get(), bufferSize);
-        } while (ret < 0 && errno == EINTR);
+        const auto start = std::chrono::steady_clock::now();
+
+        const auto written = writeOut(buffer.get(), bufferSize);
 
-        if (ret < 0) {
+        flushTime += std::chrono::steady_clock::now() - start;
+
+        if (!written) {
             return false;
         }
 
@@ -266,20 +285,64 @@ public:
         return true;
     }
 
+    /**
+     * @return the total time spent within flush
+     *
+     * Writing into a full pipe blocks, so this grows quickly when the reader cannot keep up.
+     */
+    std::chrono::nanoseconds totalFlushTime() const
+    {
+        return flushTime;
+    }
+
     bool canWrite() const
     {
-        return fd != -1;
+        return fd != -1 || sink;
+    }
+
+    /**
+     * Write all data to @p sink instead of the file descriptor, which gets closed.
+     *
+     * Not signal safe, so only use it outside of libheaptrack.
+     */
+    void setSink(std::unique_ptr<Sink> sink)
+    {
+        flush();
+        close();
+        this->sink = std::move(sink);
     }
 
-    void close()
+    /**
+     * @return false when the sink failed to write out its pending data
+     */
+    bool close()
     {
         if (fd != -1) {
             ::close(fd);
             fd = -1;
         }
+        bool ret = true;
+        if (sink) {
+            ret = sink->close();
+            sink.reset();
+        }
+        return ret;
     }
 
 private:
+    bool writeOut(const char* data, size_t size)
+    {
+        if (sink) {
+            return sink->write(data, size);
+        }
+
+        int ret = 0;
+        do {
+            ret = ::write(fd, data, size);
+        } while (ret < 0 && errno == EINTR);
+        return ret >= 0;
+    }
+
     size_t availableSpace() const
     {
         return BUFFER_CAPACITY - bufferSize;
@@ -293,6 +356,8 @@ private:
     int fd = -1;
     unsigned bufferSize = 0;
     std::unique_ptr<char[]> buffer;
+    std::unique_ptr<Sink> sink;
+    std::chrono::nanoseconds flushTime {0};
 };
 
 #endif
@@ -24,10 +24,11 @@ struct IndexedAllocationInfo
 {
     uint64_t size;
     TraceIndex traceIndex;
+    uint32_t tag;
     AllocationInfoIndex allocationIndex;
     bool operator==(const IndexedAllocationInfo& rhs) const
     {
-        return rhs.traceIndex == traceIndex && rhs.size == size;
+        return rhs.traceIndex == traceIndex && rhs.size == size && rhs.tag == tag;
         // allocationInfoIndex not compared to allow to look it up
     }
 };
@@ -49,6 +50,7 @@ struct hash<IndexedAllocationInfo>
         size_t seed = 0;
         hashCombine(seed, info.size);
         hashCombine(seed, info.traceIndex.index);
+        hashCombine(seed, info.tag);
         // allocationInfoIndex not hashed to allow to look it up
         return seed;
     }
@@ -62,10 +64,10 @@ struct AllocationInfoSet
         set.reserve(625000);
     }
 
-    bool add(uint64_t size, TraceIndex traceIndex, AllocationInfoIndex* allocationIndex)
+    bool add(uint64_t size, TraceIndex traceIndex, AllocationInfoIndex* allocationIndex, uint32_t tag = 0)
     {
         allocationIndex->index = set.size();
-        IndexedAllocationInfo info = {size, traceIndex, *allocationIndex};
+        IndexedAllocationInfo info = {size, traceIndex, tag, *allocationIndex};
         auto it = set.find(info);
         if (it != set.end()) {
             *allocationIndex = it->allocationIndex;
@@ -0,0 +1,90 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef RECENTALLOCATIONS_H
+#define RECENTALLOCATIONS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A small ring buffer of the most recent allocations that are still alive.
+ *
+ * This generalizes the detection of temporary allocations: Instead of only
+ * considering a deallocation that immediately follows its allocation, we
+ * classify an allocation as short-lived when it gets freed while it is still
+ * one of the last few allocations. This catches the common pattern of a handful
+ * of allocations that are created and destroyed in LIFO order within a single
+ * scope, which are good candidates for stack allocations or small buffer
+ * optimizations.
+ *
+ * The key can be anything that identifies an allocation, i.e. a pointer
+ * or an allocation info index.
+ */
+class RecentAllocations
+{
+public:
+    // the number of outstanding allocations we look back
+    static constexpr std::size_t WINDOW_SIZE = 16;
+
+    RecentAllocations()
+    {
+        clear();
+    }
+
+    void add(uint64_t key)
+    {
+        // when the window is full, this overwrites the oldest allocation
+        m_keys[m_next] = key;
+        m_next = (m_next + 1) % WINDOW_SIZE;
+        if (m_size < WINDOW_SIZE) {
+            ++m_size;
+        }
+    }
+
+    /**
+     * @return true when @p key is one of the recent allocations, which
+     *         then gets removed from the window
+     */
+    bool take(uint64_t key)
+    {
+        // search backwards from the most recent allocation, LIFO patterns will find their match right away
+        for (std::size_t i = 1; i <= m_size; ++i) {
+            if (m_keys[slot(i)] != key) {
+                continue;
+            }
+            // close the gap by moving the newer allocations back by one, such that the window
+            // keeps covering the last WINDOW_SIZE allocations that are still alive
+            for (; i > 1; --i) {
+                m_keys[slot(i)] = m_keys[slot(i - 1)];
+            }
+            m_next = slot(1);
+            --m_size;
+            return true;
+        }
+        return false;
+    }
+
+    void clear()
+    {
+        m_next = 0;
+        m_size = 0;
+    }
+
+private:
+    // the slot of the i-th most recent allocation, starting at 1
+    std::size_t slot(std::size_t i) const
+    {
+        return (m_next + WINDOW_SIZE - i) % WINDOW_SIZE;
+    }
+
+    std::array<uint64_t, WINDOW_SIZE> m_keys;
+    std::size_t m_next = 0;
+    std::size_t m_size = 0;
+};
+
+#endif // RECENTALLOCATIONS_H
@@ -0,0 +1,431 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "3rdparty/doctest.h"
+
+#include "analyze/accumulatedtracedata.h"
+
+#include "tempfile.h"
+
+#include <fstream>
+#include <string>
+
+using namespace std;
+
+namespace {
+struct TestData : AccumulatedTraceData
+{
+    void handleTimeStamp(int64_t /*oldStamp*/, int64_t /*newStamp*/, bool /*isFinalTimeStamp*/,
+                         const ParsePass /*pass*/) override
+    {
+    }
+
+    void handleAllocation(const AllocationInfo& /*info*/, const AllocationInfoIndex /*index*/) override
+    {
+    }
+
+    void handleDebuggee(const char* /*command*/) override
+    {
+    }
+
+    bool read(const string& contents)
+    {
+        TempFile file;
+        {
+            ofstream out(file.fileName);
+            out << contents;
+        }
+        return AccumulatedTraceData::read(file.fileName, false);
+    }
+
+    const PhaseCost* phase(const string& name) const
+    {
+        for (const auto& phase : phases) {
+            if (stringify(phase.name) == name) {
+                return &phase;
+            }
+        }
+        return nullptr;
+    }
+
+    const TagCost* tag(uint32_t value) const
+    {
+        for (const auto& tag : tags) {
+            if (tag.tag == value) {
+                return &tag;
+            }
+        }
+        return nullptr;
+    }
+};
+
+const string header = "v 10000 4\n"
+                      "X test\n"
+                      "s 5 outer\n"
+                      "s 5 inner\n"
+                      "s 4 mark\n"
+                      "t 1 0\n"
+                      "a 10 1\n"
+                      "a 100 1\n";
+
+// an allocation outside of any phase, then two occurrences of the outer phase of which the first one
+// contains the inner phase, and a marker in between
+const string phases = header
+    + "c 1\n"
+      "+ 0\n"
+      "> 1\n"
+      "c 2\n"
+      "+ 1\n"
+      "> 2\n"
+      "+ 1\n"
+      "<\n"
+      "- 1 1\n"
+      "! 3\n"
+      "<\n"
+      "c 5\n"
+      "- 0\n"
+      "> 1\n"
+      "c 6\n"
+      "+ 0\n"
+      "<\n"
+      "c 7\n";
+
+// untagged allocations, a named tag that reaches its maximum at the total peak and one that does so later on
+const string tags = "v 10000 4\n"
+                    "X test\n"
+                    "s 3 foo\n"
+                    "t 1 0\n"
+                    "a 10 1\n"
+                    "a 100 1 1\n"
+                    "a 20 1 2\n"
+                    "G 1 1\n"
+                    "c 1\n"
+                    "+ 0\n"
+                    "+ 1\n"
+                    "+ 1\n"
+                    "- 1 1\n"
+                    "+ 2\n"
+                    "+ 2\n"
+                    "- 1\n"
+                    "+ 2\n"
+                    "c 2\n";
+
+// the same tag names in a different order and another tag
+const string otherTags = "v 10000 4\n"
+                         "X test\n"
+                         "s 3 bar\n"
+                         "s 3 foo\n"
+                         "t 1 0\n"
+                         "a 10 1\n"
+                         "a 100 1 1\n"
+                         "a 30 1 3\n"
+                         "G 1 2\n"
+                         "G 3 1\n"
+                         "c 1\n"
+                         "+ 0\n"
+                         "+ 1\n"
+                         "+ 2\n"
+                         "c 2\n";
+}
+
+TEST_CASE ("phases and markers") {
+    TestData data;
+    REQUIRE(data.read(phases));
+
+    REQUIRE(data.totalCost.allocations == 4);
+    REQUIRE(data.totalCost.leaked == 0x110);
+    REQUIRE(data.totalCost.peak == 0x210);
+
+    REQUIRE(data.markers.size() == 1);
+    REQUIRE(data.stringify(data.markers[0].name) == "mark");
+    REQUIRE(data.markers[0].timeStamp == 2);
+    REQUIRE(data.markers[0].consumed == 0x110);
+
+    REQUIRE(data.phases.size() == 2);
+    auto* outer = data.phase("outer");
+    REQUIRE(outer);
+    REQUIRE(outer->occurrences == 2);
+    REQUIRE(outer->duration == 2);
+    REQUIRE(outer->cost.allocations == 3);
+    REQUIRE(outer->cost.temporary == 1);
+    REQUIRE(outer->cost.shortLived == 1);
+    REQUIRE(outer->cost.leaked == 0x110);
+    // the largest increase within one occurrence, the second one only allocated 0x10 bytes
+    REQUIRE(outer->cost.peak == 0x200);
+
+    auto* inner = data.phase("inner");
+    REQUIRE(inner);
+    REQUIRE(inner->occurrences == 1);
+    REQUIRE(inner->duration == 0);
+    REQUIRE(inner->cost.allocations == 1);
+    REQUIRE(inner->cost.leaked == 0x100);
+    REQUIRE(inner->cost.peak == 0x100);
+
+    SUBCASE("unfinished phases end with the data")
+    {
+        TestData unfinished;
+        REQUIRE(unfinished.read(header + "c 1\n> 1\n+ 0\nc 4\n"));
+        auto* phase = unfinished.phase("outer");
+        REQUIRE(phase);
+        REQUIRE(phase->occurrences == 1);
+        REQUIRE(phase->duration == 3);
+        REQUIRE(phase->cost.leaked == 0x10);
+    }
+}
+
+TEST_CASE ("phase filter") {
+    TestData data;
+
+    SUBCASE("outer")
+    {
+        data.filterParameters.phase = "outer";
+        REQUIRE(data.read(phases));
+        // the allocation and deallocation before and between the occurrences are ignored
+        REQUIRE(data.totalCost.allocations == 3);
+        REQUIRE(data.totalCost.temporary == 1);
+        REQUIRE(data.totalCost.leaked == 0x110);
+        REQUIRE(data.totalCost.peak == 0x200);
+    }
+    SUBCASE("inner")
+    {
+        data.filterParameters.phase = "inner";
+        REQUIRE(data.read(phases));
+        REQUIRE(data.totalCost.allocations == 1);
+        REQUIRE(data.totalCost.temporary == 0);
+        REQUIRE(data.totalCost.leaked == 0x100);
+    }
+    SUBCASE("unknown")
+    {
+        data.filterParameters.phase = "unknown";
+        REQUIRE(data.read(phases));
+        REQUIRE(data.totalCost.allocations == 0);
+        REQUIRE(data.totalCost.leaked == 0);
+    }
+
+    // the phases themselves are still reported in full
+    REQUIRE(data.phases.size() == 2);
+}
+
+TEST_CASE ("diff phases") {
+    TestData data;
+    REQUIRE(data.read(phases));
+
+    SUBCASE("same data")
+    {
+        TestData base;
+        REQUIRE(base.read(phases));
+        data.diff(base);
+
+        REQUIRE(data.markers.empty());
+        REQUIRE(data.phases.size() == 2);
+        for (const auto& phase : data.phases) {
+            REQUIRE(phase.occurrences == 0);
+            REQUIRE(phase.duration == 0);
+            REQUIRE(phase.cost == AllocationData());
+        }
+    }
+    SUBCASE("different phases")
+    {
+        // the strings are in a different order, such that the names need to be remapped
+        TestData base;
+        REQUIRE(base.read("v 10000 4\n"
+                          "X test\n"
+                          "s 5 other\n"
+                          "s 5 outer\n"
+                          "t 1 0\n"
+                          "a 10 1\n"
+                          "c 1\n"
+                          "> 1\n"
+                          "+ 0\n"
+                          "c 3\n"
+                          "<\n"
+                          "> 2\n"
+                          "+ 0\n"
+                          "<\n"));
+        data.diff(base);
+
+        REQUIRE(data.phases.size() == 3);
+        auto* outer = data.phase("outer");
+        REQUIRE(outer);
+        REQUIRE(outer->occurrences == 1);
+        REQUIRE(outer->duration == 2);
+        REQUIRE(outer->cost.allocations == 2);
+        REQUIRE(outer->cost.leaked == 0x100);
+
+        auto* inner = data.phase("inner");
+        REQUIRE(inner);
+        REQUIRE(inner->occurrences == 1);
+        REQUIRE(inner->cost.allocations == 1);
+
+        auto* other = data.phase("other");
+        REQUIRE(other);
+        REQUIRE(other->occurrences == -1);
+        REQUIRE(other->duration == -2);
+        REQUIRE(other->cost.allocations == -1);
+        REQUIRE(other->cost.leaked == -0x10);
+    }
+}
+
+TEST_CASE ("tags") {
+    TestData data;
+    REQUIRE(data.read(tags));
+
+    REQUIRE(data.totalCost.peak == 0x210);
+    REQUIRE(data.tags.size() == 3);
+    // the untagged allocations always come first
+    REQUIRE(data.tags[0].tag == 0);
+
+    auto* untagged = data.tag(0);
+    REQUIRE(untagged->cost.allocations == 1);
+    REQUIRE(untagged->cost.leaked == 0x10);
+    REQUIRE(untagged->cost.peak == 0x10);
+    REQUIRE(untagged->maxConsumed == 0x10);
+
+    auto* foo = data.tag(1);
+    REQUIRE(foo);
+    REQUIRE(data.stringify(foo->name) == "foo");
+    REQUIRE(foo->cost.allocations == 2);
+    REQUIRE(foo->cost.temporary == 1);
+    REQUIRE(foo->cost.shortLived == 1);
+    REQUIRE(foo->cost.leaked == 0);
+    REQUIRE(foo->cost.peak == 0x200);
+    REQUIRE(foo->maxConsumed == 0x200);
+
+    auto* unnamed = data.tag(2);
+    REQUIRE(unnamed);
+    REQUIRE(data.stringify(unnamed->name).empty());
+    REQUIRE(unnamed->cost.allocations == 3);
+    REQUIRE(unnamed->cost.temporary == 0);
+    REQUIRE(unnamed->cost.leaked == 0x60);
+    // nothing of this tag was allocated at the time of the total peak
+    REQUIRE(unnamed->cost.peak == 0);
+    REQUIRE(unnamed->maxConsumed == 0x60);
+}
+
+TEST_CASE ("diff tags") {
+    SUBCASE("same data")
+    {
+        TestData data;
+        REQUIRE(data.read(tags));
+        TestData base;
+        REQUIRE(base.read(tags));
+        data.diff(base);
+
+        REQUIRE(data.tags.size() == 3);
+        for (const auto& tag : data.tags) {
+            REQUIRE(tag.cost == AllocationData());
+            REQUIRE(tag.maxConsumed == 0);
+        }
+    }
+    SUBCASE("different tags")
+    {
+        TestData data;
+        REQUIRE(data.read(tags));
+        TestData base;
+        REQUIRE(base.read(otherTags));
+        data.diff(base);
+
+        REQUIRE(data.tags.size() == 4);
+        auto* untagged = data.tag(0);
+        REQUIRE(untagged->cost == AllocationData());
+        REQUIRE(untagged->maxConsumed == 0);
+
+        auto* foo = data.tag(1);
+        REQUIRE(data.stringify(foo->name) == "foo");
+        REQUIRE(foo->cost.allocations == 1);
+        REQUIRE(foo->cost.leaked == -0x100);
+        REQUIRE(foo->cost.peak == 0x100);
+        REQUIRE(foo->maxConsumed == 0x100);
+
+        auto* unnamed = data.tag(2);
+        REQUIRE(unnamed->cost.allocations == 3);
+        REQUIRE(unnamed->maxConsumed == 0x60);
+
+        auto* bar = data.tag(3);
+        REQUIRE(bar);
+        REQUIRE(data.stringify(bar->name) == "bar");
+        REQUIRE(bar->cost.allocations == -1);
+        REQUIRE(bar->cost.leaked == -0x30);
+        REQUIRE(bar->cost.peak == -0x30);
+        REQUIRE(bar->maxConsumed == -0x30);
+    }
+    SUBCASE("untagged data")
+    {
+        const string untagged = "v 10000 4\n"
+                                "X test\n"
+                                "t 1 0\n"
+                                "a 10 1\n"
+                                "c 1\n"
+                                "+ 0\n"
+                                "+ 0\n"
+                                "c 2\n";
+        TestData data;
+        REQUIRE(data.read(untagged));
+        REQUIRE(data.tags.empty());
+        TestData base;
+        REQUIRE(base.read(otherTags));
+        data.diff(base);
+
+        REQUIRE(data.tags.size() == 3);
+        REQUIRE(data.tags[0].tag == 0);
+        REQUIRE(data.tags[0].cost.allocations == 1);
+        REQUIRE(data.tags[0].cost.leaked == 0x10);
+        REQUIRE(data.tags[0].maxConsumed == 0x10);
+        REQUIRE(data.tag(1)->cost.allocations == -1);
+        REQUIRE(data.tag(3)->cost.allocations == -1);
+
+        // and the other way around
+        TestData reversed;
+        REQUIRE(reversed.read(otherTags));
+        TestData untaggedBase;
+        REQUIRE(untaggedBase.read(untagged));
+        reversed.diff(untaggedBase);
+        REQUIRE(reversed.tags.size() == 3);
+        REQUIRE(reversed.tags[0].cost.allocations == -1);
+        REQUIRE(reversed.tags[0].cost.leaked == -0x10);
+        REQUIRE(reversed.tag(1)->cost.allocations == 1);
+    }
+}
+
+TEST_CASE ("sampled intervals") {
+    const string sampling = "v 10000 4\n"
+                            "X test\n"
+                            "c 1\n"
+                            "D 2\n"
+                            "c 3\n"
+                            "D 4\n"
+                            "c 5\n"
+                            "D 2\n"
+                            "c 6\n"
+                            "D 1\n"
+                            "c 8\n"
+                            "D 8\n"
+                            "c 9\n";
+    TestData data;
+    REQUIRE(data.read(sampling));
+
+    // the second interval was still active when the data ended
+    REQUIRE(data.sampledIntervals.size() == 2);
+    REQUIRE(data.sampledIntervals[0].start == 1);
+    REQUIRE(data.sampledIntervals[0].end == 6);
+    REQUIRE(data.sampledIntervals[0].maxRate == 4);
+    REQUIRE(data.sampledIntervals[1].start == 8);
+    REQUIRE(data.sampledIntervals[1].end == 9);
+    REQUIRE(data.sampledIntervals[1].maxRate == 8);
+
+    SUBCASE("reading again")
+    {
+        REQUIRE(data.read(sampling));
+        REQUIRE(data.sampledIntervals.size() == 2);
+    }
+    SUBCASE("older file format")
+    {
+        TestData old;
+        REQUIRE(old.read("v 10000 3\nX test\nc 1\nD 2\nc 2\n"));
+        REQUIRE(old.sampledIntervals.empty());
+    }
+}
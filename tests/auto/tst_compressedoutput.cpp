@@ -0,0 +1,196 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "3rdparty/doctest.h"
+
+#include "interpret/compressedoutput.h"
+
+#include "tempfile.h"
+
+#include <zlib.h>
+
+#if ZSTD_FOUND
+#include <zstd.h>
+#endif
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+/// a temporary file with the given extension, which selects the compression
+struct TempOutput
+{
+    explicit TempOutput(const char* extension)
+        : path(file.fileName + extension)
+    {
+    }
+
+    ~TempOutput()
+    {
+        boost::filesystem::remove(path);
+    }
+
+    TempFile file;
+    const string path;
+};
+
+string readFile(const string& path)
+{
+    ifstream in(path, ios::binary);
+    return {istreambuf_iterator<char>(in), istreambuf_iterator<char>()};
+}
+
+string gunzip(const string& path)
+{
+    string ret;
+    auto* file = gzopen(path.c_str(), "rb");
+    REQUIRE(file);
+    vector<char> buffer(64 * 1024);
+    int read = 0;
+    while ((read = gzread(file, buffer.data(), buffer.size())) > 0) {
+        ret.append(buffer.data(), read);
+    }
+    REQUIRE(read == 0);
+    gzclose(file);
+    return ret;
+}
+
+#if ZSTD_FOUND
+string unzstd(const string& path)
+{
+    const auto compressed = readFile(path);
+    string ret;
+    auto* context = ZSTD_createDCtx();
+    REQUIRE(context);
+    vector<char> buffer(ZSTD_DStreamOutSize());
+    ZSTD_inBuffer input = {compressed.data(), compressed.size(), 0};
+    size_t remaining = 0;
+    while (input.pos < input.size) {
+        ZSTD_outBuffer output = {buffer.data(), buffer.size(), 0};
+        remaining = ZSTD_decompressStream(context, &output, &input);
+        REQUIRE(!ZSTD_isError(remaining));
+        ret.append(buffer.data(), output.pos);
+    }
+    // the frame must be complete
+    REQUIRE(remaining == 0);
+    ZSTD_freeDCtx(context);
+    return ret;
+}
+#endif
+
+/// writes a few MiB of lines like the interpreter does, large enough to require multiple compression jobs
+string writeLines(unique_ptr<LineWriter::Sink> sink)
+{
+    REQUIRE(sink);
+    TempFile unused;
+    REQUIRE(unused.open());
+    LineWriter writer(unused.fd);
+    unused.fd = -1; // closed by setSink
+    writer.setSink(std::move(sink));
+
+    string expected;
+    bool written = true;
+    for (uint32_t i = 0; i < 400000; ++i) {
+        written = writer.writeHexLine('+', i * 2654435761u, i % 97) && written;
+        char line[32];
+        snprintf(line, sizeof(line), "+ %x %x\n", i * 2654435761u, i % 97);
+        expected += line;
+    }
+    REQUIRE(written);
+    REQUIRE(writer.flush());
+    writer.close();
+    return expected;
+}
+
+unique_ptr<LineWriter::Sink> open(const string& path, CompressedOutput::Options options = {})
+{
+    string error;
+    auto sink = CompressedOutput::open(path, options, &error);
+    INFO(error);
+    REQUIRE(sink);
+    REQUIRE(error.empty());
+    return sink;
+}
+}
+
+TEST_CASE ("format detection") {
+    REQUIRE(CompressedOutput::formatForPath("heaptrack.foo.123") == CompressedOutput::Format::Uncompressed);
+    REQUIRE(CompressedOutput::formatForPath("heaptrack.foo.123.gz") == CompressedOutput::Format::Gzip);
+    REQUIRE(CompressedOutput::formatForPath("heaptrack.foo.123.zst") == CompressedOutput::Format::Zstd);
+    REQUIRE(CompressedOutput::formatForPath(".gz.zst") == CompressedOutput::Format::Zstd);
+    REQUIRE(CompressedOutput::formatForPath("gz") == CompressedOutput::Format::Uncompressed);
+
+    REQUIRE(CompressedOutput::isSupported(CompressedOutput::Format::Uncompressed));
+    REQUIRE(CompressedOutput::isSupported(CompressedOutput::Format::Gzip));
+#if ZSTD_FOUND
+    REQUIRE(CompressedOutput::isSupported(CompressedOutput::Format::Zstd));
+#else
+    REQUIRE(!CompressedOutput::isSupported(CompressedOutput::Format::Zstd));
+#endif
+}
+
+TEST_CASE ("round trip") {
+    SUBCASE("uncompressed")
+    {
+        TempOutput output("");
+        const auto expected = writeLines(open(output.path));
+        REQUIRE(readFile(output.path) == expected);
+    }
+
+    SUBCASE("gzip")
+    {
+        TempOutput output(".gz");
+        for (int level : {0, 1, 9}) {
+            CAPTURE(level);
+            CompressedOutput::Options options;
+            options.level = level;
+            const auto expected = writeLines(open(output.path, options));
+            const auto compressed = readFile(output.path);
+            REQUIRE(compressed.size() < expected.size());
+            // the gzip magic
+            REQUIRE(compressed.compare(0, 2, "\x1f\x8b") == 0);
+            REQUIRE(gunzip(output.path) == expected);
+        }
+    }
+
+#if ZSTD_FOUND
+    SUBCASE("zstd")
+    {
+        TempOutput output(".zst");
+        for (unsigned threads : {0u, 1u, 4u}) {
+            CAPTURE(threads);
+            CompressedOutput::Options options;
+            options.threads = threads;
+            const auto expected = writeLines(open(output.path, options));
+            REQUIRE(readFile(output.path).size() < expected.size());
+            REQUIRE(unzstd(output.path) == expected);
+        }
+    }
+#endif
+
+    SUBCASE("empty")
+    {
+        TempOutput output(".gz");
+        open(output.path)->close();
+        REQUIRE(gunzip(output.path).empty());
+    }
+}
+
+TEST_CASE ("errors") {
+    string error;
+    REQUIRE(!CompressedOutput::open("/does/not/exist.gz", {}, &error));
+    REQUIRE(error.find("/does/not/exist.gz") != string::npos);
+
+#if !ZSTD_FOUND
+    error.clear();
+    TempOutput output(".zst");
+    REQUIRE(!CompressedOutput::open(output.path, {}, &error));
+    REQUIRE(!error.empty());
+#endif
+}
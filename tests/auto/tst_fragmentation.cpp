@@ -0,0 +1,161 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "3rdparty/doctest.h"
+
+#include "interpret/fragmentation.h"
+#include "util/linewriter.h"
+
+#include "tempfile.h"
+
+#include <string>
+
+using namespace std;
+
+namespace {
+const uint64_t PAGE = 0x1000;
+
+/// @return the records that @p writer writes for the current state of @p fragmentation
+string write(Fragmentation& fragmentation, void (Fragmentation::*writer)(LineWriter&))
+{
+    TempFile file;
+    REQUIRE(file.open());
+    {
+        LineWriter out(file.fd);
+        (fragmentation.*writer)(out);
+        REQUIRE(out.flush());
+    }
+    // closed by the LineWriter
+    file.fd = -1;
+    return file.readContents();
+}
+
+string writeTimeStamp(Fragmentation& fragmentation)
+{
+    return write(fragmentation, &Fragmentation::writeTimeStamp);
+}
+
+string writeFinalLayout(Fragmentation& fragmentation)
+{
+    return write(fragmentation, &Fragmentation::writeFinalLayout);
+}
+}
+
+TEST_CASE ("page occupancy") {
+    Fragmentation fragmentation;
+    fragmentation.setPageSize(PAGE);
+    REQUIRE(writeTimeStamp(fragmentation).empty());
+
+    // two allocations on the same page
+    fragmentation.addAllocation(PAGE, 0x10);
+    fragmentation.addAllocation(PAGE + 0x10, 0x20);
+    REQUIRE(writeTimeStamp(fragmentation)
+            == "F 30 1\n"
+               "L 30 1 0\n"
+               "f 10 1 10 1\n"
+               "f 20 1 20 1\n"
+               "H 1000 1000 30\n");
+    // nothing changed
+    REQUIRE(writeTimeStamp(fragmentation).empty());
+
+    // an allocation that spans two pages
+    fragmentation.addAllocation(2 * PAGE - 0x10, 0x20);
+    REQUIRE(writeTimeStamp(fragmentation)
+            == "F 50 2\n"
+               "L 50 2 0\n"
+               "f 10 1 10 1\n"
+               "f 20 2 40 2\n"
+               "H 1000 1000 40 10\n");
+
+    // the page stays occupied until its last allocation got freed
+    fragmentation.removeAllocation(2 * PAGE - 0x10);
+    fragmentation.removeAllocation(PAGE);
+    // unknown and repeated deallocations are ignored
+    fragmentation.removeAllocation(PAGE);
+    fragmentation.removeAllocation(3 * PAGE);
+    // the heap shrunk, so no new layout gets written
+    REQUIRE(writeTimeStamp(fragmentation) == "F 20 1\n");
+
+    fragmentation.removeAllocation(PAGE + 0x10);
+    REQUIRE(writeTimeStamp(fragmentation) == "F 0 0\n");
+    REQUIRE(writeFinalLayout(fragmentation).empty());
+}
+
+TEST_CASE ("missed deallocation") {
+    Fragmentation fragmentation;
+    fragmentation.setPageSize(PAGE);
+    fragmentation.addAllocation(PAGE, 0x10);
+    // e.g. the deallocation happened before we attached, the allocation gets replaced
+    fragmentation.addAllocation(PAGE, 0x20);
+    REQUIRE(writeTimeStamp(fragmentation)
+            == "F 20 1\n"
+               "L 20 1 0\n"
+               "f 20 1 20 1\n"
+               "H 1000 1000 20\n");
+    fragmentation.removeAllocation(PAGE);
+    REQUIRE(writeTimeStamp(fragmentation) == "F 0 0\n");
+}
+
+TEST_CASE ("holes") {
+    Fragmentation fragmentation;
+    fragmentation.setPageSize(PAGE);
+    // pages 2 and 3 are holes between the occupied pages 1 and 4
+    fragmentation.addAllocation(PAGE, 0x10);
+    fragmentation.addAllocation(4 * PAGE, 0x10);
+    // too far away to be a hole, this starts a separate address range
+    fragmentation.addAllocation(0x200 * PAGE, 0x10);
+    REQUIRE(writeTimeStamp(fragmentation)
+            == "F 30 3\n"
+               "L 30 3 2\n"
+               "f 10 3 30 3\n"
+               "H 1000 1000 10 0 0 10\n"
+               "H 200000 1000 10\n");
+}
+
+TEST_CASE ("large allocations") {
+    Fragmentation fragmentation;
+    fragmentation.setPageSize(PAGE);
+    // spans 33 pages, which get accounted separately
+    fragmentation.addAllocation(0x100 * PAGE, 33 * PAGE);
+    fragmentation.addAllocation(PAGE, 0x10);
+    const auto records = writeTimeStamp(fragmentation);
+    // the 254 pages between the two are holes
+    REQUIRE(records.compare(0, records.find("H "),
+                            "F 21010 22\n"
+                            "L 21010 22 fe\n"
+                            "f 0 1 21000 21\n"
+                            "f 10 1 10 1\n")
+            == 0);
+    // the range covers 0x120 pages, which get distributed over buckets of five pages
+    REQUIRE(records.compare(records.find("H "), 16, "H 1000 5000 10 0") == 0);
+
+    // freeing the large allocation doesn't touch the pages of the small one
+    fragmentation.removeAllocation(0x100 * PAGE);
+    REQUIRE(writeTimeStamp(fragmentation) == "F 10 1\n");
+}
+
+TEST_CASE ("layout snapshots") {
+    Fragmentation fragmentation;
+    fragmentation.setPageSize(PAGE);
+    for (uint64_t page = 1; page <= 40; ++page) {
+        fragmentation.addAllocation(page * PAGE, PAGE);
+    }
+    REQUIRE(writeTimeStamp(fragmentation).find("L 28000 28 0\n") != string::npos);
+
+    // less than 5% growth doesn't write a new layout
+    fragmentation.addAllocation(41 * PAGE, 0x10);
+    fragmentation.addAllocation(42 * PAGE, 0x10);
+    REQUIRE(writeTimeStamp(fragmentation) == "F 28020 2a\n");
+
+    // but the final layout gets written when the heap grew since the last one
+    const auto final = writeFinalLayout(fragmentation);
+    REQUIRE(final.compare(0, 14, "L 28020 2a 0\nf") == 0);
+    REQUIRE(writeFinalLayout(fragmentation).empty());
+
+    fragmentation.addAllocation(43 * PAGE, 0x10);
+    REQUIRE(writeTimeStamp(fragmentation) == "F 28030 2b\n");
+}
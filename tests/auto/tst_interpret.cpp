@@ -0,0 +1,86 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "3rdparty/doctest.h"
+
+#include "tempfile.h"
+#include "tst_config.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+const string INTERPRET = HEAPTRACK_LIBEXEC_DIR "/heaptrack_interpret";
+
+/// @return the lines of the interpreted @p raw data that start with @p mode
+vector<string> interpret(const string& raw, char mode)
+{
+    TempFile input;
+    {
+        ofstream out(input.fileName);
+        out << raw;
+    }
+    TempFile output;
+    const auto command = INTERPRET + " < " + input.fileName + " > " + output.fileName + " 2> /dev/null";
+    INFO(command);
+    REQUIRE(system(command.c_str()) == 0);
+
+    vector<string> lines;
+    istringstream contents(output.readContents());
+    string line;
+    while (getline(contents, line)) {
+        if (line.size() > 1 && line[0] == mode && line[1] == ' ') {
+            lines.push_back(line);
+        }
+    }
+    return lines;
+}
+}
+
+TEST_CASE ("arena resets") {
+    // sizes 0xa, 0x14, ... get allocation info indices 0, 1, ... assigned in order
+    const string allocations = "t 1 0\n"
+                               "+ a 1 100 a1\n"
+                               "+ 14 1 200 a1\n"
+                               "+ 1e 1 300 a2\n"
+                               "+ 28 1 400\n";
+
+    SUBCASE("a reset frees the live pointers of its arena")
+    {
+        const auto deallocations = interpret(allocations
+                                                 + "- 200\n"
+                                                   "r a1\n"
+                                                   "r a2\n"
+                                                   "r a2\n"
+                                                   "- 400\n",
+                                             '-');
+        // 200 got freed before the reset, 400 isn't tied to an arena and the second reset has nothing left to free
+        REQUIRE(deallocations == vector<string> {"- 1 1", "- 0", "- 2", "- 3 1"});
+    }
+    SUBCASE("a reused pointer is dropped from its arena")
+    {
+        const auto deallocations = interpret(allocations
+                                                 + "- 100\n"
+                                                   "+ 32 1 100 a2\n"
+                                                   "+ 3c 1 200 a2\n"
+                                                   "+ 46 1 500 a1\n"
+                                                   "r a1\n"
+                                                   "r a2\n",
+                                             '-');
+        // 100 got freed and reallocated, 200 got reallocated without getting freed, both are tied to a2 now
+        REQUIRE(deallocations == vector<string> {"- 0 1", "- 6", "- 4", "- 5", "- 2"});
+    }
+    SUBCASE("unknown arena")
+    {
+        REQUIRE(interpret(allocations + "r a3\n", '-').empty());
+    }
+}
@@ -116,6 +116,52 @@ TEST_CASE ("write flush") {
     REQUIRE(file.readContents() == data1 + data2);
 }
 
+TEST_CASE ("write to sink") {
+    struct StringSink : LineWriter::Sink
+    {
+        StringSink(string* contents, bool* closed)
+            : contents(contents)
+            , closed(closed)
+        {
+        }
+
+        bool write(const char* data, size_t size) override
+        {
+            contents->append(data, size);
+            return true;
+        }
+
+        bool close() override
+        {
+            *closed = true;
+            return true;
+        }
+
+        string* contents;
+        bool* closed;
+    };
+
+    string contents;
+    bool closed = false;
+    {
+        LineWriter writer(-1);
+        REQUIRE(!writer.canWrite());
+        writer.setSink(unique_ptr<LineWriter::Sink>(new StringSink(&contents, &closed)));
+        REQUIRE(writer.canWrite());
+
+        REQUIRE(writer.writeHexLine('t', 0x123u, 0x456u));
+        REQUIRE(contents.empty());
+        const string longString(LineWriter::BUFFER_CAPACITY * 2, '*');
+        REQUIRE(writer.write(longString));
+        REQUIRE(writer.flush());
+        ostringstream expectedContents;
+        expectedContents << "t 123 456\n" << std::hex << longString.size() << ' ' << longString;
+        REQUIRE(contents == expectedContents.str());
+        REQUIRE(!closed);
+    }
+    REQUIRE(closed);
+}
+
 TEST_CASE ("read line 64bit") {
     const string contents =
         "m /tmp/KDevelop-5.2.1-x86_64/usr/lib/libKF5Completion.so.5 7f48beedc00 0 36854 236858 2700\n";
@@ -176,3 +222,43 @@ TEST_CASE ("read line 32bit") {
     REQUIRE(idx == 0x0);
     REQUIRE(!(reader >> idx));
 }
+
+TEST_CASE ("read lines across blocks") {
+    const string longString(LineReader::BLOCK_SIZE * 3, '*');
+    ostringstream contents;
+    for (unsigned i = 0; i < 10000; ++i) {
+        contents << "+ " << std::hex << i << '\n';
+        if (i % 1000 == 0) {
+            contents << "s " << longString.size() << ' ' << longString << '\n';
+        }
+    }
+    // the last line has no trailing newline
+    contents << "c 1234";
+    REQUIRE(contents.str().size() > LineReader::BLOCK_SIZE * 2);
+
+    stringstream stream(contents.str());
+    LineReader reader;
+    reader.setExpectedSizedStrings(true);
+    for (unsigned i = 0; i < 10000; ++i) {
+        REQUIRE(reader.getLine(stream));
+        REQUIRE(reader.mode() == '+');
+        uint32_t idx = 0;
+        REQUIRE((reader >> idx));
+        REQUIRE(idx == i);
+        REQUIRE(!(reader >> idx));
+        if (i % 1000 == 0) {
+            REQUIRE(reader.getLine(stream));
+            REQUIRE(reader.mode() == 's');
+            string str;
+            REQUIRE((reader >> str));
+            REQUIRE(str == longString);
+        }
+    }
+
+    REQUIRE(reader.getLine(stream));
+    REQUIRE(reader.line() == "c 1234");
+    uint64_t timeStamp = 0;
+    REQUIRE((reader >> timeStamp));
+    REQUIRE(timeStamp == 0x1234);
+    REQUIRE(!reader.getLine(stream));
+}
@@ -12,9 +12,20 @@
 
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <future>
 #include <iostream>
+#include <set>
+#include <sstream>
 #include <thread>
 #include <vector>
 
@@ -90,6 +101,41 @@ TEST_CASE ("api") {
             heaptrack_invalidate_module_cache();
         }
 
+        SUBCASE("batch")
+        {
+            void* ptrs[] = {data, nullptr, data + 1};
+            const size_t sizes[] = {4, 0, 4};
+            heaptrack_malloc_batch(nullptr, ptrs, sizes, 3);
+            heaptrack_free_batch(ptrs, 3);
+            heaptrack_malloc_batch(&data, ptrs, sizes, 3);
+            heaptrack_arena_reset(&data);
+        }
+
+        SUBCASE("phases")
+        {
+            heaptrack_mark("marker");
+            heaptrack_mark(nullptr);
+            heaptrack_push_phase("phase");
+            heaptrack_malloc(data, 4);
+            heaptrack_push_phase("nested\nphase");
+            heaptrack_free(data);
+            heaptrack_pop_phase();
+            heaptrack_pop_phase();
+        }
+
+        SUBCASE("tags")
+        {
+            heaptrack_register_tag(1, "tenant");
+            heaptrack_register_tag(0, "untagged");
+            heaptrack_register_tag(2, nullptr);
+            heaptrack_set_tag(1);
+            heaptrack_malloc(data, 4);
+            heaptrack_set_tag(2);
+            heaptrack_realloc(data, 8, data + 1);
+            heaptrack_clear_tag();
+            heaptrack_free(data + 1);
+        }
+
         SUBCASE("multi-threaded")
         {
             const auto numThreads = min(4u, thread::hardware_concurrency());
@@ -120,3 +166,199 @@ TEST_CASE ("api") {
         }
     }
 }
+
+namespace {
+char freedBuffer[16];
+char leakedBuffer[32];
+
+void __attribute__((noinline)) allocateFreed()
+{
+    heaptrack_malloc(freedBuffer, sizeof(freedBuffer));
+}
+
+void __attribute__((noinline)) allocateLeaked()
+{
+    heaptrack_malloc(leakedBuffer, sizeof(leakedBuffer));
+}
+}
+
+TEST_CASE ("leaks only") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_LEAKS_ONLY", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_LEAKS_ONLY");
+
+    allocateFreed();
+    allocateLeaked();
+    heaptrack_free(freedBuffer);
+    heaptrack_stop();
+
+    bool leaksOnly = false;
+    vector<uint64_t> traceParents;
+    vector<pair<uint64_t, uint64_t>> allocations; // trace index and pointer
+    int deallocations = 0;
+
+    istringstream contents(tmp.readContents());
+    string line;
+    while (getline(contents, line)) {
+        istringstream fields(line.substr(1));
+        fields >> hex;
+        if (line == "l") {
+            leaksOnly = true;
+        } else if (line[0] == 't') {
+            uint64_t ip = 0;
+            uint64_t parent = 0;
+            fields >> ip >> parent;
+            REQUIRE(!fields.fail());
+            // the parents need to be written first
+            REQUIRE(parent <= traceParents.size());
+            traceParents.push_back(parent);
+        } else if (line[0] == '+') {
+            uint64_t size = 0;
+            uint64_t trace = 0;
+            uint64_t ptr = 0;
+            fields >> size >> trace >> ptr;
+            REQUIRE(!fields.fail());
+            allocations.emplace_back(trace, ptr);
+        } else if (line[0] == '-') {
+            ++deallocations;
+        }
+    }
+
+    REQUIRE(leaksOnly);
+    // the freed allocation never gets written, neither its allocation nor its deallocation
+    REQUIRE(allocations.size() == 1);
+    REQUIRE(allocations[0].second == reinterpret_cast<uintptr_t>(leakedBuffer));
+    REQUIRE(deallocations == 0);
+
+    // only the trace entries of the leaked allocation got written, i.e. all of them are on its path to the root
+    set<uint64_t> path;
+    for (auto trace = allocations[0].first; trace; trace = traceParents[trace - 1]) {
+        REQUIRE(trace <= traceParents.size());
+        path.insert(trace);
+    }
+    REQUIRE(!path.empty());
+    REQUIRE(path.size() == traceParents.size());
+}
+
+TEST_CASE ("sampling") {
+    // write into a pipe that we read slowly at first, to simulate an interpreter that cannot keep up
+    TempFile fifo;
+    REQUIRE(mkfifo(fifo.fileName.c_str(), 0600) == 0);
+
+    atomic<bool> throttle {true};
+    atomic<bool> sampled {false};
+    atomic<bool> restored {false};
+    auto reader = async(launch::async, [&]() {
+        const int fd = open(fifo.fileName.c_str(), O_RDONLY | O_CLOEXEC);
+        string contents;
+        char buffer[512];
+        ssize_t size = 0;
+        while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+            contents.append(buffer, size);
+            if (!sampled && contents.find("\nD 2\n") != string::npos) {
+                sampled = true;
+            } else if (sampled && contents.find("\nD 1\n") != string::npos) {
+                restored = true;
+            }
+            if (throttle) {
+                this_thread::sleep_for(chrono::milliseconds(5));
+            }
+        }
+        close(fd);
+        return contents;
+    });
+
+    setenv("HEAPTRACK_MAX_SAMPLING_RATE", "2", 1);
+    heaptrack_init(fifo.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_MAX_SAMPLING_RATE");
+
+    auto waitFor = [](const atomic<bool>& condition, const function<void()>& work) {
+        const auto timeout = chrono::steady_clock::now() + chrono::seconds(20);
+        while (!condition && chrono::steady_clock::now() < timeout) {
+            work();
+        }
+        return condition.load();
+    };
+
+    int data = 0;
+    const bool wasSampled = waitFor(sampled, [&]() {
+        heaptrack_malloc(&data, 4);
+        heaptrack_free(&data);
+    });
+    throttle = false;
+    const bool wasRestored = waitFor(restored, []() { this_thread::sleep_for(chrono::milliseconds(10)); });
+
+    heaptrack_stop();
+    const auto contents = reader.get();
+
+    REQUIRE(wasSampled);
+    REQUIRE(wasRestored);
+    // the sampling rate got raised only once, as configured, and every change comes with a time stamp
+    REQUIRE(contents.find("\nD 4\n") == string::npos);
+    const auto raised = contents.find("\nD 2\n");
+    const auto lowered = contents.find("\nD 1\n");
+    REQUIRE(raised < lowered);
+    auto previousLine = [&](size_t lineEnd) { return contents.substr(contents.rfind('\n', lineEnd - 1) + 1, 2); };
+    REQUIRE(previousLine(raised) == "c ");
+    REQUIRE(previousLine(lowered) == "c ");
+}
+
+TEST_CASE ("follow fork") {
+    TempFile parentOutput; // opened/closed by heaptrack_init
+    TempFile childOutput;
+    setenv("HEAPTRACK_FOLLOW_FORK", childOutput.fileName.c_str(), 1);
+    heaptrack_init(parentOutput.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_FOLLOW_FORK");
+
+    char parentData[4];
+    char childData[8];
+    heaptrack_malloc(parentData, sizeof(parentData));
+
+    const auto pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+        // the child gets initialized on its first call into heaptrack
+        heaptrack_malloc(childData, sizeof(childData));
+        heaptrack_free(childData);
+        heaptrack_stop();
+        _exit(0);
+    }
+
+    int status = 0;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+
+    heaptrack_free(parentData);
+    heaptrack_stop();
+
+    // the process id gets appended to the output name of the child
+    const auto childFileName = childOutput.fileName + '.' + to_string(pid);
+    string childContents;
+    {
+        ifstream ifs(childFileName, ios::binary);
+        REQUIRE(ifs.is_open());
+        childContents.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+    }
+    boost::filesystem::remove(childFileName);
+
+    // the child inherited the allocations of the parent, like when attaching at runtime
+    REQUIRE(childContents.find("\nA\n") != string::npos);
+    REQUIRE(childContents.find("\n+ 8 ") != string::npos);
+    REQUIRE(childContents.find("\n+ 4 ") == string::npos);
+
+    // the output of the parent continues after the fork and doesn't contain anything of the child
+    const auto parentContents = parentOutput.readContents();
+    REQUIRE(!parentContents.empty());
+    REQUIRE(parentContents.back() == '\n');
+    REQUIRE(parentContents.find("\nA\n") == string::npos);
+    REQUIRE(parentContents.find("\n+ 8 ") == string::npos);
+    ostringstream ptr;
+    ptr << hex << reinterpret_cast<uintptr_t>(parentData);
+    const auto allocation = parentContents.find("\n+ 4 ");
+    REQUIRE(allocation != string::npos);
+    REQUIRE(parentContents.find(' ' + ptr.str() + '\n', allocation) != string::npos);
+    REQUIRE(parentContents.find("\n- " + ptr.str() + '\n', allocation) != string::npos);
+}
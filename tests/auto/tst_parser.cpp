@@ -195,6 +195,7 @@ TEST_CASE ("heaptrack.david.18594.gz") {
     REQUIRE(summary.debuggee == "./david");
     REQUIRE(summary.cost.allocations == 2896);
     REQUIRE(summary.cost.temporary == 729);
+    REQUIRE(summary.cost.shortLived == 962);
     REQUIRE(summary.cost.leaked == 0);
     REQUIRE(summary.totalLeakedSuppressed == 30463);
     REQUIRE(summary.cost.peak == 996970);
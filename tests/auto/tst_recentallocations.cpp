@@ -0,0 +1,113 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "3rdparty/doctest.h"
+
+#include "util/recentallocations.h"
+
+TEST_CASE ("take recent allocations") {
+    RecentAllocations recent;
+    REQUIRE(!recent.take(1));
+
+    recent.add(1);
+    recent.add(2);
+    recent.add(3);
+
+    SUBCASE("lifo")
+    {
+        REQUIRE(recent.take(3));
+        REQUIRE(recent.take(2));
+        REQUIRE(recent.take(1));
+    }
+    SUBCASE("fifo")
+    {
+        REQUIRE(recent.take(1));
+        REQUIRE(recent.take(2));
+        REQUIRE(recent.take(3));
+    }
+    SUBCASE("keys are taken only once")
+    {
+        REQUIRE(recent.take(2));
+        REQUIRE(!recent.take(2));
+        REQUIRE(!recent.take(4));
+    }
+    SUBCASE("clear")
+    {
+        recent.clear();
+        REQUIRE(!recent.take(1));
+        REQUIRE(!recent.take(3));
+    }
+}
+
+TEST_CASE ("window eviction") {
+    RecentAllocations recent;
+    for (uint64_t i = 0; i < RecentAllocations::WINDOW_SIZE; ++i) {
+        recent.add(i);
+    }
+
+    SUBCASE("window is full")
+    {
+        for (uint64_t i = 0; i < RecentAllocations::WINDOW_SIZE; ++i) {
+            REQUIRE(recent.take(i));
+        }
+    }
+    SUBCASE("oldest allocations get evicted")
+    {
+        recent.add(100);
+        recent.add(101);
+        REQUIRE(!recent.take(0));
+        REQUIRE(!recent.take(1));
+        for (uint64_t i = 2; i < RecentAllocations::WINDOW_SIZE; ++i) {
+            REQUIRE(recent.take(i));
+        }
+        REQUIRE(recent.take(100));
+        REQUIRE(recent.take(101));
+    }
+    SUBCASE("taken keys free their slot")
+    {
+        // the window covers the last WINDOW_SIZE allocations that are still alive
+        REQUIRE(recent.take(5));
+        recent.add(100);
+        REQUIRE(recent.take(0));
+        recent.add(101);
+        recent.add(102);
+        REQUIRE(!recent.take(1));
+        for (uint64_t i = 2; i < RecentAllocations::WINDOW_SIZE; ++i) {
+            REQUIRE(recent.take(i) == (i != 5));
+        }
+        REQUIRE(recent.take(100));
+        REQUIRE(recent.take(101));
+        REQUIRE(recent.take(102));
+    }
+    SUBCASE("lifo pattern doesn't evict older allocations")
+    {
+        REQUIRE(recent.take(RecentAllocations::WINDOW_SIZE - 1));
+        for (uint64_t i = 100; i < 200; ++i) {
+            recent.add(i);
+            REQUIRE(recent.take(i));
+        }
+        for (uint64_t i = 0; i < RecentAllocations::WINDOW_SIZE - 1; ++i) {
+            REQUIRE(recent.take(i));
+        }
+    }
+}
+
+TEST_CASE ("duplicate keys") {
+    // keys like allocation info indices repeat, the most recent one gets taken first
+    RecentAllocations recent;
+    recent.add(1);
+    for (uint64_t i = 2; i < RecentAllocations::WINDOW_SIZE; ++i) {
+        recent.add(i);
+    }
+    recent.add(1);
+
+    REQUIRE(recent.take(1));
+    recent.add(100);
+    recent.add(101);
+    // the first occurrence of 1 got evicted now
+    REQUIRE(!recent.take(1));
+}
@@ -0,0 +1,110 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "3rdparty/doctest.h"
+
+#include "interpret/stringinterner.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+void requireInterned(StringInterner& interner, const string& str, size_t id)
+{
+    // intern a copy, such that the lookup has to compare against the copy in the arena
+    const string copy = str;
+    const auto result = interner.intern(copy);
+    REQUIRE(!result.inserted);
+    REQUIRE(result.id == id);
+}
+}
+
+TEST_CASE ("ids") {
+    StringInterner interner;
+    REQUIRE(interner.size() == 0);
+
+    auto result = interner.intern("foo");
+    REQUIRE(result.inserted);
+    REQUIRE(result.id == 1);
+
+    result = interner.intern("bar");
+    REQUIRE(result.inserted);
+    REQUIRE(result.id == 2);
+
+    result = interner.intern("foo");
+    REQUIRE(!result.inserted);
+    REQUIRE(result.id == 1);
+
+    SUBCASE("prefixes and embedded nulls are distinct strings")
+    {
+        REQUIRE(interner.intern("fo").id == 3);
+        REQUIRE(interner.intern("foo\0", 4).id == 4);
+        REQUIRE(interner.intern("foo", 3).id == 1);
+        REQUIRE(interner.intern("").id == 5);
+        REQUIRE(!interner.intern("").inserted);
+        REQUIRE(interner.size() == 5);
+    }
+
+    SUBCASE("the source of a string doesn't matter")
+    {
+        const char buffer[] = "xfoox";
+        requireInterned(interner, string(buffer + 1, 3), 1);
+        REQUIRE(!interner.intern(buffer + 1, 3).inserted);
+        REQUIRE(interner.size() == 2);
+    }
+}
+
+TEST_CASE ("large strings") {
+    StringInterner interner;
+    const size_t quarter = StringInterner::BLOCK_SIZE / 4;
+    // strings up to a quarter of the block size get stored in the blocks, larger ones separately
+    const vector<string> strings = {
+        string(quarter - 1, 'a'),
+        string(quarter, 'b'),
+        string(quarter + 1, 'c'),
+        string(quarter, 'd'),
+        string(StringInterner::BLOCK_SIZE, 'e'),
+        string(4 * StringInterner::BLOCK_SIZE, 'f'),
+        "small",
+    };
+    for (size_t i = 0; i < strings.size(); ++i) {
+        const auto result = interner.intern(strings[i]);
+        REQUIRE(result.inserted);
+        REQUIRE(result.id == i + 1);
+    }
+    for (size_t i = 0; i < strings.size(); ++i) {
+        requireInterned(interner, strings[i], i + 1);
+    }
+    // only differs in the last char
+    auto modified = strings[1];
+    modified.back() = 'x';
+    REQUIRE(interner.intern(modified).inserted);
+}
+
+TEST_CASE ("block rollover") {
+    StringInterner interner;
+    // strings of varying length that don't divide the block size, such that they fill multiple blocks
+    // and the last string of every block doesn't fit anymore
+    vector<string> strings;
+    size_t totalSize = 0;
+    for (size_t i = 0; totalSize < 4 * StringInterner::BLOCK_SIZE; ++i) {
+        strings.push_back(to_string(i) + string(i % 1000, '.'));
+        totalSize += strings.back().size();
+    }
+    for (size_t i = 0; i < strings.size(); ++i) {
+        const auto result = interner.intern(strings[i]);
+        REQUIRE(result.inserted);
+        REQUIRE(result.id == i + 1);
+    }
+    REQUIRE(interner.size() == strings.size());
+    // the strings in the earlier blocks stay valid
+    for (size_t i = 0; i < strings.size(); ++i) {
+        requireInterned(interner, strings[i], i + 1);
+    }
+}
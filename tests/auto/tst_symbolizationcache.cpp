@@ -0,0 +1,198 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "3rdparty/doctest.h"
+
+#include "interpret/symbolizationcache.h"
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <functional>
+#include <thread>
+
+using namespace std;
+
+namespace {
+const string BUILD_ID = "0123456789abcdef";
+
+struct TempDir
+{
+    TempDir()
+        : path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path())
+    {
+    }
+
+    ~TempDir()
+    {
+        boost::filesystem::remove_all(path);
+    }
+
+    string cacheFile(const string& buildId = BUILD_ID) const
+    {
+        return (path / buildId).native();
+    }
+
+    const boost::filesystem::path path;
+};
+
+SymbolizationCache::Frames frames(const string& function, int line)
+{
+    return {{function, "file.cpp", line}, {function + "_caller", "other.cpp", line + 1}};
+}
+}
+
+bool operator==(const SymbolizationCache::Frame& lhs, const SymbolizationCache::Frame& rhs)
+{
+    return lhs.function == rhs.function && lhs.file == rhs.file && lhs.line == rhs.line;
+}
+
+TEST_CASE ("round trip") {
+    TempDir dir;
+    {
+        SymbolizationCache cache(dir.path.native());
+        SymbolizationCache::Frames found;
+        REQUIRE(!cache.find(BUILD_ID, 0x10, &found));
+
+        cache.insert(BUILD_ID, 0x20, frames("b", 2));
+        cache.insert(BUILD_ID, 0x10, frames("a", 1));
+        cache.insert(BUILD_ID, 0x30, {});
+        // new entries are found before they got written
+        REQUIRE(cache.find(BUILD_ID, 0x10, &found));
+        REQUIRE(found == frames("a", 1));
+    }
+    REQUIRE(boost::filesystem::exists(dir.cacheFile()));
+
+    SymbolizationCache cache(dir.path.native());
+    SymbolizationCache::Frames found;
+    REQUIRE(cache.find(BUILD_ID, 0x10, &found));
+    REQUIRE(found == frames("a", 1));
+    REQUIRE(cache.find(BUILD_ID, 0x20, &found));
+    REQUIRE(found == frames("b", 2));
+    REQUIRE(cache.find(BUILD_ID, 0x30, &found));
+    REQUIRE(found.empty());
+    REQUIRE(!cache.find(BUILD_ID, 0x18, &found));
+    REQUIRE(!cache.find("fedcba9876543210", 0x10, &found));
+}
+
+TEST_CASE ("invalid build-ids") {
+    TempDir dir;
+    {
+        SymbolizationCache cache(dir.path.native());
+        cache.insert("../escape", 0x10, frames("a", 1));
+        cache.insert("", 0x10, frames("a", 1));
+        SymbolizationCache::Frames found;
+        REQUIRE(!cache.find("../escape", 0x10, &found));
+    }
+    REQUIRE(!boost::filesystem::exists(dir.path));
+}
+
+TEST_CASE ("invalid files") {
+    TempDir dir;
+    {
+        SymbolizationCache cache(dir.path.native());
+        cache.insert(BUILD_ID, 0x10, frames("a", 1));
+    }
+    const auto file = dir.cacheFile();
+    const auto size = boost::filesystem::file_size(file);
+
+    auto modify = [&](const char* description, const std::function<void(fstream&)>& modifier) {
+        CAPTURE(description);
+        {
+            SymbolizationCache cache(dir.path.native());
+            cache.insert(BUILD_ID, 0x10, frames("a", 1));
+        }
+        {
+            fstream stream(file, ios::in | ios::out | ios::binary);
+            modifier(stream);
+        }
+        SymbolizationCache cache(dir.path.native());
+        SymbolizationCache::Frames found;
+        REQUIRE(!cache.find(BUILD_ID, 0x10, &found));
+    };
+
+    modify("magic", [](fstream& stream) { stream.write("X", 1); });
+    modify("version", [](fstream& stream) {
+        stream.seekp(8);
+        const uint32_t version = 0;
+        stream.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    });
+    modify("number of entries", [](fstream& stream) {
+        stream.seekp(12);
+        const uint32_t numEntries = 2;
+        stream.write(reinterpret_cast<const char*>(&numEntries), sizeof(numEntries));
+    });
+    modify("unterminated strings", [size](fstream& stream) {
+        stream.seekp(size - 1);
+        stream.write("x", 1);
+    });
+    modify("truncated", [&](fstream&) { boost::filesystem::resize_file(file, size - 1); });
+
+    // invalid files get replaced by the next run
+    {
+        SymbolizationCache cache(dir.path.native());
+        cache.insert(BUILD_ID, 0x10, frames("a", 1));
+    }
+    SymbolizationCache cache(dir.path.native());
+    SymbolizationCache::Frames found;
+    REQUIRE(cache.find(BUILD_ID, 0x10, &found));
+    REQUIRE(found == frames("a", 1));
+}
+
+TEST_CASE ("merge") {
+    TempDir dir;
+    {
+        // like two concurrent runs that loaded the cache before either of them wrote it
+        SymbolizationCache first(dir.path.native());
+        SymbolizationCache second(dir.path.native());
+        first.insert(BUILD_ID, 0x10, frames("a", 1));
+        first.insert(BUILD_ID, 0x20, frames("b", 2));
+        second.insert(BUILD_ID, 0x20, frames("b", 3));
+        second.insert(BUILD_ID, 0x30, frames("c", 4));
+        SymbolizationCache::Frames found;
+        REQUIRE(!second.find(BUILD_ID, 0x10, &found));
+    }
+
+    SymbolizationCache cache(dir.path.native());
+    SymbolizationCache::Frames found;
+    REQUIRE(cache.find(BUILD_ID, 0x10, &found));
+    REQUIRE(found == frames("a", 1));
+    // the entries of the cache that got written last win
+    REQUIRE(cache.find(BUILD_ID, 0x20, &found));
+    REQUIRE(found == frames("b", 2));
+    REQUIRE(cache.find(BUILD_ID, 0x30, &found));
+    REQUIRE(found == frames("c", 4));
+}
+
+TEST_CASE ("shared between threads") {
+    TempDir dir;
+    const uint64_t numThreads = 4;
+    const uint64_t numAddresses = 1000;
+    {
+        SymbolizationCache cache(dir.path.native());
+        vector<thread> threads;
+        for (uint64_t i = 0; i < numThreads; ++i) {
+            threads.emplace_back([&cache, i]() {
+                SymbolizationCache::Frames found;
+                for (uint64_t address = i; address < numAddresses; address += numThreads) {
+                    cache.insert(BUILD_ID, address, frames(to_string(address), address));
+                    REQUIRE(cache.find(BUILD_ID, address, &found));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    SymbolizationCache cache(dir.path.native());
+    SymbolizationCache::Frames found;
+    for (uint64_t address = 0; address < numAddresses; ++address) {
+        REQUIRE(cache.find(BUILD_ID, address, &found));
+        REQUIRE(found == frames(to_string(address), address));
+    }
+}
@@ -0,0 +1,87 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "3rdparty/doctest.h"
+
+#include "track/libheaptrack.h"
+
+#include "tempfile.h"
+#include "tst_config.h"
+
+#include <cstdlib>
+#include <string>
+
+using namespace std;
+
+namespace {
+const string INTERPRET = HEAPTRACK_LIBEXEC_DIR "/heaptrack_interpret";
+const string SYMBOLIZE = HEAPTRACK_LIBEXEC_DIR "/heaptrack_symbolize";
+
+char buffer[64];
+
+void __attribute__((noinline)) allocate(int depth)
+{
+    if (depth) {
+        allocate(depth - 1);
+    } else {
+        heaptrack_malloc(buffer, sizeof(buffer));
+        heaptrack_free(buffer);
+    }
+}
+
+inline void __attribute__((always_inline)) allocateInlined()
+{
+    heaptrack_malloc(buffer + 1, 1);
+}
+
+bool run(const string& command)
+{
+    INFO(command);
+    return system(command.c_str()) == 0;
+}
+}
+
+TEST_CASE ("deferred symbolization") {
+    TempFile raw; // opened/closed by heaptrack_init
+    heaptrack_init(raw.fileName.c_str(), nullptr, nullptr, nullptr);
+    for (int i = 0; i < 5; ++i) {
+        allocate(i);
+    }
+    allocateInlined();
+    heaptrack_free(buffer + 1);
+    heaptrack_stop();
+
+    TempFile direct;
+    REQUIRE(run(INTERPRET + " < " + raw.fileName + " > " + direct.fileName + " 2> /dev/null"));
+    TempFile deferred;
+    REQUIRE(run("HEAPTRACK_DEFER_SYMBOLIZATION=1 " + INTERPRET + " < " + raw.fileName + " > " + deferred.fileName
+                + " 2> /dev/null"));
+    const auto directContents = direct.readContents();
+    REQUIRE(directContents.find("\ni ") != string::npos);
+    REQUIRE(deferred.readContents() != directContents);
+
+    SUBCASE("from a file")
+    {
+        TempFile symbolized;
+        REQUIRE(run(SYMBOLIZE + ' ' + deferred.fileName + " > " + symbolized.fileName));
+        REQUIRE(symbolized.readContents() == directContents);
+    }
+    SUBCASE("from stdin")
+    {
+        TempFile symbolized;
+        REQUIRE(run(SYMBOLIZE + " < " + deferred.fileName + " > " + symbolized.fileName));
+        REQUIRE(symbolized.readContents() == directContents);
+    }
+}
+
+TEST_CASE ("empty input") {
+    TempFile empty;
+    REQUIRE(empty.open());
+    TempFile symbolized;
+    REQUIRE(run(SYMBOLIZE + " < " + empty.fileName + " > " + symbolized.fileName));
+    REQUIRE(symbolized.readContents().empty());
+}
@@ -175,6 +175,76 @@ TEST_CASE ("tracetree indexing") {
     }
 }
 
+TEST_CASE ("truncating backtraces") {
+    Trace trace;
+
+    SUBCASE("explicit truncation")
+    {
+        trace.fillTestData(10, 100);
+        REQUIRE(trace.size() == 11);
+        trace.truncate(3);
+        REQUIRE(trace.size() == 4);
+        REQUIRE(trace[0] == Trace::ip_t(100));
+        REQUIRE(trace[2] == Trace::ip_t(2));
+        REQUIRE(trace[3] == reinterpret_cast<Trace::ip_t>(Trace::TRUNCATION_MARKER));
+    }
+
+    SUBCASE("max depth")
+    {
+        Trace::setMaxDepth(4);
+        REQUIRE(fill(trace, 10, 1));
+        Trace::setMaxDepth(Trace::MAX_SIZE);
+
+        REQUIRE(trace.size() == 5);
+        REQUIRE(trace[4] == reinterpret_cast<Trace::ip_t>(Trace::TRUNCATION_MARKER));
+
+        REQUIRE(fill(trace, 10, 1));
+        REQUIRE(trace.size() > 5);
+        REQUIRE(find(trace.begin(), trace.end(), reinterpret_cast<Trace::ip_t>(Trace::TRUNCATION_MARKER))
+                == trace.end());
+    }
+
+    SUBCASE("stop ranges")
+    {
+        REQUIRE(fill(trace, 10, 1));
+        const auto size = trace.size();
+        // the recursion returns to the same address for every level, the first one stops the unwinding
+        const auto stop = reinterpret_cast<uintptr_t>(trace[3]);
+        const auto stopIndex = distance(trace.begin(), find(trace.begin(), trace.end(), trace[3]));
+
+        Trace::setStopRanges({{stop, stop + 1}});
+        REQUIRE(fill(trace, 10, 1));
+        Trace::setStopRanges({});
+
+        REQUIRE(trace.size() == stopIndex + 2);
+        REQUIRE(trace[stopIndex] == reinterpret_cast<Trace::ip_t>(stop));
+        REQUIRE(trace[stopIndex + 1] == reinterpret_cast<Trace::ip_t>(Trace::TRUNCATION_MARKER));
+
+        REQUIRE(fill(trace, 10, 1));
+        REQUIRE(trace.size() == size);
+    }
+
+    SUBCASE("stop ranges replaced while unwinding")
+    {
+        void* data[10];
+        {
+            Trace::setStopRanges({{0x10, 0x20}});
+            Trace::FrameCollector frames(data, 10, 0);
+            // the collector keeps using the ranges it started with, which must not get freed in between
+            Trace::setStopRanges({{0x30, 0x40}});
+            Trace::reclaimStopRanges();
+            REQUIRE(frames.add(0x30));
+            REQUIRE(!frames.add(0x10));
+            REQUIRE(frames.size() == 3);
+        }
+        Trace::reclaimStopRanges();
+
+        Trace::FrameCollector frames(data, 10, 0);
+        REQUIRE(!frames.add(0x30));
+        Trace::setStopRanges({});
+    }
+}
+
 struct CallbackData
 {
     Dwfl* dwfl = nullptr;
@@ -228,7 +298,7 @@ TEST_CASE ("symbolizing") {
         REQUIRE(die);
 
         auto dieName = cuDie->dieName(die->die());
-        auto isDebugBuild = i == 0 && dieName == "Trace::unwind(void**)";
+        auto isDebugBuild = i == 0 && dieName == "Trace::unwind(void**, int, int)";
         if (i == 0 + j) {
             if (!isDebugBuild)
                 REQUIRE(dieName == "Trace::fill(int)");
@@ -262,3 +332,108 @@ TEST_CASE ("symbolizing") {
         }
     }
 }
+
+TEST_CASE ("dwarf range index") {
+    DwarfRangeIndex index;
+
+    SUBCASE("empty")
+    {
+        index.add({0x10, 0x10}, 0);
+        index.build();
+        REQUIRE(index.size() == 0);
+        REQUIRE(index.find(0x10) == -1);
+    }
+
+    SUBCASE("disjoint")
+    {
+        index.add({0x30, 0x40}, 1);
+        index.add({0x10, 0x20}, 0);
+        index.build();
+        REQUIRE(index.size() == 2);
+        REQUIRE(index.find(0) == -1);
+        REQUIRE(index.find(0xf) == -1);
+        REQUIRE(index.find(0x10) == 0);
+        REQUIRE(index.find(0x1f) == 0);
+        // high is exclusive
+        REQUIRE(index.find(0x20) == -1);
+        REQUIRE(index.find(0x2f) == -1);
+        REQUIRE(index.find(0x30) == 1);
+        REQUIRE(index.find(0x3f) == 1);
+        REQUIRE(index.find(0x40) == -1);
+        REQUIRE(index.find(-1) == -1);
+    }
+
+    SUBCASE("overlapping")
+    {
+        index.add({0x10, 0x30}, 1);
+        index.add({0x20, 0x40}, 0);
+        index.build();
+        REQUIRE(index.size() == 2);
+        REQUIRE(index.find(0x10) == 1);
+        REQUIRE(index.find(0x1f) == 1);
+        REQUIRE(index.find(0x20) == 0);
+        REQUIRE(index.find(0x3f) == 0);
+        REQUIRE(index.find(0x40) == -1);
+    }
+
+    SUBCASE("nested in a higher index")
+    {
+        index.add({0x10, 0x40}, 1);
+        index.add({0x20, 0x30}, 0);
+        index.build();
+        REQUIRE(index.size() == 3);
+        REQUIRE(index.find(0x1f) == 1);
+        REQUIRE(index.find(0x20) == 0);
+        REQUIRE(index.find(0x2f) == 0);
+        REQUIRE(index.find(0x30) == 1);
+        REQUIRE(index.find(0x3f) == 1);
+        REQUIRE(index.find(0x40) == -1);
+    }
+
+    SUBCASE("nested in a lower index")
+    {
+        index.add({0x10, 0x40}, 0);
+        index.add({0x20, 0x30}, 1);
+        index.build();
+        REQUIRE(index.size() == 1);
+        REQUIRE(index.find(0x10) == 0);
+        REQUIRE(index.find(0x25) == 0);
+        REQUIRE(index.find(0x3f) == 0);
+        REQUIRE(index.find(0x40) == -1);
+    }
+
+    SUBCASE("discarded code starting at zero")
+    {
+        // the linker discarded the code of index 2, so its range got relocated to start at zero
+        index.add({0x1000, 0x1100}, 0);
+        index.add({0x1100, 0x1200}, 1);
+        index.add({0, 0x1180}, 2);
+        index.build();
+        REQUIRE(index.size() == 3);
+        REQUIRE(index.find(0) == 2);
+        REQUIRE(index.find(0xfff) == 2);
+        REQUIRE(index.find(0x1000) == 0);
+        REQUIRE(index.find(0x10ff) == 0);
+        REQUIRE(index.find(0x1100) == 1);
+        REQUIRE(index.find(0x11ff) == 1);
+        REQUIRE(index.find(0x1200) == -1);
+    }
+
+    SUBCASE("adjacent ranges of the same index get merged")
+    {
+        index.add({0x20, 0x30}, 0);
+        index.add({0x10, 0x20}, 0);
+        // overlapping ranges of the same index, too
+        index.add({0x28, 0x38}, 0);
+        index.add({0x38, 0x40}, 1);
+        index.add({0x40, 0x50}, 1);
+        index.build();
+        REQUIRE(index.size() == 2);
+        REQUIRE(index.find(0x10) == 0);
+        REQUIRE(index.find(0x20) == 0);
+        REQUIRE(index.find(0x37) == 0);
+        REQUIRE(index.find(0x38) == 1);
+        REQUIRE(index.find(0x4f) == 1);
+        REQUIRE(index.find(0x50) == -1);
+    }
+}
@@ -0,0 +1,198 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * Measures the lookups of the CU and subprogram DIEs in a binary with lots of compilation units.
+ *
+ * By default, a synthetic shared library gets generated and compiled with debug information first,
+ * which requires a C compiler, taken from $CC or `cc`. Alternatively, pass the path to an existing
+ * binary with debug information.
+ */
+
+#include <src/interpret/dwarfdiecache.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+struct Options
+{
+    int cus = 2000;
+    int functions = 50;
+    string binary;
+};
+
+bool parseOptions(int argc, char** argv, Options* options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg == "--cus" && i + 1 < argc) {
+            options->cus = max(1, atoi(argv[++i]));
+        } else if (arg == "--functions" && i + 1 < argc) {
+            options->functions = max(1, atoi(argv[++i]));
+        } else if (arg[0] != '-' && options->binary.empty()) {
+            options->binary = arg;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @return the path to the generated library, or an empty string on failure
+string generateBinary(const Options& options)
+{
+    char dirTemplate[] = "/tmp/bench_dwarfdiecache.XXXXXX";
+    if (!mkdtemp(dirTemplate)) {
+        return {};
+    }
+    const string dir = dirTemplate;
+
+    for (int cu = 0; cu < options.cus; ++cu) {
+        ofstream out(dir + "/cu" + to_string(cu) + ".c");
+        out << "static inline __attribute__((always_inline)) int inlined_" << cu << "(int i) { return i * " << cu
+            << "; }\n";
+        for (int function = 0; function < options.functions; ++function) {
+            out << "int function_" << cu << '_' << function << "(int i) { return inlined_" << cu << "(i) + "
+                << function << "; }\n";
+        }
+    }
+
+    const char* cc = getenv("CC");
+    const string compiler = cc ? cc : "cc";
+    const string library = dir + "/libsynthetic.so";
+    const string command = "cd " + dir + " && ls cu*.c | xargs -P " + to_string(sysconf(_SC_NPROCESSORS_ONLN))
+        + " -n 64 " + compiler + " -g -O1 -fPIC -c && " + compiler + " -shared -o " + library + " cu*.o";
+    cerr << "generating " << options.cus << " compilation units in " << dir << '\n';
+    if (system(command.c_str()) != 0) {
+        return {};
+    }
+    return library;
+}
+
+template <typename Callback>
+double measure(const Callback& callback)
+{
+    const auto start = chrono::steady_clock::now();
+    callback();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        cerr << "usage: " << argv[0] << " [--cus N] [--functions N per CU] [binary with debug info]\n";
+        return 1;
+    }
+
+    const auto binary = options.binary.empty() ? generateBinary(options) : options.binary;
+    if (binary.empty()) {
+        cerr << "failed to generate the synthetic binary\n";
+        return 1;
+    }
+
+    Dwfl_Callbacks callbacks = {
+        &dwfl_build_id_find_elf,
+        &dwfl_standard_find_debuginfo,
+        &dwfl_offline_section_address,
+        nullptr,
+    };
+    auto dwfl = unique_ptr<Dwfl, void (*)(Dwfl*)>(dwfl_begin(&callbacks), &dwfl_end);
+    dwfl_report_begin(dwfl.get());
+    auto* module = dwfl_report_offline(dwfl.get(), binary.c_str(), binary.c_str(), -1);
+    dwfl_report_end(dwfl.get(), nullptr, nullptr);
+    if (!module) {
+        cerr << "failed to load " << binary << ": " << dwfl_errmsg(dwfl_errno()) << '\n';
+        return 1;
+    }
+
+    // look up the start and middle of every function, like the return addresses of a backtrace
+    vector<Dwarf_Addr> addresses;
+    const auto numSymbols = dwfl_module_getsymtab(module);
+    for (int i = 0; i < numSymbols; ++i) {
+        GElf_Sym sym;
+        GElf_Addr addr = 0;
+        if (dwfl_module_getsym_info(module, i, &sym, &addr, nullptr, nullptr, nullptr)
+            && GELF_ST_TYPE(sym.st_info) == STT_FUNC && sym.st_size) {
+            addresses.push_back(addr);
+            addresses.push_back(addr + sym.st_size / 2);
+        }
+    }
+
+    Dwarf_Addr bias = 0;
+    if (!dwfl_module_getdwarf(module, &bias)) {
+        cerr << "no debug information found in " << binary << '\n';
+        return 1;
+    }
+
+    // the first lookup visits the CUs, lazily via the aranges if possible
+    unique_ptr<DwarfDieCache> cache;
+    const auto firstLookupTime = measure([&]() {
+        cache = make_unique<DwarfDieCache>(module);
+        cache->findCuDie(addresses.empty() ? 0 : addresses.front());
+    });
+
+    size_t foundCus = 0;
+    auto findCus = [&]() {
+        foundCus = 0;
+        for (auto addr : addresses) {
+            foundCus += cache->findCuDie(addr) != nullptr;
+        }
+    };
+    const auto coldCuTime = measure(findCus);
+    const auto warmCuTime = measure(findCus);
+
+    // the linear scan that was used before, for comparison
+    size_t linearCus = 0;
+    const auto linearCuTime = measure([&]() {
+        for (auto addr : addresses) {
+            for (const auto& cuDie : cache->m_cuDieRanges) {
+                if (cuDie.contains(addr)) {
+                    ++linearCus;
+                    break;
+                }
+            }
+        }
+    });
+
+    // the first lookup in every CU caches its subprograms
+    size_t foundSubprograms = 0;
+    auto findSubprograms = [&]() {
+        foundSubprograms = 0;
+        for (auto addr : addresses) {
+            if (auto* cuDie = cache->findCuDie(addr)) {
+                foundSubprograms += cuDie->findSubprogramDie(addr - cuDie->bias()) != nullptr;
+            }
+        }
+    };
+    const auto coldSubprogramTime = measure(findSubprograms);
+    const auto warmSubprogramTime = measure(findSubprograms);
+
+    auto perLookup = [&](double milliseconds) { return milliseconds * 1E6 / max<size_t>(1, addresses.size()); };
+    cout << fixed << setprecision(1);
+    cout << cache->m_cuDieRanges.size() << " CUs, " << addresses.size() << " addresses, " << foundCus
+         << " found in a CU (" << linearCus << " via linear scan), " << foundSubprograms << " in a subprogram\n";
+    cout << setw(28) << left << "first findCuDie:" << firstLookupTime << "ms\n";
+    cout << setw(28) << left << "findCuDie (cold):" << perLookup(coldCuTime) << "ns per lookup\n";
+    cout << setw(28) << left << "findCuDie (warm):" << perLookup(warmCuTime) << "ns per lookup\n";
+    cout << setw(28) << left << "linear CU scan:" << perLookup(linearCuTime) << "ns per lookup\n";
+    cout << setw(28) << left << "findSubprogramDie (cold):" << perLookup(coldSubprogramTime) << "ns per lookup\n";
+    cout << setw(28) << left << "findSubprogramDie (warm):" << perLookup(warmSubprogramTime) << "ns per lookup\n";
+    return foundCus == linearCus ? 0 : 1;
+}
@@ -6,10 +6,69 @@
 
 #include <src/util/linereader.h>
 
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
 
+namespace {
+/// the line based parsing that LineReader used before, via std::getline and branchy hex parsing
+uint64_t readGetline(std::istream& in)
+{
+    uint64_t ret = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        uint64_t hex = 0;
+        for (auto it = line.cbegin() + std::min<size_t>(2, line.size()); it != line.cend(); ++it) {
+            const char c = *it;
+            if ('0' <= c && c <= '9') {
+                hex = hex * 16 + c - '0';
+            } else if ('a' <= c && c <= 'f') {
+                hex = hex * 16 + c - 'a' + 10;
+            } else {
+                ret += hex;
+                hex = 0;
+            }
+        }
+        ret += hex;
+    }
+    return ret;
+}
+
+uint64_t readLineReader(std::istream& in)
+{
+    uint64_t ret = 0;
+    LineReader reader;
+    while (reader.getLine(in)) {
+        uint64_t hex;
+        while (reader.readHex(hex)) {
+            ret += hex;
+        }
+    }
+    return ret;
+}
+
+template <typename Reader>
+uint64_t measure(const char* name, const std::string& contents, size_t lines, const Reader& reader)
+{
+    uint64_t ret = 0;
+    const int iterations = 100;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        std::istringstream in(contents);
+        ret += reader(in);
+    }
+    const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::setw(12) << std::left << name << std::fixed << std::setprecision(1)
+              << (contents.size() * iterations / seconds / 1024 / 1024) << " MiB/s, "
+              << (lines * iterations / seconds / 1E6) << "M lines/s\n";
+    return ret;
+}
+}
+
 int main()
 {
     std::string contents;
@@ -19,19 +78,11 @@ int main()
         contents.append("102 345 678 9ab\n");
         contents.append("102345 6789ab cdef01 23456789\n");
     }
+    const size_t lines = 300000;
 
-    uint64_t ret = 0;
-    for (int i = 0; i < 1000; ++i) {
-        std::istringstream in(contents);
-        LineReader reader;
-        while (reader.getLine(in)) {
-            uint64_t hex;
-            while (reader.readHex(hex)) {
-                ret += hex;
-            }
-        }
-    }
+    const auto getlineSum = measure("getline:", contents, lines, readGetline);
+    const auto lineReaderSum = measure("LineReader:", contents, lines, readLineReader);
 
-    std::cout << ret << '\n';
-    return 0;
+    std::cout << lineReaderSum << '\n';
+    return getlineSum == lineReaderSum ? 0 : 1;
 }
@@ -0,0 +1,260 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * Multi-threaded allocation workloads, to measure the overhead of heaptrack under contention.
+ *
+ * Run it once plainly and once within heaptrack to compare the numbers. To also measure
+ * the amount of data written per event, let heaptrack write its raw data to a regular file:
+ *
+ *   LD_PRELOAD=lib/heaptrack/libheaptrack_preload.so DUMP_HEAPTRACK_OUTPUT=/tmp/raw bench_malloc_threads
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <benchutil.h>
+
+using namespace std;
+
+namespace {
+
+enum class Sizes
+{
+    // 8 to 128 bytes
+    Small,
+    // 8 bytes to 64KiB, smaller sizes being more likely
+    Mixed,
+    // 64KiB to 1MiB
+    Large,
+};
+
+enum class Lifetime
+{
+    // every allocation gets freed right away
+    Temporary,
+    // allocations get freed in reverse order, like objects on the stack
+    Lifo,
+    // allocations get freed in the order they were allocated, like in a queue
+    Fifo,
+    // allocations replace a random one of a pool of live allocations
+    Random,
+};
+
+struct Options
+{
+    vector<unsigned> threads = {1, 2, 4, 8};
+    uint64_t allocations = 1000000;
+    Sizes sizes = Sizes::Small;
+    int depth = 10;
+    Lifetime lifetime = Lifetime::Lifo;
+    // the number of live allocations for the lifo, fifo and random lifetimes
+    size_t window = 64;
+};
+
+struct Random
+{
+    uint64_t state;
+
+    uint64_t operator()()
+    {
+        // xorshift64, cheap enough to not distort the measurements
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
+size_t randomSize(Sizes sizes, Random& random)
+{
+    switch (sizes) {
+    case Sizes::Small:
+        return 8 + random() % 121;
+    case Sizes::Mixed:
+        // pick the power of two uniformly, which favors small sizes
+        return (size_t(1) << (3 + random() % 13)) + random() % 8;
+    case Sizes::Large:
+        return (64 << 10) + random() % (960 << 10);
+    }
+    return 0;
+}
+
+/**
+ * Run the allocation workload of one thread, @p depth frames down the stack.
+ */
+__attribute__((noinline)) void allocate(const Options& options, int depth, Random& random)
+{
+    if (depth > 0) {
+        allocate(options, depth - 1, random);
+        clobber(); // prevent tail call optimization, the frames should be on the stack
+        return;
+    }
+
+    vector<void*> live(options.window, nullptr);
+    size_t next = 0;
+    for (uint64_t i = 0; i < options.allocations; ++i) {
+        void* ptr = malloc(randomSize(options.sizes, random));
+        escape(ptr);
+        switch (options.lifetime) {
+        case Lifetime::Temporary:
+            free(ptr);
+            break;
+        case Lifetime::Lifo:
+            live[next++] = ptr;
+            if (next == live.size()) {
+                while (next) {
+                    free(live[--next]);
+                }
+            }
+            break;
+        case Lifetime::Fifo:
+            free(live[next]);
+            live[next] = ptr;
+            next = (next + 1) % live.size();
+            break;
+        case Lifetime::Random: {
+            auto& slot = live[random() % live.size()];
+            free(slot);
+            slot = ptr;
+            break;
+        }
+        }
+    }
+    if (options.lifetime == Lifetime::Lifo) {
+        // the other slots were freed already
+        live.resize(next);
+    }
+    for (auto* ptr : live) {
+        free(ptr);
+    }
+}
+
+/**
+ * @return the size of the raw heaptrack output, or -1 when we don't run in heaptrack or write into a pipe
+ */
+int64_t heaptrackOutputSize()
+{
+    const auto* output = getenv("DUMP_HEAPTRACK_OUTPUT");
+    struct stat outputStat;
+    if (!output || stat(output, &outputStat) != 0 || !S_ISREG(outputStat.st_mode)) {
+        return -1;
+    }
+    return outputStat.st_size;
+}
+
+bool parseOptions(int argc, char** argv, Options* options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (i + 1 == argc) {
+            return false;
+        }
+        const string value = argv[++i];
+        if (arg == "--threads") {
+            options->threads.clear();
+            istringstream stream(value);
+            string count;
+            while (getline(stream, count, ',')) {
+                options->threads.push_back(max(1, atoi(count.c_str())));
+            }
+        } else if (arg == "--allocations") {
+            options->allocations = strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--depth") {
+            options->depth = max(0, atoi(value.c_str()));
+        } else if (arg == "--window") {
+            options->window = max(1, atoi(value.c_str()));
+        } else if (arg == "--sizes" && value == "small") {
+            options->sizes = Sizes::Small;
+        } else if (arg == "--sizes" && value == "mixed") {
+            options->sizes = Sizes::Mixed;
+        } else if (arg == "--sizes" && value == "large") {
+            options->sizes = Sizes::Large;
+        } else if (arg == "--lifetime" && value == "temporary") {
+            options->lifetime = Lifetime::Temporary;
+        } else if (arg == "--lifetime" && value == "lifo") {
+            options->lifetime = Lifetime::Lifo;
+        } else if (arg == "--lifetime" && value == "fifo") {
+            options->lifetime = Lifetime::Fifo;
+        } else if (arg == "--lifetime" && value == "random") {
+            options->lifetime = Lifetime::Random;
+        } else {
+            return false;
+        }
+    }
+    return !options->threads.empty();
+}
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        cerr << "usage: " << argv[0]
+             << " [--threads 1,2,4,8] [--allocations N per thread] [--sizes small|mixed|large]"
+                " [--depth N] [--lifetime temporary|lifo|fifo|random] [--window N]\n";
+        return 1;
+    }
+
+    cout << setw(8) << "threads" << setw(16) << "ns per call" << setw(16) << "calls/s" << setw(10) << "scaling";
+    const bool measureOutput = heaptrackOutputSize() >= 0;
+    if (measureOutput) {
+        cout << setw(16) << "bytes per call";
+    }
+    cout << '\n';
+
+    double baseThroughput = 0;
+    for (auto threads : options.threads) {
+        const auto outputSizeBefore = heaptrackOutputSize();
+        atomic<unsigned> waiting(threads);
+        vector<thread> workers;
+        const auto start = chrono::steady_clock::now();
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back([&options, &waiting, i]() {
+                Random random = {0x9e3779b97f4a7c15ull * (i + 1)};
+                // start all threads at the same time to maximize contention
+                --waiting;
+                while (waiting) {
+                    this_thread::yield();
+                }
+                allocate(options, options.depth, random);
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        const auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // every allocation gets freed again
+        const double calls = 2. * options.allocations * threads;
+        const auto throughput = calls / elapsed;
+        if (!baseThroughput) {
+            baseThroughput = throughput / threads;
+        }
+        cout << setw(8) << threads << setw(16) << fixed << setprecision(1) << (elapsed * threads * 1E9 / calls)
+             << setw(16) << setprecision(0) << throughput << setw(9) << setprecision(2)
+             << (throughput / baseThroughput) << 'x';
+        if (measureOutput) {
+            // this is not exact, as heaptrack buffers its output, but close enough for many calls
+            cout << setw(16) << setprecision(2) << ((heaptrackOutputSize() - outputSizeBefore) / calls);
+        }
+        cout << endl;
+    }
+
+    return 0;
+}
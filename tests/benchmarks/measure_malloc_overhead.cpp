@@ -4,6 +4,7 @@
     SPDX-License-Identifier: LGPL-2.1-or-later
 */
 
+#include <chrono>
 #include <iostream>
 #include <malloc.h>
 #include <unistd.h>
@@ -12,6 +13,33 @@
 
 using namespace std;
 
+extern "C" {
+// only available when running within heaptrack
+__attribute__((weak)) void heaptrack_pause();
+__attribute__((weak)) void heaptrack_resume();
+}
+
+// the time per pair of malloc and free, in nanoseconds, the best of a few runs to reduce the noise
+double measureCallCost(int size)
+{
+    const auto iterations = 1000000;
+    double best = 0;
+    for (int run = 0; run < 3; ++run) {
+        const auto start = chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            auto ptr = malloc(size);
+            escape(ptr);
+            free(ptr);
+        }
+        const auto elapsed = chrono::steady_clock::now() - start;
+        const auto cost = chrono::duration<double, nano>(elapsed).count() / iterations;
+        if (!run || cost < best) {
+            best = cost;
+        }
+    }
+    return best;
+}
+
 int main()
 {
     const auto log2_max = 17;
@@ -38,5 +66,25 @@ int main()
         const auto actual = (cost[i] - baseline);
         cout << sizes[i] << "\t\t|\t" << actual << "\t|\t" << (actual - sizes[i]) << '\n';
     }
+
+    // run this once plainly and once within heaptrack to see the per-call cost of the hooks
+    // while paused, heaptrack only runs the fast path of the hooks
+    const bool canPause = heaptrack_pause && heaptrack_resume;
+    cout << "\nrequested\t|\tns per malloc+free";
+    if (canPause) {
+        cout << "\t|\tns while paused\t|\tpaused vs. tracked";
+    }
+    cout << '\n';
+    for (int size : {16, 256, 4096}) {
+        const auto tracked = measureCallCost(size);
+        cout << size << "\t\t|\t" << tracked;
+        if (canPause) {
+            heaptrack_pause();
+            const auto paused = measureCallCost(size);
+            heaptrack_resume();
+            cout << "\t\t\t|\t" << paused << "\t\t|\t" << (100. * paused / tracked) << "%";
+        }
+        cout << '\n';
+    }
     return 0;
 }
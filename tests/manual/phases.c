@@ -0,0 +1,39 @@
+/*
+    SPDX-FileCopyrightText: 2026 agent <agent@local>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define HEAPTRACK_API_DLSYM 1
+#include "track/heaptrack_api.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void handle_request(int size)
+{
+    heaptrack_report_push_phase("request");
+    for (int i = 0; i < 10; ++i) {
+        free(malloc(size));
+    }
+    heaptrack_report_pop_phase();
+}
+
+int main()
+{
+    heaptrack_report_push_phase("startup");
+    char* config = malloc(1000);
+    heaptrack_report_pop_phase();
+
+    for (int i = 0; i < 5; ++i) {
+        char name[32];
+        snprintf(name, sizeof(name), "request batch %d", i);
+        heaptrack_report_mark(name);
+        handle_request(100 * (i + 1));
+    }
+
+    heaptrack_report_push_phase("shutdown");
+    free(config);
+    heaptrack_report_pop_phase();
+    return 0;
+}